@@ -0,0 +1,78 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "asyncExecutor.h"
+
+namespace badgerdb {
+
+AsyncExecutor::AsyncExecutor()
+  : pending(0)
+{
+}
+
+void AsyncExecutor::startRequest()
+{
+  std::lock_guard<std::mutex> guard(latch);
+  pending++;
+}
+
+void AsyncExecutor::completeRequest(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    ready.push_back(std::move(task));
+  }
+  completed.notify_one();
+}
+
+bool AsyncExecutor::next(std::function<void()>& task, const bool wait)
+{
+  std::unique_lock<std::mutex> guard(latch);
+  if (wait)
+    completed.wait(guard, [this]() { return !ready.empty() || pending == 0; });
+  if (ready.empty())
+    return false;
+  task = std::move(ready.front());
+  ready.pop_front();
+
+  // counted as done before it runs, so a continuation that throws does not
+  // leave run() waiting for it forever
+  pending--;
+  return true;
+}
+
+std::size_t AsyncExecutor::run()
+{
+  std::size_t count = 0;
+  std::function<void()> task;
+  while (next(task, true))
+  {
+    task();
+    count++;
+  }
+  return count;
+}
+
+std::size_t AsyncExecutor::poll()
+{
+  std::size_t count = 0;
+  std::function<void()> task;
+  while (next(task, false))
+  {
+    task();
+    count++;
+  }
+  return count;
+}
+
+std::size_t AsyncExecutor::outstanding()
+{
+  std::lock_guard<std::mutex> guard(latch);
+  return pending;
+}
+
+}
@@ -0,0 +1,93 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace badgerdb {
+
+/**
+* @brief Runs the completions of asynchronous requests on the thread that
+* calls run(), so one thread can keep many page reads in flight and handle
+* each as it finishes.
+*
+* A request is announced with startRequest() when it is issued. Whoever
+* completes it, typically an I/O thread, hands its continuation to
+* completeRequest(). run() executes continuations in the order they complete
+* until no request is left outstanding; continuations may issue further
+* requests, which run() then also waits for. Everything but run() and poll()
+* may be called from any thread.
+*/
+class AsyncExecutor
+{
+ public:
+  AsyncExecutor();
+
+	/**
+   * Announces a request whose continuation will be passed to completeRequest().
+	 */
+  void startRequest();
+
+	/**
+   * Queues the continuation of a request announced with startRequest().
+	 *
+	 * @param task   	Continuation, run by run() or poll()
+	 */
+  void completeRequest(std::function<void()> task);
+
+	/**
+   * Runs continuations, waiting for outstanding requests, until no request is
+	 * left. An exception thrown by a continuation is passed on; the requests
+	 * still outstanding then are left for the next call.
+	 *
+	 * @return  			Number of continuations run
+	 */
+  std::size_t run();
+
+	/**
+   * Runs the continuations that are queued, without waiting.
+	 *
+	 * @return  			Number of continuations run
+	 */
+  std::size_t poll();
+
+	/**
+   * Returns the number of requests started and not yet completed and run.
+	 */
+  std::size_t outstanding();
+
+ private:
+  AsyncExecutor(const AsyncExecutor&);
+  AsyncExecutor& operator=(const AsyncExecutor&);
+
+	/**
+   * Take the next queued continuation, waiting for one if wait is true.
+	 *
+	 * @return  			False if there was none to take
+	 */
+  bool next(std::function<void()>& task, const bool wait);
+
+	/**
+   * Continuations of completed requests, in completion order
+	 */
+  std::deque<std::function<void()> > ready;
+
+	/**
+   * Requests started whose continuation has not been run yet
+	 */
+  std::size_t pending;
+
+  std::mutex latch;
+  std::condition_variable completed;
+};
+
+}
@@ -0,0 +1,2546 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "buffer.h"
+#include "bufHashTbl.h"
+#include "bufPoolMgr.h"
+#include "file.h"
+#include "file_iterator.h"
+#include "filescan.h"
+#include "page.h"
+#include "page_iterator.h"
+#include "shmBufMgr.h"
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/page_pinned_exception.h"
+
+using namespace badgerdb;
+
+// -----------------------------------------------------------------------------
+// Globals
+// -----------------------------------------------------------------------------
+const std::string benchFileName = "bench.db";
+
+// Every page of the bench file holds a single record of this type.
+typedef struct counter {
+	PageId pageNo;
+	long long count;
+} COUNTER;
+
+// The chained hash table BufHashTbl used to be, kept to compare against. The
+// only change is that the hash is computed unsigned, as the original could
+// produce a negative bucket index.
+class ChainedHashTbl
+{
+ public:
+	struct bucket {
+		const File* file;
+		PageId pageNo;
+		FrameId frameNo;
+		bucket* next;
+	};
+
+	ChainedHashTbl(int htSize) : HTSIZE(htSize)
+	{
+		ht = new bucket*[htSize];
+		for (int i = 0; i < HTSIZE; i++)
+			ht[i] = NULL;
+	}
+
+	~ChainedHashTbl()
+	{
+		for (int i = 0; i < HTSIZE; i++)
+		{
+			while (ht[i])
+			{
+				bucket* tmpBuc = ht[i];
+				ht[i] = ht[i]->next;
+				delete tmpBuc;
+			}
+		}
+		delete [] ht;
+	}
+
+	void insert(const File* file, const PageId pageNo, const FrameId frameNo)
+	{
+		int index = hash(file, pageNo);
+		bucket* tmpBuc = new bucket;
+		tmpBuc->file = file;
+		tmpBuc->pageNo = pageNo;
+		tmpBuc->frameNo = frameNo;
+		tmpBuc->next = ht[index];
+		ht[index] = tmpBuc;
+	}
+
+	bool lookup(const File* file, const PageId pageNo, FrameId &frameNo)
+	{
+		for (bucket* tmpBuc = ht[hash(file, pageNo)]; tmpBuc; tmpBuc = tmpBuc->next)
+		{
+			if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+			{
+				frameNo = tmpBuc->frameNo;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void remove(const File* file, const PageId pageNo)
+	{
+		int index = hash(file, pageNo);
+		bucket* prevBuc = NULL;
+		for (bucket* tmpBuc = ht[index]; tmpBuc; prevBuc = tmpBuc, tmpBuc = tmpBuc->next)
+		{
+			if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+			{
+				if (prevBuc)
+					prevBuc->next = tmpBuc->next;
+				else
+					ht[index] = tmpBuc->next;
+				delete tmpBuc;
+				return;
+			}
+		}
+	}
+
+ private:
+	int hash(const File* file, const PageId pageNo)
+	{
+		unsigned tmp = (unsigned long)file;
+		return (tmp + pageNo) % HTSIZE;
+	}
+
+	int HTSIZE;
+	bucket** ht;
+};
+
+// -----------------------------------------------------------------------------
+// Forward declarations
+// -----------------------------------------------------------------------------
+
+PageFile* createBenchFile(int numPages, std::vector<PageId>& pageIds, const std::string& name = benchFileName);
+void deleteBenchFile(PageFile* file);
+bool stressTest(int numThreads, ReplacementPolicyType policy, bool hits = false);
+void hitPathBenchmark(int maxThreads);
+void hashTableBenchmark();
+void policyBenchmark();
+void scanBenchmark();
+void bgWriterBenchmark();
+void prefetchBenchmark();
+bool flushBenchmark();
+bool warmStartBenchmark();
+bool statsBenchmark();
+void poolsBenchmark();
+void hintsBenchmark();
+bool sharedPoolTest(int numProcs);
+bool victimCacheBenchmark();
+bool optimisticBenchmark(int maxThreads);
+bool asyncBenchmark();
+bool admissionBenchmark(int maxThreads);
+bool fileIoBenchmark(int maxThreads);
+bool bulkIoBenchmark();
+bool allocBenchmark();
+bool extentBenchmark();
+
+const ReplacementPolicyType policies[] = {CLOCK, LRU_K, TWO_Q, ARC};
+const char* const policyNames[] = {"clock", "lru-k", "2q", "arc"};
+const int numPolicies = sizeof(policies) / sizeof(policies[0]);
+
+int main(int argc, char **argv)
+{
+	std::string mode = argc > 1 ? argv[1] : "all";
+	int maxThreads = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+	if (maxThreads < 1)
+		maxThreads = 1;
+
+	bool ok = true;
+	if (mode == "stress" || mode == "all")
+		for (int i = 0; i < numPolicies; i++)
+		{
+			ok = stressTest(maxThreads < 2 ? 2 : maxThreads, policies[i]) && ok;
+			ok = stressTest(maxThreads < 2 ? 2 : maxThreads, policies[i], true) && ok;
+		}
+	if (mode == "hitpath" || mode == "all")
+		hitPathBenchmark(maxThreads);
+	if (mode == "hashtbl" || mode == "all")
+		hashTableBenchmark();
+	if (mode == "policies" || mode == "all")
+		policyBenchmark();
+	if (mode == "scan" || mode == "all")
+		scanBenchmark();
+	if (mode == "bgwriter" || mode == "all")
+		bgWriterBenchmark();
+	if (mode == "prefetch" || mode == "all")
+		prefetchBenchmark();
+	if (mode == "flush" || mode == "all")
+		ok = flushBenchmark() && ok;
+	if (mode == "warmstart" || mode == "all")
+		ok = warmStartBenchmark() && ok;
+	if (mode == "stats" || mode == "all")
+		ok = statsBenchmark() && ok;
+	if (mode == "pools" || mode == "all")
+		poolsBenchmark();
+	if (mode == "hints" || mode == "all")
+		hintsBenchmark();
+	if (mode == "shm" || mode == "all")
+		ok = sharedPoolTest(maxThreads < 2 ? 2 : maxThreads) && ok;
+	if (mode == "victim" || mode == "all")
+		ok = victimCacheBenchmark() && ok;
+	if (mode == "optimistic" || mode == "all")
+		ok = optimisticBenchmark(maxThreads) && ok;
+	if (mode == "async" || mode == "all")
+		ok = asyncBenchmark() && ok;
+	if (mode == "admission" || mode == "all")
+		ok = admissionBenchmark(maxThreads) && ok;
+	if (mode == "fileio" || mode == "all")
+		ok = fileIoBenchmark(maxThreads) && ok;
+	if (mode == "bulkio" || mode == "all")
+		ok = bulkIoBenchmark() && ok;
+	if (mode == "alloc" || mode == "all")
+		ok = allocBenchmark() && ok;
+	if (mode == "extent" || mode == "all")
+		ok = extentBenchmark() && ok;
+
+	return ok ? 0 : 1;
+}
+
+// -----------------------------------------------------------------------------
+// createBenchFile / deleteBenchFile
+// -----------------------------------------------------------------------------
+
+PageFile* createBenchFile(int numPages, std::vector<PageId>& pageIds, const std::string& name)
+{
+	try
+	{
+		File::remove(name);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	PageFile* file = new PageFile(name, true);
+	for (int i = 0; i < numPages; i++)
+	{
+		PageId pageNo;
+		Page page = file->allocatePage(pageNo);
+		COUNTER rec = {pageNo, 0};
+		page.insertRecord(std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+		file->writePage(pageNo, page);
+		pageIds.push_back(pageNo);
+	}
+	return file;
+}
+
+void deleteBenchFile(PageFile* file)
+{
+	const std::string name = file->filename();
+	delete file;
+	File::remove(name);
+}
+
+// -----------------------------------------------------------------------------
+// stressTest
+// Threads pin random pages of a file four times larger than the pool, so
+// nearly every access races with evictions by other threads. Each thread only
+// updates the pages it owns (pageNo % numThreads), and every pin checks that
+// the frame really holds the page asked for. Meanwhile another thread keeps
+// doubling and halving the pool. At the end the counters on disk must add up
+// to the number of updates each thread made. With hits set the file has half
+// as many pages as the pool, so the readers hit while the pool is resized as
+// fast as it can be, and the policy is updated at the same time.
+// -----------------------------------------------------------------------------
+
+bool stressTest(int numThreads, ReplacementPolicyType policy, bool hits)
+{
+	const int numFrames = 64;
+	const int numPages = hits ? numFrames / 2 : 4 * numFrames;
+	const int opsPerThread = hits ? 200000 : 20000;
+
+	std::cout << "Stress test: " << numThreads << " threads, " << numFrames
+		<< " frames, " << numPages << " pages, " << policyNames[policy]
+		<< (hits ? ", hits" : "") << std::endl;
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+	BufMgr* bufMgr = new BufMgr(numFrames, policy);
+	// race the compressed copies of evicted pages against the readers too
+	bufMgr->setVictimCacheSize(numFrames * 512);
+
+	std::atomic<int> errors(0);
+	std::atomic<int> running(numThreads);
+	std::vector<long long> updates(numPages, 0);
+	std::vector<std::thread> threads;
+
+	// grow and shrink the pool under the readers; shrinks fail while a
+	// frame being dropped is pinned
+	int shrinks = 0, failedShrinks = 0;
+	std::thread resizer([&]() {
+		while (running > 0)
+		{
+			bufMgr->resize(2 * numFrames);
+			if (hits)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			try
+			{
+				bufMgr->resize(numFrames);
+				shrinks++;
+			}
+			catch(const PagePinnedException &)
+			{
+				failedShrinks++;
+			}
+			if (hits)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	});
+
+	for (int t = 0; t < numThreads; t++)
+	{
+		threads.push_back(std::thread([&, t]() {
+			std::mt19937 rng(t);
+			for (int op = 0; op < opsPerThread; op++)
+			{
+				const int idx = rng() % numPages;
+				const PageId pageNo = pageIds[idx];
+				if (op % 8 == 0)
+				{
+					// race prefetches against the readers and evictions as well
+					std::vector<PageId> ahead;
+					for (int i = 1; i <= 4; i++)
+						ahead.push_back(pageIds[(idx + i) % numPages]);
+					bufMgr->prefetchPages(file, ahead);
+				}
+				const bool owner = (int)(pageNo % numThreads) == t;
+				Page* page;
+				bufMgr->readPage(file, pageNo, page);
+				if (page->page_number() != pageNo)
+					errors++;
+				if (owner)
+				{
+					RecordId rid = {pageNo, 1, 0};
+					std::string data = page->getRecord(rid);
+					COUNTER rec;
+					memcpy(&rec, data.data(), sizeof(rec));
+					rec.count++;
+					page->updateRecord(rid, std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+					updates[idx]++;
+				}
+				bufMgr->unPinPage(file, pageNo, owner);
+			}
+			running--;
+		}));
+	}
+	for (std::size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+	resizer.join();
+
+	bufMgr->flushFile(file);
+	for (int i = 0; i < numPages; i++)
+	{
+		Page page = file->readPage(pageIds[i]);
+		RecordId rid = {pageIds[i], 1, 0};
+		COUNTER rec;
+		memcpy(&rec, page.getRecord(rid).data(), sizeof(rec));
+		if (rec.pageNo != pageIds[i] || rec.count != updates[i])
+			errors++;
+	}
+
+	delete bufMgr;
+	deleteBenchFile(file);
+
+	std::cout << (errors == 0 ? "Stress test passed" : "Stress test FAILED")
+		<< " (" << errors << " errors, " << shrinks << " shrinks, "
+		<< failedShrinks << " refused while pinned)" << std::endl;
+	return errors == 0;
+}
+
+// -----------------------------------------------------------------------------
+// hitPathBenchmark
+// All pages fit in the pool, so after warm-up every readPage is a hit. Reports
+// pin/unpin pairs per second for 1, 2, 4, ... maxThreads threads, for every
+// replacement policy.
+// -----------------------------------------------------------------------------
+
+void hitPathBenchmark(int maxThreads)
+{
+	const int numPages = 1024;
+	const std::chrono::milliseconds duration(500);
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+
+	std::cout << "Hit path: " << numPages << " resident pages" << std::endl;
+	std::cout << "policy\tthreads\tops/s\tspeedup" << std::endl;
+	for (int p = 0; p < numPolicies; p++)
+	{
+		BufMgr* bufMgr = new BufMgr(numPages, policies[p]);
+
+		// warm up the pool
+		for (int i = 0; i < numPages; i++)
+		{
+			Page* page;
+			bufMgr->readPage(file, pageIds[i], page);
+			bufMgr->unPinPage(file, pageIds[i], false);
+		}
+
+		double base = 0;
+		for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+		{
+			std::atomic<bool> stop(false);
+			std::atomic<long long> total(0);
+			std::vector<std::thread> threads;
+			for (int t = 0; t < numThreads; t++)
+			{
+				threads.push_back(std::thread([&, t]() {
+					std::mt19937 rng(t);
+					long long ops = 0;
+					while (!stop)
+					{
+						const PageId pageNo = pageIds[rng() % numPages];
+						Page* page;
+						bufMgr->readPage(file, pageNo, page);
+						bufMgr->unPinPage(file, pageNo, false);
+						ops++;
+					}
+					total += ops;
+				}));
+			}
+			std::this_thread::sleep_for(duration);
+			stop = true;
+			for (std::size_t t = 0; t < threads.size(); t++)
+				threads[t].join();
+
+			const double opsPerSec = total * 1000.0 / duration.count();
+			if (numThreads == 1)
+				base = opsPerSec;
+			std::cout << policyNames[p] << "\t" << numThreads << "\t" << (long long)opsPerSec << "\t"
+				<< opsPerSec / base << std::endl;
+		}
+
+		bufMgr->flushFile(file);
+		delete bufMgr;
+	}
+	deleteBenchFile(file);
+}
+
+// -----------------------------------------------------------------------------
+// hashTableBenchmark
+// Fills each table the way a pool of numBufs frames would fill it (pages of a
+// few files), then times random lookups and removing and reinserting entries,
+// as a miss followed by an eviction does. Reports nanoseconds per operation.
+// Only the table operations are timed, the partition latches are not taken.
+// -----------------------------------------------------------------------------
+
+template <class Table, class Lookup>
+void timeHashTable(const char* name, Table& table, Lookup lookup,
+	const std::vector<File*>& files, std::uint32_t numBufs)
+{
+	typedef std::chrono::steady_clock clock;
+	const std::uint32_t perFile = numBufs / files.size();
+	const int lookups = 4000000;
+	std::mt19937 rng(1);
+
+	clock::time_point start = clock::now();
+	for (std::uint32_t i = 0; i < numBufs; i++)
+		table.insert(files[i % files.size()], i / files.size() + 1, i);
+	const double insertNs = std::chrono::duration<double, std::nano>(clock::now() - start).count() / numBufs;
+
+	FrameId frameNo = 0;
+	long long found = 0;
+	start = clock::now();
+	for (int i = 0; i < lookups; i++)
+	{
+		const std::uint32_t key = rng() % numBufs;
+		found += lookup(table, files[key % files.size()], key / files.size() + 1, frameNo);
+	}
+	const double lookupNs = std::chrono::duration<double, std::nano>(clock::now() - start).count() / lookups;
+
+	// evict a random resident page and insert one that was not resident
+	std::vector<PageId> resident(numBufs);
+	for (std::uint32_t i = 0; i < numBufs; i++)
+		resident[i] = i / files.size() + 1;
+	PageId nextPage = perFile + 1;
+	start = clock::now();
+	for (std::uint32_t i = 0; i < numBufs; i++)
+	{
+		const std::uint32_t victim = rng() % numBufs;
+		const File* file = files[victim % files.size()];
+		table.remove(file, resident[victim]);
+		resident[victim] = nextPage++;
+		table.insert(file, resident[victim], victim);
+	}
+	const double replaceNs = std::chrono::duration<double, std::nano>(clock::now() - start).count() / numBufs;
+
+	std::cout << name << "\t" << numBufs << "\t" << insertNs << "\t" << lookupNs
+		<< "\t" << replaceNs << (found == lookups ? "" : "\tLOOKUPS MISSED") << std::endl;
+}
+
+bool chainedLookup(ChainedHashTbl& table, const File* file, const PageId pageNo, FrameId& frameNo)
+{
+	return table.lookup(file, pageNo, frameNo);
+}
+
+bool flatLookup(BufHashTbl& table, const File* file, const PageId pageNo, FrameId& frameNo)
+{
+	table.lookup(file, pageNo, frameNo);
+	return true;
+}
+
+void hashTableBenchmark()
+{
+	std::vector<File*> files;
+	for (int i = 0; i < 4; i++)
+	{
+		std::string name = benchFileName + "." + std::to_string(i);
+		try
+		{
+			File::remove(name);
+		}
+		catch(const FileNotFoundException &)
+		{
+		}
+		files.push_back(new BlobFile(name, true));
+	}
+
+	std::cout << "Hash table: ns per insert / lookup / remove+insert" << std::endl;
+	std::cout << "table\tentries\tinsert\tlookup\treplace" << std::endl;
+	for (std::uint32_t numBufs = 1024; numBufs <= 1024 * 1024; numBufs *= 32)
+	{
+		{
+			ChainedHashTbl chained(((((int) (numBufs * 1.2))*2)/2)+1);
+			timeHashTable("chained", chained, chainedLookup, files, numBufs);
+		}
+		{
+			BufHashTbl flat(numBufs);
+			timeHashTable("flat", flat, flatLookup, files, numBufs);
+		}
+	}
+
+	for (std::size_t i = 0; i < files.size(); i++)
+	{
+		std::string name = files[i]->filename();
+		delete files[i];
+		File::remove(name);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// policyBenchmark
+// Replays the same page reference traces against a pool using each
+// replacement policy and reports the hit ratio (reads that did not go to
+// disk). The traces are built to tell the policies apart:
+//   hot+scan  point lookups on a hot set that fits the pool, interrupted by
+//             sequential scans of cold pages larger than the pool
+//   zipf      skewed random accesses, a few pages get most of the traffic
+//   loop      the same sequence of pages, slightly more than the pool holds,
+//             read over and over
+// -----------------------------------------------------------------------------
+
+void buildTraces(int numPages, int numFrames, std::vector<std::string>& names,
+	std::vector<std::vector<int> >& traces)
+{
+	const int length = 60000;
+	std::mt19937 rng(42);
+
+	// hot+scan: half the pool is hot, scans cover four pools' worth of pages
+	{
+		std::vector<int> trace;
+		const int hotPages = numFrames / 2;
+		while ((int)trace.size() < length)
+		{
+			for (int i = 0; i < 4000; i++)
+				trace.push_back(rng() % hotPages);
+			for (int i = 0; i < 4 * numFrames; i++)
+				trace.push_back(hotPages + (i % (numPages - hotPages)));
+		}
+		names.push_back("hot+scan");
+		traces.push_back(trace);
+	}
+
+	// zipf (s = 1) over all pages
+	{
+		std::vector<double> cdf(numPages);
+		double sum = 0;
+		for (int i = 0; i < numPages; i++)
+			cdf[i] = (sum += 1.0 / (i + 1));
+		std::uniform_real_distribution<double> uniform(0, sum);
+		std::vector<int> trace;
+		for (int i = 0; i < length; i++)
+			trace.push_back(std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin());
+		names.push_back("zipf");
+		traces.push_back(trace);
+	}
+
+	// loop over 125% of the pool
+	{
+		std::vector<int> trace;
+		const int loopPages = numFrames + numFrames / 4;
+		for (int i = 0; i < length; i++)
+			trace.push_back(i % loopPages);
+		names.push_back("loop");
+		traces.push_back(trace);
+	}
+}
+
+void policyBenchmark()
+{
+	const int numFrames = 256;
+	const int numPages = 8 * numFrames;
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+
+	std::vector<std::string> names;
+	std::vector<std::vector<int> > traces;
+	buildTraces(numPages, numFrames, names, traces);
+
+	std::cout << "Replacement policies: hit ratio, " << numFrames << " frames, "
+		<< numPages << " pages" << std::endl;
+	std::cout << "trace";
+	for (int p = 0; p < numPolicies; p++)
+		std::cout << "\t" << policyNames[p];
+	std::cout << std::endl;
+
+	for (std::size_t t = 0; t < traces.size(); t++)
+	{
+		std::cout << names[t];
+		for (int p = 0; p < numPolicies; p++)
+		{
+			BufMgr* bufMgr = new BufMgr(numFrames, policies[p]);
+			for (std::size_t i = 0; i < traces[t].size(); i++)
+			{
+				Page* page;
+				const PageId pageNo = pageIds[traces[t][i]];
+				bufMgr->readPage(file, pageNo, page);
+				bufMgr->unPinPage(file, pageNo, false);
+			}
+			const BufStats& stats = bufMgr->getBufStats();
+			const double hitRatio = 1.0 - (double)stats.diskreads / stats.accesses;
+			std::cout << "\t" << (int)(hitRatio * 1000) / 10.0 << "%";
+			bufMgr->flushFile(file);
+			delete bufMgr;
+		}
+		std::cout << std::endl;
+	}
+
+	deleteBenchFile(file);
+}
+
+// -----------------------------------------------------------------------------
+// scanBenchmark
+// Reads a hot set of pages, scans a file eight times the size of the pool,
+// then reads the hot set again and counts how many hot pages had to come back
+// from disk. Done once with plain readPage and once through a BufferRing.
+// -----------------------------------------------------------------------------
+
+void scanBenchmark()
+{
+	const int numFrames = 256;
+	const int numPages = 8 * numFrames;
+	const int hotPages = numFrames / 2;
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+
+	std::cout << "Sequential scan: hot pages reread after scanning " << numPages
+		<< " pages through " << numFrames << " frames" << std::endl;
+	std::cout << "scan\tpolicy\thot misses" << std::endl;
+	for (int useRing = 0; useRing < 2; useRing++)
+	{
+		for (int p = 0; p < numPolicies; p++)
+		{
+			BufMgr* bufMgr = new BufMgr(numFrames, policies[p]);
+			Page* page;
+
+			// touch the hot pages twice so every policy sees them as hot
+			for (int pass = 0; pass < 2; pass++)
+			{
+				for (int i = 0; i < hotPages; i++)
+				{
+					bufMgr->readPage(file, pageIds[i], page);
+					bufMgr->unPinPage(file, pageIds[i], false);
+				}
+			}
+
+			BufferRing ring;
+			for (int i = hotPages; i < numPages; i++)
+			{
+				bufMgr->readPage(file, pageIds[i], page, useRing ? &ring : NULL);
+				bufMgr->unPinPage(file, pageIds[i], false);
+			}
+
+			bufMgr->clearBufStats();
+			for (int i = 0; i < hotPages; i++)
+			{
+				bufMgr->readPage(file, pageIds[i], page);
+				bufMgr->unPinPage(file, pageIds[i], false);
+			}
+			std::cout << (useRing ? "ring" : "plain") << "\t" << policyNames[p] << "\t"
+				<< bufMgr->getBufStats().diskreads << "/" << hotPages << std::endl;
+
+			bufMgr->flushFile(file);
+			delete bufMgr;
+		}
+	}
+
+	deleteBenchFile(file);
+}
+
+// -----------------------------------------------------------------------------
+// bgWriterBenchmark
+// Random reads over a file four times the size of the pool, half of them
+// dirtying the page, paced so the writer gets time between requests. Reports
+// how many evictions had to write a page first (foreground writes) and the
+// average and worst readPage latency, with and without the background writer.
+// -----------------------------------------------------------------------------
+
+void bgWriterBenchmark()
+{
+	typedef std::chrono::steady_clock clock;
+	const int numFrames = 256;
+	const int numPages = 4 * numFrames;
+	const int ops = 20000;
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+
+	std::cout << "Background writer: " << ops << " random reads, half dirtying, "
+		<< numFrames << " frames, " << numPages << " pages" << std::endl;
+	std::cout << "writer\tfg writes\tbg writes\tavg us\tmax us" << std::endl;
+	for (int useWriter = 0; useWriter < 2; useWriter++)
+	{
+		BufMgr* bufMgr = new BufMgr(numFrames);
+		if (useWriter)
+		{
+			BgWriterConfig config;
+			config.interval = std::chrono::milliseconds(1);
+			config.lookahead = 64;
+			bufMgr->startBgWriter(config);
+		}
+
+		std::mt19937 rng(7);
+		double totalUs = 0, maxUs = 0;
+		for (int i = 0; i < ops; i++)
+		{
+			const PageId pageNo = pageIds[rng() % numPages];
+			Page* page;
+			clock::time_point start = clock::now();
+			bufMgr->readPage(file, pageNo, page);
+			const double us = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+			totalUs += us;
+			maxUs = std::max(maxUs, us);
+			bufMgr->unPinPage(file, pageNo, i % 2 == 0);
+			if (i % 16 == 0)
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+
+		bufMgr->stopBgWriter();
+		const BufStats& stats = bufMgr->getBufStats();
+		std::cout << (useWriter ? "on" : "off") << "\t" << stats.diskwrites - stats.bgwrites
+			<< "\t\t" << stats.bgwrites << "\t\t" << totalUs / ops << "\t" << maxUs << std::endl;
+		bufMgr->flushFile(file);
+		delete bufMgr;
+	}
+
+	deleteBenchFile(file);
+}
+
+// -----------------------------------------------------------------------------
+// prefetchBenchmark
+// Reads every page of a file in order through a ring, as FileScan does, doing
+// a little work on each page, with the OS cache of the file dropped first.
+// Done once reading each page on demand and once keeping the next pages
+// prefetched, as FileScan does.
+// -----------------------------------------------------------------------------
+
+void dropOsCache(const std::string& name)
+{
+	int fd = open(name.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+void prefetchBenchmark()
+{
+	typedef std::chrono::steady_clock clock;
+	const int numFrames = 256;
+	const int numPages = 8 * numFrames;
+	const int depth = 8;
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+
+	std::cout << "Prefetch: sequential read of " << numPages << " pages, OS cache dropped" << std::endl;
+	std::cout << "prefetch\tms\tprefetched" << std::endl;
+	for (int usePrefetch = 0; usePrefetch < 2; usePrefetch++)
+	{
+		dropOsCache(benchFileName);
+		BufMgr* bufMgr = new BufMgr(numFrames);
+		BufferRing ring;
+		long long checksum = 0;
+
+		clock::time_point start = clock::now();
+		if (usePrefetch)
+			bufMgr->prefetchPages(file, std::vector<PageId>(pageIds.begin() + 1, pageIds.begin() + 1 + depth), &ring);
+		for (int i = 0; i < numPages; i++)
+		{
+			if (usePrefetch && i + depth < numPages)
+				bufMgr->prefetchPages(file, std::vector<PageId>(1, pageIds[i + depth]), &ring);
+			Page* page;
+			bufMgr->readPage(file, pageIds[i], page, &ring);
+			for (PageIterator it = page->begin(); it != page->end(); ++it)
+				checksum += (*it).size();
+			bufMgr->unPinPage(file, pageIds[i], false);
+		}
+		const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+		std::cout << (usePrefetch ? "on" : "off") << "\t\t" << ms << "\t" << bufMgr->getBufStats().prefetches
+			<< (checksum == (long long)numPages * sizeof(COUNTER) ? "" : "\tBAD CHECKSUM") << std::endl;
+		bufMgr->flushFile(file);
+		delete bufMgr;
+	}
+
+	deleteBenchFile(file);
+}
+
+// -----------------------------------------------------------------------------
+// flushBenchmark
+// Dirties the few pages of a small file and flushes it, in pools of growing
+// size. Flushing only visits the file's own pages, so the time per flush
+// should not grow with the pool. Also checks that evictFile() drops pages
+// without writing them and that flushAll() writes pages but keeps them, and
+// that a dirty page whose write back fails on eviction stays dirty.
+// -----------------------------------------------------------------------------
+
+/**
+ * A PageFile whose writes fail while failWrites is set.
+ */
+class FailingWriteFile : public PageFile
+{
+ public:
+	FailingWriteFile(const std::string& name)
+		: PageFile(name, false), failWrites(false), writes(0)
+	{
+	}
+
+	void writePage(const PageId pageNo, const Page& page) override
+	{
+		if (failWrites)
+			throw std::runtime_error("write failed");
+		PageFile::writePage(pageNo, page);
+		writes++;
+	}
+
+	bool failWrites;
+	int writes;
+};
+
+bool flushBenchmark()
+{
+	typedef std::chrono::steady_clock clock;
+	const int numPages = 8;
+	const int rounds = 2000;
+	const std::uint32_t poolSizes[] = {1024, 16384};
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+	bool ok = true;
+
+	std::cout << "Flush: " << numPages << " dirty pages of one file, " << rounds << " flushes" << std::endl;
+	std::cout << "frames\tus/flush" << std::endl;
+	for (int p = 0; p < 2; p++)
+	{
+		BufMgr* bufMgr = new BufMgr(poolSizes[p]);
+		double totalUs = 0;
+		for (int r = 0; r < rounds; r++)
+		{
+			for (int i = 0; i < numPages; i++)
+			{
+				Page* page;
+				bufMgr->readPage(file, pageIds[i], page);
+				bufMgr->unPinPage(file, pageIds[i], true);
+			}
+			clock::time_point start = clock::now();
+			bufMgr->flushFile(file);
+			totalUs += std::chrono::duration<double, std::micro>(clock::now() - start).count();
+		}
+		std::cout << poolSizes[p] << "\t" << totalUs / rounds << std::endl;
+		delete bufMgr;
+	}
+
+	BufMgr* bufMgr = new BufMgr(64);
+	for (int i = 0; i < numPages; i++)
+	{
+		Page* page;
+		bufMgr->readPage(file, pageIds[i], page);
+		bufMgr->unPinPage(file, pageIds[i], true);
+	}
+	bufMgr->flushAll();
+	const int written = bufMgr->getBufStats().diskwrites;
+	for (int i = 0; i < numPages; i++)
+	{
+		Page* page;
+		bufMgr->readPage(file, pageIds[i], page);
+		bufMgr->unPinPage(file, pageIds[i], true);
+	}
+	if (written != numPages || bufMgr->getBufStats().diskreads != numPages)
+	{
+		std::cout << "flushAll wrote " << written << " pages and pages were read "
+			<< bufMgr->getBufStats().diskreads << " times, expected " << numPages << std::endl;
+		ok = false;
+	}
+	bufMgr->evictFile(file);
+	bufMgr->flushFile(file);
+	if (bufMgr->getBufStats().diskwrites != written)
+	{
+		std::cout << "evictFile wrote pages back" << std::endl;
+		ok = false;
+	}
+
+	// a pinned page must survive disposePage, or its holder's unpin would
+	// land on whatever page the frame holds next
+	PageId disposeNo;
+	Page* disposePage;
+	bufMgr->allocPage(file, disposeNo, disposePage);
+	try
+	{
+		bufMgr->disposePage(file, disposeNo);
+		std::cout << "disposePage cleared a pinned page" << std::endl;
+		ok = false;
+	}
+	catch(const PagePinnedException &)
+	{
+	}
+	bufMgr->unPinPage(file, disposeNo, false);
+	bufMgr->disposePage(file, disposeNo);
+	delete bufMgr;
+
+	// a failed write back leaves the page dirty, so the next eviction writes it
+	{
+		FailingWriteFile failing(file->filename());
+		bufMgr = new BufMgr(1);
+		Page* page;
+		bufMgr->readPage(&failing, pageIds[0], page);
+		bufMgr->unPinPage(&failing, pageIds[0], true);
+		failing.failWrites = true;
+		try
+		{
+			bufMgr->readPage(&failing, pageIds[1], page);
+			bufMgr->unPinPage(&failing, pageIds[1], false);
+		}
+		catch(const std::runtime_error &)
+		{
+		}
+		failing.failWrites = false;
+		bufMgr->readPage(&failing, pageIds[1], page);
+		bufMgr->unPinPage(&failing, pageIds[1], false);
+		if (failing.writes != 1)
+		{
+			std::cout << "eviction after a failed write back wrote " << failing.writes << " pages" << std::endl;
+			ok = false;
+		}
+		delete bufMgr;
+	}
+
+	deleteBenchFile(file);
+	std::cout << (ok ? "Flush checks passed" : "Flush checks FAILED") << std::endl;
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// warmStartBenchmark
+// Runs a skewed workload, saves the resident set and "restarts" with a new
+// buffer manager and the OS cache of the file dropped. The same workload is
+// then run cold and after loadResidentSet(), comparing how many of its reads
+// go to disk and how long they take.
+// -----------------------------------------------------------------------------
+
+bool warmStartBenchmark()
+{
+	typedef std::chrono::steady_clock clock;
+	const int numFrames = 256;
+	const int numPages = 8 * numFrames;
+	const int ops = 20000;
+	const std::string setName = "bench.resident";
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+
+	// 90% of the accesses go to 200 hot pages spread over the file
+	std::vector<PageId> trace;
+	std::mt19937 rng(11);
+	for (int i = 0; i < ops; i++)
+	{
+		const int idx = rng() % 10 != 0 ? (rng() % 200) * (numPages / 200) : rng() % numPages;
+		trace.push_back(pageIds[idx]);
+	}
+
+	BufMgr* bufMgr = new BufMgr(numFrames);
+	for (int i = 0; i < ops; i++)
+	{
+		Page* page;
+		bufMgr->readPage(file, trace[i], page);
+		bufMgr->unPinPage(file, trace[i], false);
+	}
+	bufMgr->saveResidentSet(setName);
+	delete bufMgr;
+
+	bool ok = true;
+	std::cout << "Warm start: " << ops << " reads, 90% to 200 of " << numPages << " pages, "
+		<< numFrames << " frames, OS cache dropped" << std::endl;
+	std::cout << "start	loaded	load ms	disk reads	ms" << std::endl;
+	int coldReads = 0;
+	for (int warm = 0; warm < 2; warm++)
+	{
+		dropOsCache(benchFileName);
+		bufMgr = new BufMgr(numFrames);
+
+		clock::time_point start = clock::now();
+		std::uint32_t loaded = 0;
+		if (warm)
+			loaded = bufMgr->loadResidentSet(setName, std::vector<File*>(1, file));
+		const double loadMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+		const int readsBefore = bufMgr->getBufStats().diskreads;
+
+		start = clock::now();
+		for (int i = 0; i < ops; i++)
+		{
+			Page* page;
+			bufMgr->readPage(file, trace[i], page);
+			bufMgr->unPinPage(file, trace[i], false);
+		}
+		const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+		const int reads = bufMgr->getBufStats().diskreads - readsBefore;
+
+		std::cout << (warm ? "warm" : "cold") << "\t" << loaded << "\t" << loadMs << "\t"
+			<< reads << "\t\t" << ms << std::endl;
+		if (!warm)
+			coldReads = reads;
+		else if (loaded != (std::uint32_t)numFrames || reads >= coldReads)
+			ok = false;
+		bufMgr->flushFile(file);
+		delete bufMgr;
+	}
+
+	// a page pinned while the set is saved is about to be used again, so it
+	// is among the pages a much smaller pool keeps, though LRU-K would evict
+	// it first for having been read only once
+	bufMgr = new BufMgr(numFrames, LRU_K);
+	for (int i = 0; i < ops; i++)
+	{
+		Page* page;
+		bufMgr->readPage(file, trace[i], page);
+		bufMgr->unPinPage(file, trace[i], false);
+	}
+	Page* pinned;
+	bufMgr->readPage(file, pageIds[1], pinned);
+	bufMgr->saveResidentSet(setName);
+	bufMgr->unPinPage(file, pageIds[1], false);
+	delete bufMgr;
+	bufMgr = new BufMgr(4);
+	bufMgr->loadResidentSet(setName, std::vector<File*>(1, file));
+	const int readsBefore = bufMgr->getBufStats().diskreads;
+	bufMgr->readPage(file, pageIds[1], pinned);
+	bufMgr->unPinPage(file, pageIds[1], false);
+	if (bufMgr->getBufStats().diskreads != readsBefore)
+	{
+		std::cout << "pinned page was saved as a cold one" << std::endl;
+		ok = false;
+	}
+	delete bufMgr;
+
+	std::remove(setName.c_str());
+	deleteBenchFile(file);
+	std::cout << (ok ? "Warm start checks passed" : "Warm start checks FAILED") << std::endl;
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// statsBenchmark
+// Reads and dirties pages of two files in a pool smaller than both, then checks
+// that hits and misses add up to the accesses and that the per file counters
+// add up to the pool wide ones. Prints the snapshot as text and as JSON.
+// -----------------------------------------------------------------------------
+
+bool statsBenchmark()
+{
+	const int numFrames = 64;
+	const int numPages = 4 * numFrames;
+	const int ops = 20000;
+
+	std::vector<PageId> pageIds, otherIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+	PageFile* other = createBenchFile(numPages / 4, otherIds, "bench.stats");
+
+	BufMgr* bufMgr = new BufMgr(numFrames);
+	std::mt19937 rng(13);
+	for (int i = 0; i < ops; i++)
+	{
+		PageFile* f = rng() % 4 == 0 ? other : file;
+		const PageId pageNo = f == other ? otherIds[rng() % otherIds.size()] : pageIds[rng() % pageIds.size()];
+		Page* page;
+		bufMgr->readPage(f, pageNo, page);
+		bufMgr->unPinPage(f, pageNo, rng() % 8 == 0);
+	}
+
+	const BufStats& stats = bufMgr->getBufStats();
+	std::map<std::string, FileStats> files;
+	bufMgr->getFileStats(files);
+	FileStats sum;
+	for (std::map<std::string, FileStats>::iterator it = files.begin(); it != files.end(); ++it)
+	{
+		sum.hits += it->second.hits;
+		sum.misses += it->second.misses;
+		sum.diskreads += it->second.diskreads;
+		sum.diskwrites += it->second.diskwrites;
+		sum.evictions += it->second.evictions;
+	}
+
+	bool ok = true;
+	if (stats.hits + stats.misses != stats.accesses || stats.accesses != ops)
+	{
+		std::cout << "hits " << stats.hits << " + misses " << stats.misses << " != accesses " << stats.accesses << std::endl;
+		ok = false;
+	}
+	if (files.size() != 2 || sum.hits != (std::uint64_t)stats.hits || sum.misses != (std::uint64_t)stats.misses
+		|| sum.diskreads != (std::uint64_t)stats.diskreads || sum.diskwrites != (std::uint64_t)stats.diskwrites
+		|| sum.evictions != (std::uint64_t)(stats.cleanEvictions + stats.dirtyEvictions))
+	{
+		std::cout << "per file counters do not add up to the pool's" << std::endl;
+		ok = false;
+	}
+	if (stats.readLatency.count() != (std::uint64_t)stats.diskreads
+		|| stats.writeLatency.count() != (std::uint64_t)stats.diskwrites)
+	{
+		std::cout << "latency histograms do not match the disk counters" << std::endl;
+		ok = false;
+	}
+
+	std::cout << "Stats: " << ops << " reads over two files, " << numFrames << " frames" << std::endl;
+	std::cout << bufMgr->statsSnapshot();
+	std::cout << bufMgr->statsSnapshot(true) << std::endl;
+
+	bufMgr->clearBufStats();
+	files.clear();
+	bufMgr->getFileStats(files);
+	if (stats.accesses != 0 || stats.hits != 0 || !files.empty())
+	{
+		std::cout << "clearBufStats left counters behind" << std::endl;
+		ok = false;
+	}
+
+	bufMgr->flushFile(file);
+	bufMgr->flushFile(other);
+	delete bufMgr;
+
+	// a snapshot must not set up an I/O engine the pool never used
+	bufMgr = new BufMgr(numFrames);
+	if (bufMgr->statsSnapshot(true).find("\"io_engine\":\"none\"") == std::string::npos)
+	{
+		std::cout << "statsSnapshot set up an I/O engine" << std::endl;
+		ok = false;
+	}
+	delete bufMgr;
+
+	deleteBenchFile(other);
+	deleteBenchFile(file);
+	std::cout << (ok ? "Stats checks passed" : "Stats checks FAILED") << std::endl;
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// poolsBenchmark
+// Index lookups over a small hot set of pages interleaved with repeated
+// sequential scans of a relation several times larger than the pool. Run once
+// with both files in one pool and once with the frames split between an index
+// pool and a heap pool, comparing the hit ratio of the index lookups.
+// -----------------------------------------------------------------------------
+
+void poolsBenchmark()
+{
+	typedef std::chrono::steady_clock clock;
+	const std::uint32_t numFrames = 512;
+	const int hotPages = 192;
+	const int heapPages = 4 * numFrames;
+	const int rounds = 4;
+
+	std::vector<PageId> indexIds, heapIds;
+	PageFile* index = createBenchFile(hotPages, indexIds, "bench.index");
+	PageFile* heap = createBenchFile(heapPages, heapIds, "bench.heap");
+
+	std::cout << "Pools: " << hotPages << " hot index pages, scans of " << heapPages
+		<< " heap pages, " << numFrames << " frames" << std::endl;
+	std::cout << "layout\t\tindex hit ratio\theap hit ratio\tms" << std::endl;
+	for (int split = 0; split < 2; split++)
+	{
+		BufPoolMgr pools(numFrames);
+		if (split)
+		{
+			pools.addPool("index", numFrames / 2);
+			pools.addPool("heap", numFrames / 2);
+		}
+		else
+		{
+			pools.addPool("shared", numFrames);
+		}
+		pools.assignFile(index, "index");
+		pools.assignFile(heap, "heap");
+		BufMgr* indexPool = pools.poolFor(index);
+		BufMgr* heapPool = pools.poolFor(heap);
+
+		std::mt19937 rng(17);
+		int indexHits = 0, indexReads = 0, heapHits = 0, heapReads = 0;
+		clock::time_point start = clock::now();
+		for (int r = 0; r < rounds; r++)
+		{
+			for (int i = 0; i < heapPages; i++)
+			{
+				Page* page;
+				// four lookups per page scanned
+				for (int j = 0; j < 4; j++)
+				{
+					const PageId pageNo = indexIds[rng() % hotPages];
+					const int before = indexPool->getBufStats().hits;
+					indexPool->readPage(index, pageNo, page);
+					indexPool->unPinPage(index, pageNo, false);
+					indexHits += indexPool->getBufStats().hits - before;
+					indexReads++;
+				}
+				const int before = heapPool->getBufStats().hits;
+				heapPool->readPage(heap, heapIds[i], page);
+				heapPool->unPinPage(heap, heapIds[i], false);
+				heapHits += heapPool->getBufStats().hits - before;
+				heapReads++;
+			}
+		}
+		const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+		std::cout << (split ? "index+heap" : "shared") << "\t" << (double)indexHits / indexReads << "\t\t"
+			<< (double)heapHits / heapReads << "\t\t" << ms << std::endl;
+
+		pools.removeFile(index);
+		pools.removeFile(heap);
+	}
+
+	deleteBenchFile(heap);
+	deleteBenchFile(index);
+}
+
+// -----------------------------------------------------------------------------
+// hintsBenchmark
+// Index lookups (the root, one of 63 inner pages, then a random leaf) while a
+// scan reads through the rest of the file, in a pool that holds a fraction of
+// the leaves. Run for each policy without hints, and with the inner pages read
+// as HOT_INDEX_INTERNAL and the scanned pages as SCAN_ONCE, comparing the hit
+// ratio of the inner pages and of the lookups' leaves.
+// -----------------------------------------------------------------------------
+
+void hintsBenchmark()
+{
+	const int numFrames = 256;
+	const int innerPages = 64;
+	const int numPages = 16 * numFrames;
+	const int lookups = 20000;
+	const int scanPerLookup = 4;
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+
+	std::cout << "Hints: " << lookups << " lookups through " << innerPages << " inner pages, "
+		<< scanPerLookup << " scanned pages per lookup, " << numPages << " pages, " << numFrames << " frames" << std::endl;
+	std::cout << "policy\thints\tinner hit ratio\tleaf hit ratio" << std::endl;
+	for (int p = 0; p < numPolicies; p++)
+	{
+		for (int hinted = 0; hinted < 2; hinted++)
+		{
+			BufMgr* bufMgr = new BufMgr(numFrames, policies[p]);
+			const AccessHint innerHint = hinted ? HOT_INDEX_INTERNAL : NORMAL;
+			const AccessHint scanHint = hinted ? SCAN_ONCE : NORMAL;
+			std::mt19937 rng(19);
+			int innerHits = 0, innerReads = 0, leafHits = 0, leafReads = 0;
+			int scanPos = innerPages;
+			for (int i = 0; i < lookups; i++)
+			{
+				Page* page;
+				const PageId path[2] = {pageIds[0], pageIds[1 + rng() % (innerPages - 1)]};
+				for (int level = 0; level < 2; level++)
+				{
+					const int before = bufMgr->getBufStats().hits;
+					bufMgr->readPage(file, path[level], page, NULL, innerHint);
+					bufMgr->unPinPage(file, path[level], false);
+					innerHits += bufMgr->getBufStats().hits - before;
+					innerReads++;
+				}
+
+				// leaves are skewed, so some of them are worth keeping too
+				const int leaf = innerPages + (rng() % 4 == 0 ? rng() % (numPages - innerPages) : rng() % numFrames);
+				const int before = bufMgr->getBufStats().hits;
+				bufMgr->readPage(file, pageIds[leaf], page, NULL);
+				bufMgr->unPinPage(file, pageIds[leaf], false);
+				leafHits += bufMgr->getBufStats().hits - before;
+				leafReads++;
+
+				for (int j = 0; j < scanPerLookup; j++)
+				{
+					bufMgr->readPage(file, pageIds[scanPos], page, NULL, scanHint);
+					bufMgr->unPinPage(file, pageIds[scanPos], false);
+					scanPos = scanPos + 1 < numPages ? scanPos + 1 : innerPages;
+				}
+			}
+			std::cout << policyNames[p] << "\t" << (hinted ? "yes" : "no") << "\t"
+				<< (double)innerHits / innerReads << "\t\t" << (double)leafHits / leafReads << std::endl;
+			delete bufMgr;
+		}
+	}
+
+	deleteBenchFile(file);
+}
+
+// -----------------------------------------------------------------------------
+// sharedPoolTest
+// Like the stress test, but with processes sharing one ShmBufMgr instead of
+// threads sharing a BufMgr. Every process opens the file itself and updates
+// the counters of the pages it owns; their dirty pages stay in the shared
+// pool when they exit and are written back by the parent's flushFile().
+// -----------------------------------------------------------------------------
+
+bool sharedPoolTest(int numProcs)
+{
+	typedef std::chrono::steady_clock clock;
+	const int numFrames = 64;
+	const int numPages = 4 * numFrames;
+	const int opsPerProc = 20000;
+	const std::string segName = "/badgerdb_bench";
+
+	std::cout << "Shared pool: " << numProcs << " processes, " << numFrames
+		<< " frames, " << numPages << " pages" << std::endl;
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+	// children open the file themselves, an inherited stream would share its offset
+	delete file;
+
+	ShmBufMgr::remove(segName);
+	ShmBufMgr* pool = new ShmBufMgr(segName, numFrames);
+
+	clock::time_point start = clock::now();
+	std::vector<pid_t> children;
+	for (int p = 0; p < numProcs; p++)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			int errors = 0;
+			{
+				PageFile childFile(benchFileName, false);
+				ShmBufMgr childPool(segName, numFrames);
+				std::mt19937 rng(p);
+				for (int op = 0; op < opsPerProc; op++)
+				{
+					const PageId pageNo = pageIds[rng() % numPages];
+					const bool owner = (int)(pageNo % numProcs) == p;
+					Page* page;
+					childPool.readPage(&childFile, pageNo, page);
+					if (page->page_number() != pageNo)
+						errors++;
+					if (owner)
+					{
+						RecordId rid = {pageNo, 1, 0};
+						COUNTER rec;
+						memcpy(&rec, page->getRecord(rid).data(), sizeof(rec));
+						rec.count++;
+						page->updateRecord(rid, std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+					}
+					childPool.unPinPage(&childFile, pageNo, owner);
+				}
+			}
+			_exit(errors == 0 ? 0 : 1);
+		}
+		children.push_back(pid);
+	}
+
+	int errors = 0;
+	for (std::size_t i = 0; i < children.size(); i++)
+	{
+		int status = 0;
+		if (waitpid(children[i], &status, 0) != children[i] || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			errors++;
+	}
+	const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+	// replay each process's choices to know how often every page was updated
+	std::vector<long long> updates(numPages, 0);
+	for (int p = 0; p < numProcs; p++)
+	{
+		std::mt19937 rng(p);
+		for (int op = 0; op < opsPerProc; op++)
+		{
+			const int idx = rng() % numPages;
+			if ((int)(pageIds[idx] % numProcs) == p)
+				updates[idx]++;
+		}
+	}
+
+	file = new PageFile(benchFileName, false);
+	pool->flushFile(file);
+	delete pool;
+	ShmBufMgr::remove(segName);
+	for (int i = 0; i < numPages; i++)
+	{
+		Page page = file->readPage(pageIds[i]);
+		RecordId rid = {pageIds[i], 1, 0};
+		COUNTER rec;
+		memcpy(&rec, page.getRecord(rid).data(), sizeof(rec));
+		if (rec.pageNo != pageIds[i] || rec.count != updates[i])
+			errors++;
+	}
+	deleteBenchFile(file);
+
+	std::cout << (errors == 0 ? "Shared pool test passed" : "Shared pool test FAILED")
+		<< " (" << errors << " errors, " << ms << " ms)" << std::endl;
+	return errors == 0;
+}
+
+// -----------------------------------------------------------------------------
+// victimCacheBenchmark
+// Uniform random reads over a file four times the size of the pool, with and
+// without a compressed victim cache of 1 MB behind it. Every page read is
+// checked to be the page asked for, holding its own record.
+// -----------------------------------------------------------------------------
+
+bool victimCacheBenchmark()
+{
+	typedef std::chrono::steady_clock clock;
+	const int numFrames = 128;
+	const int numPages = 4 * numFrames;
+	const int ops = 50000;
+	const std::size_t cacheBytes = 1 << 20;
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+
+	bool ok = true;
+	std::cout << "Victim cache: " << ops << " random reads of " << numPages << " pages, "
+		<< numFrames << " frames" << std::endl;
+	std::cout << "cache\tdisk reads\tcache hits\tbytes/page\tms" << std::endl;
+	for (int withCache = 0; withCache < 2; withCache++)
+	{
+		BufMgr* bufMgr = new BufMgr(numFrames);
+		bufMgr->setVictimCacheSize(withCache ? cacheBytes : 0);
+		std::mt19937 rng(23);
+		clock::time_point start = clock::now();
+		for (int i = 0; i < ops; i++)
+		{
+			const PageId pageNo = pageIds[rng() % numPages];
+			Page* page;
+			bufMgr->readPage(file, pageNo, page);
+			RecordId rid = {pageNo, 1, 0};
+			COUNTER rec;
+			memcpy(&rec, page->getRecord(rid).data(), sizeof(rec));
+			if (page->page_number() != pageNo || rec.pageNo != pageNo)
+				ok = false;
+			bufMgr->unPinPage(file, pageNo, false);
+		}
+		const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+		const BufStats& stats = bufMgr->getBufStats();
+		std::size_t pages, bytes;
+		bufMgr->getVictimCacheUsage(pages, bytes);
+		std::cout << (withCache ? cacheBytes : 0) << "\t" << stats.diskreads << "\t\t" << stats.victimHits
+			<< "\t\t" << (pages > 0 ? bytes / pages : 0) << "\t\t" << ms << std::endl;
+		if (withCache && stats.diskreads != numPages)
+			ok = false;
+		delete bufMgr;
+	}
+
+	deleteBenchFile(file);
+	std::cout << (ok ? "Victim cache checks passed" : "Victim cache checks FAILED") << std::endl;
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// optimisticBenchmark
+// Reads of a few hot pages, the way lookups pass the inner nodes of an index,
+// pinned through readPage() and unpinned, or through readOptimistic(). Then
+// checks that optimistic readers never accept a page while a writer rewrites
+// its record and the pool is shrunk and grown under them.
+// -----------------------------------------------------------------------------
+
+bool optimisticBenchmark(int maxThreads)
+{
+	const int numFrames = 256;
+	const int numHot = 16;
+	const std::chrono::milliseconds duration(300);
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numHot, pageIds);
+	BufMgr* bufMgr = new BufMgr(numFrames);
+
+	// the reader of a page checks its record and returns what it read
+	auto readRecord = [](const Page& page, PageId pageNo, COUNTER& rec) {
+		RecordId rid = {pageNo, 1, 0};
+		const std::string data = page.getRecord(rid);
+		if (data.size() == sizeof(rec))
+			memcpy(&rec, data.data(), sizeof(rec));
+		else
+			rec.pageNo = Page::INVALID_NUMBER;
+	};
+
+	std::cout << "Optimistic reads: " << numHot << " hot pages, " << numFrames << " frames" << std::endl;
+	std::cout << "threads	pinned ops/s	optimistic ops/s" << std::endl;
+	bool ok = true;
+	for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+	{
+		std::cout << numThreads;
+		for (int optimistic = 0; optimistic < 2; optimistic++)
+		{
+			std::atomic<bool> stop(false);
+			std::atomic<long long> total(0);
+			std::atomic<int> wrong(0);
+			std::vector<std::thread> threads;
+			for (int t = 0; t < numThreads; t++)
+			{
+				threads.push_back(std::thread([&, t]() {
+					std::mt19937 rng(t);
+					std::vector<FrameId> frames(numHot, 0);
+					long long ops = 0;
+					while (!stop)
+					{
+						const int hot = rng() % numHot;
+						const PageId pageNo = pageIds[hot];
+						COUNTER rec;
+						if (!optimistic || !bufMgr->readOptimistic(file, pageNo, frames[hot],
+								[&](const Page& page) { readRecord(page, pageNo, rec); }))
+						{
+							Page* page;
+							bufMgr->readPage(file, pageNo, page);
+							readRecord(*page, pageNo, rec);
+							bufMgr->unPinPage(file, pageNo, false);
+						}
+						if (rec.pageNo != pageNo)
+							wrong++;
+						ops++;
+					}
+					total += ops;
+				}));
+			}
+			std::this_thread::sleep_for(duration);
+			stop = true;
+			for (std::size_t t = 0; t < threads.size(); t++)
+				threads[t].join();
+			std::cout << "\t" << (long long)(total * 1000.0 / duration.count()) << "\t";
+			if (wrong > 0)
+				ok = false;
+		}
+		std::cout << std::endl;
+	}
+
+	// readers against a writer rewriting records and a thread resizing the pool
+	bufMgr->clearBufStats();
+	{
+		std::atomic<bool> stop(false);
+		std::atomic<int> wrong(0);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < std::max(maxThreads, 2); t++)
+		{
+			threads.push_back(std::thread([&, t]() {
+				std::mt19937 rng(t);
+				std::vector<FrameId> frames(numHot, 0);
+				while (!stop)
+				{
+					const int hot = rng() % numHot;
+					const PageId pageNo = pageIds[hot];
+					COUNTER rec;
+					if (bufMgr->readOptimistic(file, pageNo, frames[hot],
+							[&](const Page& page) { readRecord(page, pageNo, rec); }) && rec.pageNo != pageNo)
+						wrong++;
+				}
+			}));
+		}
+		threads.push_back(std::thread([&]() {
+			std::mt19937 rng(99);
+			while (!stop)
+			{
+				const PageId pageNo = pageIds[rng() % numHot];
+				Page* page;
+				bufMgr->readPage(file, pageNo, page);
+				RecordId rid = {pageNo, 1, 0};
+				COUNTER rec;
+				memcpy(&rec, page->getRecord(rid).data(), sizeof(rec));
+				rec.count++;
+				page->updateRecord(rid, std::string((char*)&rec, sizeof(rec)));
+				bufMgr->unPinPage(file, pageNo, true);
+			}
+		}));
+		threads.push_back(std::thread([&]() {
+			while (!stop)
+			{
+				try
+				{
+					bufMgr->resize(numFrames / 2);
+				}
+				catch(const PagePinnedException &)
+				{
+				}
+				bufMgr->resize(numFrames);
+				std::this_thread::yield();
+			}
+		}));
+		std::this_thread::sleep_for(duration);
+		stop = true;
+		for (std::size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+
+		const BufStats& stats = bufMgr->getBufStats();
+		std::cout << "with a writer and resizes: " << stats.optimisticReads << " reads, "
+			<< stats.optimisticFallbacks << " fallbacks, " << wrong << " torn reads accepted" << std::endl;
+		if (wrong > 0 || stats.optimisticReads == 0)
+			ok = false;
+	}
+
+	bufMgr->flushFile(file);
+	delete bufMgr;
+	deleteBenchFile(file);
+	std::cout << (ok ? "Optimistic read checks passed" : "Optimistic read checks FAILED") << std::endl;
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// asyncBenchmark
+// Uniform random reads of a file eight times the size of the pool from a
+// single thread: one at a time through readPage(), then through
+// readPageAsync() with up to a given number of reads in flight. Every page
+// read is checked to be the page asked for. Also checks that a read of a page
+// another request is still reading does not block the executor.
+// -----------------------------------------------------------------------------
+
+/**
+ * A PageFile whose batched reads wait while held is set, for at most a second.
+ */
+class HeldReadFile : public PageFile
+{
+ public:
+	HeldReadFile(const std::string& name)
+		: PageFile(name, false), held(false)
+	{
+	}
+
+	void readPages(PageIo* pages, const std::size_t count, IoEngine& engine) const override
+	{
+		const std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		while (held && std::chrono::steady_clock::now() < until)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		PageFile::readPages(pages, count, engine);
+	}
+
+	std::atomic<bool> held;
+};
+
+bool asyncBenchmark()
+{
+	typedef std::chrono::steady_clock clock;
+	const int numFrames = 256;
+	const int numPages = 8 * numFrames;
+	const int ops = 20000;
+	const int windows[] = {0, 1, 8, 32};
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+
+	bool ok = true;
+	std::cout << "Async reads: " << ops << " random reads of " << numPages << " pages, "
+		<< numFrames << " frames, one thread" << std::endl;
+	std::cout << "in flight	disk reads	ms" << std::endl;
+	for (std::size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+	{
+		BufMgr* bufMgr = new BufMgr(numFrames);
+		std::mt19937 rng(31);
+		int wrong = 0;
+		auto check = [&](const Page* page, PageId pageNo) {
+			RecordId rid = {pageNo, 1, 0};
+			COUNTER rec;
+			memcpy(&rec, page->getRecord(rid).data(), sizeof(rec));
+			if (page->page_number() != pageNo || rec.pageNo != pageNo)
+				wrong++;
+		};
+
+		clock::time_point start = clock::now();
+		if (windows[w] == 0)
+		{
+			for (int i = 0; i < ops; i++)
+			{
+				const PageId pageNo = pageIds[rng() % numPages];
+				Page* page;
+				bufMgr->readPage(file, pageNo, page);
+				check(page, pageNo);
+				bufMgr->unPinPage(file, pageNo, false);
+			}
+		}
+		else
+		{
+			// every completed read issues the next one
+			AsyncExecutor executor;
+			int issued = 0;
+			std::function<void()> issue = [&]() {
+				if (issued == ops)
+					return;
+				issued++;
+				const PageId pageNo = pageIds[rng() % numPages];
+				bufMgr->readPageAsync(file, pageNo, executor, [&, pageNo](PageHandle& page, std::exception_ptr error) {
+					if (error)
+						wrong++;
+					else
+						check(page.get(), pageNo);
+					page.release();
+					issue();
+				});
+			};
+			for (int i = 0; i < windows[w]; i++)
+				issue();
+			executor.run();
+		}
+		const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+		std::cout << windows[w] << (windows[w] == 0 ? " (sync)" : "") << "\t"
+			<< bufMgr->getBufStats().diskreads << "\t\t" << ms << std::endl;
+		if (wrong > 0)
+			ok = false;
+		delete bufMgr;
+	}
+
+	// the second read of a page finds the first still in flight, and completes
+	// with it rather than waiting for it on the executor's thread
+	{
+		HeldReadFile slow(file->filename());
+		BufMgr* bufMgr = new BufMgr(numFrames);
+		AsyncExecutor executor;
+		int completed = 0;
+		slow.held = true;
+		for (int i = 0; i < 2; i++)
+		{
+			bufMgr->readPageAsync(&slow, pageIds[0], executor, [&](PageHandle& page, std::exception_ptr error) {
+				if (!error && page.get()->page_number() == pageIds[0])
+					completed++;
+				page.release();
+			});
+		}
+		clock::time_point start = clock::now();
+		if (executor.poll() != 0)
+			ok = false;
+		const double pollMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+		slow.held = false;
+		executor.run();
+		std::cout << "poll() with a read in flight: " << pollMs << " ms" << std::endl;
+		if (completed != 2 || bufMgr->getBufStats().diskreads != 1)
+			ok = false;
+		delete bufMgr;
+	}
+
+	deleteBenchFile(file);
+	std::cout << (ok ? "Async read checks passed" : "Async read checks FAILED") << std::endl;
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// admissionBenchmark
+// Threads each pinning batches of up to a fixed number of random pages at
+// once, together needing more frames than the pool has: first with nothing
+// stopping them, then with every thread holding a BufClient that reserves
+// its batch size. Counts the batches that failed with the pool exhausted,
+// which should be none with admission. Then times readPage() failing with
+// every frame pinned.
+// -----------------------------------------------------------------------------
+
+bool admissionBenchmark(int maxThreads)
+{
+	typedef std::chrono::steady_clock clock;
+	const int numFrames = 64;
+	const int numPages = 8 * numFrames;
+	const int batch = 24;
+	const int rounds = 300;
+	const int numThreads = std::max(maxThreads, 4);
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+
+	bool ok = true;
+	std::cout << "Admission: " << numThreads << " threads pinning " << batch << " pages at a time, "
+		<< numFrames << " frames" << std::endl;
+	std::cout << "admission	failed batches	peak pins	ms" << std::endl;
+	for (int admission = 0; admission < 2; admission++)
+	{
+		BufMgr* bufMgr = new BufMgr(numFrames);
+		std::atomic<int> failed(0);
+		std::atomic<int> peak(0);
+		std::atomic<int> wrong(0);
+		std::vector<std::thread> threads;
+		clock::time_point start = clock::now();
+		for (int t = 0; t < numThreads; t++)
+		{
+			threads.push_back(std::thread([&, t]() {
+				std::mt19937 rng(t);
+				for (int r = 0; r < rounds; r++)
+				{
+					std::unique_ptr<BufClient> client(admission ? new BufClient(bufMgr, batch) : NULL);
+					std::vector<PageId> pinned;
+					try
+					{
+						while ((int)pinned.size() < batch)
+						{
+							const PageId pageNo = pageIds[rng() % numPages];
+							if (std::find(pinned.begin(), pinned.end(), pageNo) != pinned.end())
+								continue;
+							Page* page;
+							bufMgr->readPage(file, pageNo, page);
+							pinned.push_back(pageNo);
+						}
+					}
+					catch(const BufferExceededException &)
+					{
+						failed++;
+					}
+					if (client && client->pins() != (int)pinned.size())
+						wrong++;
+					for (std::size_t i = 0; i < pinned.size(); i++)
+						bufMgr->unPinPage(file, pinned[i], false);
+					if (client)
+					{
+						if (client->pins() != 0)
+							wrong++;
+						if (client->peakPins() > peak)
+							peak = client->peakPins();
+					}
+				}
+			}));
+		}
+		for (std::size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+		const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+		std::cout << (admission ? "reserved" : "none") << "\t\t" << failed << "\t\t"
+			<< (admission ? std::to_string(peak) : std::string("-")) << "\t\t" << ms << std::endl;
+		if (admission && (failed > 0 || wrong > 0 || peak != batch))
+			ok = false;
+		if (bufMgr->freeFrames() != (std::uint32_t)numFrames || bufMgr->getReservedFrames() != 0)
+			ok = false;
+		delete bufMgr;
+	}
+
+	// a reservation larger than the pool, or one that times out, is refused
+	{
+		BufMgr* bufMgr = new BufMgr(numFrames);
+		try
+		{
+			BufClient client(bufMgr, numFrames + 1);
+			ok = false;
+		}
+		catch(const BufferExceededException &)
+		{
+		}
+		BufClient all(bufMgr, numFrames);
+		std::thread([&]() {
+			try
+			{
+				BufClient more(bufMgr, 1, std::chrono::milliseconds(10));
+				ok = false;
+			}
+			catch(const BufferExceededException &)
+			{
+			}
+		}).join();
+		delete bufMgr;
+	}
+
+	// frames pinned outside any client are not free to reserve, and a client
+	// admitted before they were pinned waits for one to be unpinned
+	{
+		BufMgr* bufMgr = new BufMgr(numFrames);
+		std::atomic<bool> admitted(false);
+		std::atomic<bool> read(false);
+		std::thread reader([&]() {
+			BufClient client(bufMgr, 1);
+			admitted = true;
+			while (bufMgr->freeFrames() != 0)
+				std::this_thread::yield();
+			try
+			{
+				Page* page;
+				bufMgr->readPage(file, pageIds[numFrames], page);
+				read = true;
+				bufMgr->unPinPage(file, pageIds[numFrames], false);
+			}
+			catch(const BufferExceededException &)
+			{
+			}
+		});
+		while (!admitted)
+			std::this_thread::yield();
+		for (int i = 0; i < numFrames; i++)
+		{
+			Page* page;
+			bufMgr->readPage(file, pageIds[i], page);
+		}
+		std::thread([&]() {
+			try
+			{
+				BufClient more(bufMgr, 1, std::chrono::milliseconds(10));
+				ok = false;
+			}
+			catch(const BufferExceededException &)
+			{
+			}
+		}).join();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		bufMgr->unPinPage(file, pageIds[0], false);
+		reader.join();
+		if (!read)
+			ok = false;
+		for (int i = 1; i < numFrames; i++)
+			bufMgr->unPinPage(file, pageIds[i], false);
+		if (bufMgr->freeFrames() != (std::uint32_t)numFrames || bufMgr->getReservedFrames() != 0)
+			ok = false;
+		delete bufMgr;
+	}
+
+	// failing once every frame is pinned
+	{
+		const int attempts = 20000;
+		BufMgr* bufMgr = new BufMgr(numFrames);
+		for (int i = 0; i < numFrames; i++)
+		{
+			Page* page;
+			bufMgr->readPage(file, pageIds[i], page);
+		}
+		if (bufMgr->freeFrames() != 0)
+			ok = false;
+		int refused = 0;
+		clock::time_point start = clock::now();
+		for (int i = 0; i < attempts; i++)
+		{
+			try
+			{
+				Page* page;
+				bufMgr->readPage(file, pageIds[numFrames + i % numFrames], page);
+			}
+			catch(const BufferExceededException &)
+			{
+				refused++;
+			}
+		}
+		const double us = std::chrono::duration<double, std::micro>(clock::now() - start).count() / attempts;
+		std::cout << "readPage() with every frame pinned: " << us << " us per refusal" << std::endl;
+		if (refused != attempts)
+			ok = false;
+		for (int i = 0; i < numFrames; i++)
+			bufMgr->unPinPage(file, pageIds[i], false);
+		if (bufMgr->freeFrames() != (std::uint32_t)numFrames)
+			ok = false;
+		delete bufMgr;
+	}
+
+	deleteBenchFile(file);
+	std::cout << (ok ? "Admission checks passed" : "Admission checks FAILED") << std::endl;
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// fileIoBenchmark
+// Random page reads straight from one File, without a buffer pool, for 1, 2,
+// 4, ... maxThreads threads, checking every page read is the page asked for.
+// Then rewrites every page and flushes the file once.
+// -----------------------------------------------------------------------------
+
+bool fileIoBenchmark(int maxThreads)
+{
+	typedef std::chrono::steady_clock clock;
+	const int numPages = 2048;
+	const std::chrono::milliseconds duration(500);
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+
+	bool ok = true;
+	std::cout << "File I/O: random reads of " << numPages << " pages of one file" << std::endl;
+	std::cout << "threads\treads/s\tspeedup" << std::endl;
+	double base = 0;
+	for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+	{
+		std::atomic<bool> stop(false);
+		std::atomic<long long> total(0);
+		std::atomic<int> wrong(0);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; t++)
+		{
+			threads.push_back(std::thread([&, t]() {
+				std::mt19937 rng(t);
+				Page page;
+				long long ops = 0;
+				while (!stop)
+				{
+					const PageId pageNo = pageIds[rng() % numPages];
+					file->readPage(pageNo, page);
+					if (page.page_number() != pageNo)
+						wrong++;
+					ops++;
+				}
+				total += ops;
+			}));
+		}
+		std::this_thread::sleep_for(duration);
+		stop = true;
+		for (std::size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+
+		const double opsPerSec = total * 1000.0 / duration.count();
+		if (numThreads == 1)
+			base = opsPerSec;
+		std::cout << numThreads << "\t" << (long long)opsPerSec << "\t" << opsPerSec / base << std::endl;
+		if (wrong > 0)
+			ok = false;
+	}
+
+	clock::time_point start = clock::now();
+	for (int i = 0; i < numPages; i++)
+		file->writePage(pageIds[i], file->readPage(pageIds[i]));
+	const double writeMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	start = clock::now();
+	file->flush();
+	const double flushMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	std::cout << "rewrite of " << numPages << " pages: " << writeMs << " ms, then flush: " << flushMs << " ms" << std::endl;
+
+	deleteBenchFile(file);
+	std::cout << (ok ? "File I/O checks passed" : "File I/O checks FAILED") << std::endl;
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// bulkIoBenchmark
+// Random page reads from one file one readPage() at a time, then in batches
+// through File::readPages() on each I/O engine. Then a BufMgr on each engine
+// dirties every page of the file and flushes it, after which the file is
+// checked to hold every update.
+// -----------------------------------------------------------------------------
+
+bool bulkIoBenchmark()
+{
+	typedef std::chrono::steady_clock clock;
+	const int numPages = 2048;
+	const int ops = 16384;
+	const std::size_t batch = 32;
+	const IoEngineType types[] = {IO_THREAD_POOL, IO_URING};
+
+	std::vector<PageId> pageIds;
+	PageFile* file = createBenchFile(numPages, pageIds);
+
+	bool ok = true;
+	std::cout << "Bulk I/O: " << ops << " random reads of " << numPages << " pages, batches of "
+		<< batch << std::endl;
+	std::cout << "engine\t\treads ms\tflush ms" << std::endl;
+
+	{
+		std::mt19937 rng(5);
+		Page page;
+		clock::time_point start = clock::now();
+		for (int i = 0; i < ops; i++)
+		{
+			const PageId pageNo = pageIds[rng() % numPages];
+			file->readPage(pageNo, page);
+			if (page.page_number() != pageNo)
+				ok = false;
+		}
+		const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+		std::cout << "one at a time\t" << ms << "\t-" << std::endl;
+	}
+
+	for (std::size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+	{
+		std::unique_ptr<IoEngine> engine(IoEngine::create(types[t]));
+		if (engine->type() != types[t])
+		{
+			std::cout << "io_uring\tunavailable" << std::endl;
+			continue;
+		}
+
+		std::mt19937 rng(5);
+		std::vector<Page> pages(batch);
+		std::vector<PageIo> ios(batch);
+		clock::time_point start = clock::now();
+		for (int i = 0; i < ops; i += batch)
+		{
+			for (std::size_t k = 0; k < batch; k++)
+			{
+				ios[k].page_number = pageIds[rng() % numPages];
+				ios[k].page = &pages[k];
+				ios[k].error = std::exception_ptr();
+			}
+			file->readPages(ios.data(), batch, *engine);
+			for (std::size_t k = 0; k < batch; k++)
+				if (ios[k].error || pages[k].page_number() != ios[k].page_number)
+					ok = false;
+		}
+		const double readMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+		// every page dirtied in the pool, then written back by flushFile()
+		BufMgr* bufMgr = new BufMgr(numPages);
+		bufMgr->setIoEngine(types[t]);
+		for (int i = 0; i < numPages; i++)
+		{
+			Page* page;
+			bufMgr->readPage(file, pageIds[i], page);
+			RecordId rid = {pageIds[i], 1, 0};
+			COUNTER rec = {pageIds[i], (int)t + 1};
+			page->updateRecord(rid, std::string((char*)&rec, sizeof(rec)));
+			bufMgr->unPinPage(file, pageIds[i], true);
+		}
+		start = clock::now();
+		bufMgr->flushFile(file);
+		const double flushMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+		if (bufMgr->getBufStats().diskwrites != numPages)
+			ok = false;
+		std::cout << engine->name() << (engine->type() == IO_URING ? "\t" : "\t\t") << readMs << "\t"
+			<< flushMs << std::endl;
+		delete bufMgr;
+
+		for (int i = 0; i < numPages; i++)
+		{
+			Page page = file->readPage(pageIds[i]);
+			RecordId rid = {pageIds[i], 1, 0};
+			COUNTER rec;
+			memcpy(&rec, page.getRecord(rid).data(), sizeof(rec));
+			if (rec.pageNo != pageIds[i] || rec.count != (int)t + 1)
+				ok = false;
+		}
+	}
+
+	deleteBenchFile(file);
+	std::cout << (ok ? "Bulk I/O checks passed" : "Bulk I/O checks FAILED") << std::endl;
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// allocBenchmark
+// Times allocating the pages of files of growing size, which should take the
+// same time per page whatever the size. The file header must only reach the
+// disk when the file is flushed or closed. Then every other page is deleted and
+// reallocated, and the used list must still run in ascending page order with
+// the map page on neither list. Last, a file is written in the legacy format
+// (16 byte header) and must be upgraded when it is opened, keeping its pages.
+// -----------------------------------------------------------------------------
+
+/**
+ * Checks that iterating the file visits exactly the expected pages, in order,
+ * each holding its own counter.
+ */
+static bool checkUsedList(PageFile* file, const std::vector<PageId>& expected)
+{
+	std::size_t i = 0;
+	for (FileIterator it = file->begin(); it != file->end(); ++it, ++i)
+	{
+		Page page = *it;
+		if (i >= expected.size() || page.page_number() != expected[i])
+			return false;
+		RecordId rid = {page.page_number(), 1, 0};
+		COUNTER rec;
+		memcpy(&rec, page.getRecord(rid).data(), sizeof(rec));
+		if (rec.pageNo != page.page_number())
+			return false;
+	}
+	return i == expected.size();
+}
+
+/**
+ * Writes a file in an old format: the given header, then pages 1 to numPages
+ * on the used list, each holding its own counter.
+ */
+static bool writeOldFile(const std::string& name, const void* header, std::size_t headerSize,
+	int numPages, std::vector<PageId>& pageIds)
+{
+	try
+	{
+		File::remove(name);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	static_assert(sizeof(Page) == Page::SIZE, "pages are written as they are laid out");
+	const int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	bool ok = pwrite(fd, header, headerSize, 0) == (ssize_t)headerSize;
+	for (PageId pageNo = 1; pageNo <= (PageId)numPages; pageNo++)
+	{
+		Page page;
+		COUNTER rec = {pageNo, 0};
+		page.insertRecord(std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+		char bytes[Page::SIZE];
+		memcpy(bytes, &page, Page::SIZE);
+		PageHeader* pageHeader = reinterpret_cast<PageHeader*>(bytes);
+		pageHeader->current_page_number = pageNo;
+		pageHeader->next_page_number = pageNo < (PageId)numPages ? pageNo + 1 : Page::INVALID_NUMBER;
+		ok = pwrite(fd, bytes, Page::SIZE, headerSize + (off_t)(pageNo - 1) * Page::SIZE)
+			== (ssize_t)Page::SIZE && ok;
+		pageIds.push_back(pageNo);
+	}
+	close(fd);
+	return ok;
+}
+
+bool allocBenchmark()
+{
+	typedef std::chrono::steady_clock clock;
+	const int sizes[] = {1024, 4096, 16384};
+
+	bool ok = true;
+	std::cout << "Page allocation" << std::endl;
+	std::cout << "pages	us/page" << std::endl;
+	for (std::size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		std::vector<PageId> pageIds;
+		clock::time_point start = clock::now();
+		PageFile* file = createBenchFile(sizes[s], pageIds);
+		const double us = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+		std::cout << sizes[s] << "\t" << us / sizes[s] << std::endl;
+		ok = checkUsedList(file, pageIds) && ok;
+		deleteBenchFile(file);
+	}
+
+	// the header reaches the disk when the file is flushed, not on every change
+	{
+		const int numPages = 64;
+		std::vector<PageId> pageIds;
+		PageFile* file = createBenchFile(numPages, pageIds);
+		FileHeader onDisk;
+		const int fd = open(file->filename().c_str(), O_RDONLY);
+		ok = pread(fd, &onDisk, sizeof(onDisk), 0) == sizeof(onDisk) && onDisk.num_pages == 0 && ok;
+		file->flush();
+		ok = pread(fd, &onDisk, sizeof(onDisk), 0) == sizeof(onDisk) && onDisk.magic == FILE_MAGIC
+			&& onDisk.num_pages == pageIds.back() + 1 && ok;
+		file->deletePage(pageIds[0]);
+		delete file;
+		ok = pread(fd, &onDisk, sizeof(onDisk), 0) == sizeof(onDisk) && onDisk.num_free_pages == 1 && ok;
+		close(fd);
+		file = new PageFile(benchFileName, false);
+		ok = checkUsedList(file, std::vector<PageId>(pageIds.begin() + 1, pageIds.end())) && ok;
+		deleteBenchFile(file);
+	}
+
+	// delete every other page, then allocate as many again
+	{
+		const int numPages = 2048;
+		std::vector<PageId> pageIds;
+		PageFile* file = createBenchFile(numPages, pageIds);
+		std::vector<PageId> kept;
+		clock::time_point start = clock::now();
+		for (int i = 0; i < numPages; i++)
+			if (i % 2)
+				file->deletePage(pageIds[i]);
+			else
+				kept.push_back(pageIds[i]);
+		const double deleteUs = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+		ok = checkUsedList(file, kept) && ok;
+
+		start = clock::now();
+		for (int i = 0; i < numPages / 2; i++)
+		{
+			PageId pageNo;
+			Page page = file->allocatePage(pageNo);
+			COUNTER rec = {pageNo, 0};
+			page.insertRecord(std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+			file->writePage(pageNo, page);
+		}
+		const double reuseUs = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+		// freed pages are all reused, so the file holds the same pages again
+		ok = checkUsedList(file, pageIds) && ok;
+		std::cout << "delete\t" << deleteUs / (numPages / 2) << std::endl;
+		std::cout << "reuse\t" << reuseUs / (numPages / 2) << std::endl;
+
+		// the page before the first data page is the map
+		try
+		{
+			file->deletePage(pageIds[0] - 1);
+			ok = false;
+		}
+		catch(const InvalidPageException &)
+		{
+		}
+		deleteBenchFile(file);
+	}
+
+	// a file in the legacy format: 16 byte header, then pages 1 to numPages
+	{
+		const int numPages = 300;
+		const std::string name = benchFileName;
+		const PageId legacy[4] = {numPages + 1, 1, 0, 0};
+		std::vector<PageId> pageIds;
+		ok = writeOldFile(name, legacy, sizeof(legacy), numPages, pageIds) && ok;
+
+		PageFile* file = new PageFile(name, false);
+		ok = checkUsedList(file, pageIds) && ok;
+
+		// a deleted page is reused in place, a new one goes after the map page
+		file->deletePage(7);
+		PageId pageNo;
+		Page page = file->allocatePage(pageNo);
+		ok = pageNo == 7 && ok;
+		COUNTER rec = {pageNo, 0};
+		page.insertRecord(std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+		file->writePage(pageNo, page);
+		page = file->allocatePage(pageNo);
+		ok = pageNo == numPages + 2 && ok;
+		rec.pageNo = pageNo;
+		page.insertRecord(std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+		file->writePage(pageNo, page);
+		pageIds.push_back(pageNo);
+		ok = checkUsedList(file, pageIds) && ok;
+		delete file;
+
+		// opened again, the file is left as it is
+		file = new PageFile(name, false);
+		ok = checkUsedList(file, pageIds) && ok;
+		deleteBenchFile(file);
+	}
+
+	// a page another process allocated can be read here, though the header
+	// this process keeps, and the one on disk, do not count it yet
+	{
+		std::vector<PageId> pageIds;
+		PageFile* file = createBenchFile(4, pageIds);
+		int fds[2];
+		ok = pipe(fds) == 0 && ok;
+		const pid_t pid = fork();
+		if (pid == 0)
+		{
+			PageId pageNo;
+			Page page = file->allocatePage(pageNo);
+			COUNTER rec = {pageNo, 0};
+			page.insertRecord(std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+			file->writePage(pageNo, page);
+			// gone without closing the file, so the header is not written back
+			_exit(write(fds[1], &pageNo, sizeof(pageNo)) == sizeof(pageNo) ? 0 : 1);
+		}
+		PageId pageNo = Page::INVALID_NUMBER;
+		int status = 0;
+		ok = read(fds[0], &pageNo, sizeof(pageNo)) == sizeof(pageNo) && waitpid(pid, &status, 0) == pid
+			&& status == 0 && ok;
+		close(fds[0]);
+		close(fds[1]);
+		try
+		{
+			ok = file->readPage(pageNo).page_number() == pageNo && ok;
+		}
+		catch(const InvalidPageException &)
+		{
+			std::cout << "page allocated by another process could not be read" << std::endl;
+			ok = false;
+		}
+		deleteBenchFile(file);
+	}
+
+	std::cout << (ok ? "Allocation checks passed" : "Allocation checks FAILED") << std::endl;
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// extentBenchmark
+// Two files grown a page at a time in turn must each take whole extents of
+// disk space. With the OS cache dropped, one of them is then scanned a page
+// at a time with readPage(), with FileIterator, which reads whole extents,
+// and with FileScan through a BufMgr. An iterator at the end must see a
+// page appended since. After churn the iterator must still visit the used
+// pages in ascending order, and readPages() must read a run of pages with
+// free pages among them. Last, a version 2 file must be upgraded when it is opened.
+// -----------------------------------------------------------------------------
+
+/**
+ * Allocates a page holding its own counter.
+ */
+static PageId appendCounterPage(PageFile* file)
+{
+	PageId pageNo;
+	Page page = file->allocatePage(pageNo);
+	COUNTER rec = {pageNo, 0};
+	page.insertRecord(std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+	file->writePage(pageNo, page);
+	return pageNo;
+}
+
+/**
+ * Returns true if the file takes whole extents of disk space.
+ */
+static bool wholeExtents(const std::string& name)
+{
+	struct stat st;
+	return stat(name.c_str(), &st) == 0 && st.st_size >= (off_t)sizeof(FileHeader)
+		&& (st.st_size - sizeof(FileHeader)) % (PageFile::EXTENT_PAGES * Page::SIZE) == 0;
+}
+
+bool extentBenchmark()
+{
+	typedef std::chrono::steady_clock clock;
+	const int numPages = 4096;
+	const std::string otherName = benchFileName + ".other";
+
+	bool ok = true;
+	std::vector<PageId> pageIds;
+	std::vector<PageId> otherIds;
+	PageFile* file = createBenchFile(0, pageIds);
+	PageFile* other = createBenchFile(0, otherIds, otherName);
+	for (int i = 0; i < numPages; i++)
+	{
+		pageIds.push_back(appendCounterPage(file));
+		otherIds.push_back(appendCounterPage(other));
+	}
+	ok = wholeExtents(benchFileName) && wholeExtents(otherName) && ok;
+	deleteBenchFile(other);
+
+	std::cout << "Extents: scan of " << numPages << " pages, OS cache dropped" << std::endl;
+	std::cout << "reader		ms" << std::endl;
+	{
+		dropOsCache(benchFileName);
+		int visited = 0;
+		clock::time_point start = clock::now();
+		for (PageId pageNo = file->getFirstPageNo(); pageNo != Page::INVALID_NUMBER; visited++)
+			pageNo = file->readPage(pageNo).next_page_number();
+		const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+		std::cout << "readPage	" << ms << std::endl;
+		ok = visited == numPages && ok;
+
+		dropOsCache(benchFileName);
+		start = clock::now();
+		ok = checkUsedList(file, pageIds) && ok;
+		std::cout << "FileIterator	" << std::chrono::duration<double, std::milli>(clock::now() - start).count()
+			<< std::endl;
+
+		dropOsCache(benchFileName);
+		BufMgr* bufMgr = new BufMgr(256);
+		start = clock::now();
+		{
+			FileScan scan(benchFileName, bufMgr);
+			RecordId rid;
+			visited = 0;
+			while (scan.tryScanNext(rid))
+				visited++;
+		}
+		std::cout << "FileScan	" << std::chrono::duration<double, std::milli>(clock::now() - start).count()
+			<< std::endl;
+		ok = visited == numPages && ok;
+		delete bufMgr;
+
+		// a dereference sees a page written after the one before it was read
+		{
+			FileIterator it = file->begin();
+			*it;
+			++it;
+			RecordId rid = {it.page_number(), 1, 0};
+			Page changed = file->readPage(it.page_number());
+			COUNTER rec = {it.page_number(), 7};
+			changed.updateRecord(rid, std::string(reinterpret_cast<char*>(&rec), sizeof(rec)));
+			file->writePage(it.page_number(), changed);
+			Page seen = *it;
+			COUNTER got;
+			memcpy(&got, seen.getRecord(rid).data(), sizeof(got));
+			if (got.count != 7)
+			{
+				std::cout << "FileIterator returned a stale page" << std::endl;
+				ok = false;
+			}
+		}
+
+		// an iterator at the end sees a page appended since
+		FileIterator last = file->begin();
+		for (int i = 1; i < numPages; i++)
+			++last;
+		pageIds.push_back(appendCounterPage(file));
+		++last;
+		ok = last != file->end() && last.page_number() == pageIds.back() && ok;
+	}
+
+	// every third page deleted, then half of them allocated again
+	{
+		std::vector<PageId> kept;
+		std::vector<bool> used(pageIds.back() + 1, false);
+		for (std::size_t i = 0; i < pageIds.size(); i++)
+			if (i % 3 == 0)
+				file->deletePage(pageIds[i]);
+			else
+				used[pageIds[i]] = true;
+		for (std::size_t i = 0; i < pageIds.size() / 6; i++)
+			used[appendCounterPage(file)] = true;
+		for (PageId pageNo = 0; pageNo < used.size(); pageNo++)
+			if (used[pageNo])
+				kept.push_back(pageNo);
+		ok = checkUsedList(file, kept) && ok;
+
+		// one run of pages, free ones among them
+		const std::size_t run = PageFile::EXTENT_PAGES;
+		std::vector<Page> pages(run);
+		std::vector<PageIo> ios(run);
+		for (std::size_t k = 0; k < run; k++)
+		{
+			ios[k].page_number = pageIds[0] + k;
+			ios[k].page = &pages[k];
+		}
+		std::unique_ptr<IoEngine> engine(IoEngine::create());
+		file->readPages(ios.data(), run, *engine);
+		for (std::size_t k = 0; k < run; k++)
+			if (used[ios[k].page_number] != !ios[k].error
+				|| (used[ios[k].page_number] && pages[k].page_number() != ios[k].page_number))
+				ok = false;
+	}
+	deleteBenchFile(file);
+
+	// a version 2 file: the current header up to reserved_pages
+	{
+		const int numPages = 200;
+		const std::uint32_t version2[8] = {FILE_MAGIC, 2, numPages + 1, 1, 0, 0, numPages, 0};
+		std::vector<PageId> oldIds;
+		ok = writeOldFile(benchFileName, version2, sizeof(version2), numPages, oldIds) && ok;
+		file = new PageFile(benchFileName, false);
+		ok = checkUsedList(file, oldIds) && ok;
+		oldIds.push_back(appendCounterPage(file));
+		ok = checkUsedList(file, oldIds) && ok;
+		delete file;
+
+		FileHeader onDisk;
+		const int fd = open(benchFileName.c_str(), O_RDONLY);
+		ok = pread(fd, &onDisk, sizeof(onDisk), 0) == sizeof(onDisk) && onDisk.version == FILE_VERSION
+			&& onDisk.reserved_pages > onDisk.num_pages && ok;
+		close(fd);
+		ok = wholeExtents(benchFileName) && ok;
+		file = new PageFile(benchFileName, false);
+		ok = checkUsedList(file, oldIds) && ok;
+		deleteBenchFile(file);
+	}
+
+	std::cout << (ok ? "Extent checks passed" : "Extent checks FAILED") << std::endl;
+	return ok;
+}
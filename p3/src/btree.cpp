@@ -4,6 +4,7 @@
  * @section LICENSE
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
+#include <algorithm>
 #include <string>
 #include "btree.h"
 #include "filescan.h"
@@ -14,7 +15,6 @@
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
-#include "exceptions/end_of_file_exception.h"
 
 //#define DEBUG
 
@@ -40,20 +40,15 @@ namespace badgerdb
 		std::string indexName = idxStr.str(); // name of the index file
 		outIndexName = indexName;
 
-		// We will keep the root page in the buffer pool during the entirety of our program
-		Page* cachedRoot;
-
-		// We won't keep the header page in the buffer pool. We update it at the end.
-		Page * headerPage;
-
+		// We will keep the root page (rootPage) in the buffer pool during the entirety of our program
 		// Check to see if a file exists with name indexName...
 		try {
 			file =  new BlobFile(indexName, false);
 			std::cout << "Opened existing index file\n";
 			
-			// Load header page
-			bufMgr->readPage(file, headerPageNum, headerPage);
-			IndexMetaInfo* header = (IndexMetaInfo*)headerPage;
+			// Load header page. We won't keep it in the buffer pool, we update it at the end.
+			PageHandle headerPage = bufMgr->fetchPage(file, headerPageNum);
+			IndexMetaInfo* header = (IndexMetaInfo*)headerPage.get();
 			
 
 			// Assuming meta info in file doesn't conflit with actuals
@@ -62,12 +57,13 @@ namespace badgerdb
 			nodeOccupancy=header->nodeOccupancy;
 			
 			// unpin (updated at the end)
-			bufMgr->unPinPage(file, headerPageNum, true);
+			headerPage.markDirty();
+			headerPage.release();
 
 			// read the root page
-			bufMgr->readPage(file, rootPageNum, cachedRoot);
+			rootPage = bufMgr->fetchPage(file, rootPageNum);
 
-			//printNode(rootPageNum, cachedRoot, false);		
+			//printNode(rootPageNum, rootPage.get(), false);		
 			std::cout << "Leaf num: "<<leafOccupancy<<"\n";
 			std::cout << "internal num: "<<nodeOccupancy<<"\n";
 			
@@ -75,9 +71,9 @@ namespace badgerdb
 			std::cout << "Created new index file\n";
 			file =  new BlobFile(indexName, true);
 			
-			// Load header page
-			bufMgr->allocPage(file, headerPageNum, headerPage);
-			IndexMetaInfo* header = (IndexMetaInfo*)headerPage;
+			// Load header page. We won't keep it in the buffer pool, we update it at the end.
+			PageHandle headerPage = bufMgr->newPage(file, headerPageNum);
+			IndexMetaInfo* header = (IndexMetaInfo*)headerPage.get();
 
 			// initialize meta info in header
 			*header = IndexMetaInfo();
@@ -90,29 +86,28 @@ namespace badgerdb
 			header->attrType = attributeType;
 			
 			// unpin (updated at the end)
-			bufMgr->unPinPage(file, headerPageNum, true);
+			headerPage.markDirty();
+			headerPage.release();
 
 			// Create new root page
-			bufMgr->allocPage(file, rootPageNum, cachedRoot);
+			rootPage = bufMgr->newPage(file, rootPageNum);
 
 			// Initial root to empty leaf node
-			LeafNodeInt* rootNode = (LeafNodeInt*)(cachedRoot);
+			LeafNodeInt* rootNode = (LeafNodeInt*)(rootPage.get());
 			*rootNode = LeafNodeInt();
+			rootPage.markDirty();
 
-			// Scan through and insert data
+			// Scan through and insert data. The scan reads the relation through
+			// its own buffer ring, so the index pages built here stay in the pool
 			FileScan fscan(relationName, bufMgr);
-			try {
-				RecordId scanRid;
-				while (1) {
-					fscan.scanNext(scanRid);
-					//Assuming RECORD.i is our key, lets extract the key, which we know is INTEGER and whose byte offset is also know inside the record. 
-					std::string recordStr = fscan.getRecord();
-					const char* record = recordStr.c_str();
-					const void* key = (void *)(record + attrByteOffset);
-					insertEntry(key, scanRid);
-				}
+			RecordId scanRid;
+			while (fscan.tryScanNext(scanRid)) {
+				//Assuming RECORD.i is our key, lets extract the key, which we know is INTEGER and whose byte offset is also know inside the record. 
+				std::string recordStr = fscan.getRecord();
+				const char* record = recordStr.c_str();
+				const void* key = (void *)(record + attrByteOffset);
+				insertEntry(key, scanRid);
 			}
-			catch (const EndOfFileException &e){}
 		}
 	}
 
@@ -125,16 +120,17 @@ namespace badgerdb
 		if(scanExecuting) endScan();
 
 		// Write data to header page
-		Page* headerPage;
-		bufMgr->readPage(file, headerPageNum, headerPage);
-		IndexMetaInfo* header = (IndexMetaInfo*) headerPage;
+		PageHandle headerPage = bufMgr->fetchPage(file, headerPageNum);
+		IndexMetaInfo* header = (IndexMetaInfo*) headerPage.get();
 		header->rootPageNo = rootPageNum;
 		header->leafOccupancy = leafOccupancy;
 		header->nodeOccupancy = nodeOccupancy;
-		bufMgr->unPinPage(file,headerPageNum,true);
+		headerPage.markDirty();
+		headerPage.release();
 
 		//Unpin root (we have been keeping it pinned)
-		bufMgr->unPinPage(file,rootPageNum,true);
+		rootPage.markDirty();
+		rootPage.release();
 
 		// Delete
 		bufMgr->flushFile(file);
@@ -154,7 +150,7 @@ namespace badgerdb
 		int currKey = *(int*)(key);
 
 		// Load root page from buffer pool
-		Page* currPage;
+		PageHandle currPage;
 		
 		// Id of current loaded page
 		PageId currId = rootPageNum;
@@ -166,17 +162,17 @@ namespace badgerdb
 		findLeaf(currId, currPage, currKey, currDepth, !nodeOccupancy);
 
 		// Now we are at a leaf node
-		LeafNodeInt* leafNode = (LeafNodeInt*) currPage;
+		LeafNodeInt* leafNode = (LeafNodeInt*) currPage.get();
 
 		// Check if the new entry will fit
 		if(leafNode->numValidKeys < INTARRAYLEAFSIZE){
 			/* The leaf is not full: add the element */
 			
 			// find the insertion index
-			int insertAt = findIndex(currId,currPage,currKey,true);
+			int insertAt = findIndex(currId,currPage.get(),currKey,true);
 
 			// make room for the new element
-			shiftData(currId, currPage, insertAt, true);
+			shiftData(currId, currPage.get(), insertAt, true);
 
 			// insert new element
 			leafNode->keyArray[insertAt]=currKey;
@@ -186,7 +182,7 @@ namespace badgerdb
 			leafNode->numValidKeys++;
 			
 			// Unpin current (dirty) leaf page
-			bufMgr->unPinPage(file, currId, true);
+			currPage.markDirty();
 			
 			return;
 		}
@@ -195,17 +191,16 @@ namespace badgerdb
 		/* The leaf is full: divide the leaf node and copy middle element up */
 
 		// create page to copy half of the data into
-		Page* secondPage;
 		PageId secondPageId;
-		bufMgr->allocPage(file,secondPageId,secondPage);
+		PageHandle secondPage = bufMgr->newPage(file, secondPageId);
 
 		// Create node struct in new page
-		LeafNodeInt* secondLeafNode = (LeafNodeInt*) secondPage;
+		LeafNodeInt* secondLeafNode = (LeafNodeInt*) secondPage.get();
 		*secondLeafNode = LeafNodeInt();
 		secondLeafNode->numValidKeys=INTARRAYLEAFSIZE/2;
 
 		// the side that we insert on
-		bool insertLeft = findIndex(currId, currPage, currKey, true) <= INTARRAYLEAFSIZE/2;
+		bool insertLeft = findIndex(currId, currPage.get(), currKey, true) <= INTARRAYLEAFSIZE/2;
 		
 		// Number of keys to move to second node
 		int copyNum = (INTARRAYLEAFSIZE + insertLeft) / 2;
@@ -221,8 +216,8 @@ namespace badgerdb
 		
 		if (insertLeft) {
 			// find where to insert at in left node
-			int insertAt = findIndex(currId, currPage, currKey, true);
-			shiftData(currId, currPage, insertAt, true);
+			int insertAt = findIndex(currId, currPage.get(), currKey, true);
+			shiftData(currId, currPage.get(), insertAt, true);
 			
 			// insert new element
 			leafNode->keyArray[insertAt] = currKey;
@@ -230,8 +225,8 @@ namespace badgerdb
 			leafNode->numValidKeys++;
 		} else {
 			// find where to insert at in left node
-			int insertAt = findIndex(secondPageId, secondPage, currKey, true);
-			shiftData(secondPageId, secondPage, insertAt, true);
+			int insertAt = findIndex(secondPageId, secondPage.get(), currKey, true);
+			shiftData(secondPageId, secondPage.get(), insertAt, true);
 			
 			// insert new element
 			secondLeafNode->keyArray[insertAt] = currKey;
@@ -251,8 +246,10 @@ namespace badgerdb
 		PageId prevId = secondPageId;
 
 		// unpin (dirty) leaf pages
-		bufMgr->unPinPage(file,secondPageId, true);
-		bufMgr->unPinPage(file,currId, true);
+		secondPage.markDirty();
+		secondPage.release();
+		currPage.markDirty();
+		currPage.release();
 
 		// Move up one level
 		currId = findParent(currId);
@@ -261,8 +258,8 @@ namespace badgerdb
 		// While we are below the root node, split parent and push up middle parent key if needed
 		while (currDepth >= 0) {
 			// Load new node (parent of old)
-			bufMgr->readPage(file, currId, currPage);
-			NonLeafNodeInt* currNode = (NonLeafNodeInt*) currPage;
+			currPage = bufMgr->fetchPage(file, currId, NULL, HOT_INDEX_INTERNAL);
+			NonLeafNodeInt* currNode = (NonLeafNodeInt*) currPage.get();
 
 			// No matter what, we are adding a key to an internal node
 			nodeOccupancy++;
@@ -271,10 +268,10 @@ namespace badgerdb
 			if (currNode->numValidKeys < INTARRAYNONLEAFSIZE) {
 				
 				// find the insertion index
-				int insertAt = findIndex(currId, currPage, currKey, false);
+				int insertAt = findIndex(currId, currPage.get(), currKey, false);
 				
 				// make room for the new element
-				shiftData(currId, currPage, insertAt, false);
+				shiftData(currId, currPage.get(), insertAt, false);
 				
 				// insert new element
 				currNode->keyArray[insertAt] = currKey;
@@ -284,21 +281,21 @@ namespace badgerdb
 				currNode->numValidKeys++;
 
 				// Unpin current (dirty) node page
-				bufMgr->unPinPage(file, currId, true);
+				currPage.markDirty();
 
 				return;
 			}
 			// Else we split the parent, push up the middle parent key, and add the new value to the correct sibling
 
 			// create page to copy half of the data into
-			bufMgr->allocPage(file, secondPageId, secondPage);
+			secondPage = bufMgr->newPage(file, secondPageId);
 			
 			// Create node struct in new page
-			NonLeafNodeInt* secondNode = (NonLeafNodeInt*) secondPage;
+			NonLeafNodeInt* secondNode = (NonLeafNodeInt*) secondPage.get();
 			*secondNode = NonLeafNodeInt();
 
 			// the side that we insert on
-			bool insertLeft = findIndex(currId, currPage, currKey, false) < INTARRAYNONLEAFSIZE/2;
+			bool insertLeft = findIndex(currId, currPage.get(), currKey, false) < INTARRAYNONLEAFSIZE/2;
 			
 			// Number of keys to move to second node
 			int copyNum = (INTARRAYNONLEAFSIZE - !insertLeft) / 2;
@@ -321,8 +318,8 @@ namespace badgerdb
 					// get key to push up
 					currKey = currNode->keyArray[currNode->numValidKeys--];
 					
-					int insertAt = findIndex(currId, currPage, currKey, false);
-					shiftData(currId, currPage, insertAt, false);
+					int insertAt = findIndex(currId, currPage.get(), currKey, false);
+					shiftData(currId, currPage.get(), insertAt, false);
 					
 					// insert new element
 					currNode->keyArray[insertAt] = currKey;
@@ -331,8 +328,8 @@ namespace badgerdb
 				}
 			} else {
 				// find where to insert at in left node
-				int insertAt = findIndex(secondPageId, secondPage, currKey, false);
-				shiftData(secondPageId, secondPage, insertAt, false);
+				int insertAt = findIndex(secondPageId, secondPage.get(), currKey, false);
+				shiftData(secondPageId, secondPage.get(), insertAt, false);
 				
 				// insert new element
 				secondNode->keyArray[insertAt] = currKey;
@@ -347,8 +344,10 @@ namespace badgerdb
 			secondNode->level = currNode->level; // same as sibling
 
 			// We don't need these anymore
-			bufMgr->unPinPage(file, secondPageId, true);
-			bufMgr->unPinPage(file, currId, true);
+			secondPage.markDirty();
+			secondPage.release();
+			currPage.markDirty();
+			currPage.release();
 
 			currId = findParent(currId);
 			prevId = secondPageId;
@@ -361,9 +360,8 @@ namespace badgerdb
 		 */
 		
 		// Make new root node
-		Page* newRootPage;
-		bufMgr->allocPage(file, rootPageNum, newRootPage);
-		NonLeafNodeInt* newRootNode = (NonLeafNodeInt*) newRootPage;
+		PageHandle newRootPage = bufMgr->newPage(file, rootPageNum);
+		NonLeafNodeInt* newRootNode = (NonLeafNodeInt*) newRootPage.get();
 		*newRootNode = NonLeafNodeInt();
 
 		// Set root values
@@ -378,20 +376,9 @@ namespace badgerdb
 		newRootNode->pageNoArray[0] = currId; // left child
 		newRootNode->pageNoArray[1] = secondPageId; // right child
 
-		// Load children
-		bufMgr->readPage(file, currId, currPage);
-		bufMgr->readPage(file, secondPageId, secondPage);
-		
-		/* Unpinning */ 
-		
-		// This is the old root and so it get's unpinned twice
-		bufMgr->unPinPage(file, currId, true); 
-		bufMgr->unPinPage(file, currId, true);
-
-		// unpin right child
-		bufMgr->unPinPage(file, secondPageId, true);	
-
-		// Note: We leave the new root pinned
+		// Keep the new root pinned instead of the old one (currId), which is unpinned here
+		newRootPage.markDirty();
+		rootPage = std::move(newRootPage);
 	}
 
 	/**
@@ -403,35 +390,51 @@ namespace badgerdb
 	 * @param currDepth current depth in tree (root is 0)
 	 * @param isLeaf are we at a leaf (does nothing in this case)
 	 */
-	void BTreeIndex::findLeaf(PageId& pageNo, Page*& page, int key, int& currDepth, bool isLeaf){
-		bufMgr->readPage(file, pageNo, page);
+	void BTreeIndex::findLeaf(PageId& pageNo, PageHandle& page, int key, int& currDepth, bool isLeaf){
+		page.release();
 		while (!isLeaf) { 
 			// By assumption, we are at an internal node
-			NonLeafNodeInt* currNode = (NonLeafNodeInt*) page;
-
-			// Will the next node be a leaf?
-			isLeaf=currNode->level;
-
-			// Determine where to traverse to next
-			int insertAt=0;
-			while (insertAt < currNode->numValidKeys 
-					&& key >= currNode->keyArray[insertAt]) insertAt++;
+			PageId next = Page::INVALID_NUMBER;
 
-			// used for unpinning
-			PageId old = pageNo;
+			if (pageNo == rootPageNum && rootPage.get() != NULL) {
+				// the root stays pinned through rootPage, read it in place
+				next = childFor((const NonLeafNodeInt*) rootPage.get(), key, isLeaf);
+			} else {
+				// inner nodes are passed by every lookup: read them without a pin,
+				// pinning only if a writer got in the way
+				if ((std::size_t) currDepth >= innerFrames.size())
+					innerFrames.resize(currDepth + 1, 0);
+				bool childIsLeaf = false;
+				if (bufMgr->readOptimistic(file, pageNo, innerFrames[currDepth],
+						[&](const Page& node) { next = childFor((const NonLeafNodeInt*) &node, key, childIsLeaf); },
+						HOT_INDEX_INTERNAL)) {
+					isLeaf = childIsLeaf;
+				} else {
+					PageHandle inner = bufMgr->fetchPage(file, pageNo, NULL, HOT_INDEX_INTERNAL);
+					next = childFor((const NonLeafNodeInt*) inner.get(), key, isLeaf);
+				}
+			}
 
 			// Update to new page id
-			pageNo = currNode->pageNoArray[insertAt];
-
-			// Unpin old page (not modified)
-			bufMgr->unPinPage(file, old, false);
-			
-			// Load the next page into the buffer pool
-			bufMgr->readPage(file, pageNo, page);
+			pageNo = next;
 
 			// We have moved one level down the tree
 			currDepth++;
 		}
+
+		// Only the leaf is pinned for the caller
+		page = bufMgr->fetchPage(file, pageNo);
+	}
+
+	PageId BTreeIndex::childFor(const NonLeafNodeInt* node, int key, bool& childIsLeaf){
+		// Will the next node be a leaf?
+		childIsLeaf = node->level;
+
+		// Determine where to traverse to next
+		const int numKeys = std::max(0, std::min(node->numValidKeys, INTARRAYNONLEAFSIZE));
+		int insertAt = 0;
+		while (insertAt < numKeys && key >= node->keyArray[insertAt]) insertAt++;
+		return node->pageNoArray[insertAt];
 	}
 
 	/**
@@ -443,11 +446,63 @@ namespace badgerdb
 	 * @param currDepth current depth in tree (root is 0)
 	 * @param isLeaf are we at a leaf (does nothing in this case)
 	 */
-	void BTreeIndex::findLeafFromRoot(PageId& pageNo, Page*& page, int key){
+	void BTreeIndex::findLeafFromRoot(PageId& pageNo, PageHandle& page, int key){
 		int dummy = 0;
 		findLeaf(pageNo = rootPageNum,page,key,dummy,!nodeOccupancy);
 	}
 
+	// -----------------------------------------------------------------------------
+	// BTreeIndex::lookupAsync
+	// -----------------------------------------------------------------------------
+	void BTreeIndex::lookupAsync(const void* key, AsyncExecutor& executor, LookupCallback done){
+		lookupFrom(rootPageNum, !nodeOccupancy, *((int*)key), 0, executor, done);
+	}
+
+	void BTreeIndex::lookupFrom(PageId pageNo, bool isLeaf, int key, int depth, AsyncExecutor& executor, LookupCallback done){
+		// pass the inner nodes that are in the pool without waiting for anything
+		while (!isLeaf) {
+			PageId next = Page::INVALID_NUMBER;
+			bool childIsLeaf = false;
+			if (pageNo == rootPageNum && rootPage.get() != NULL) {
+				next = childFor((const NonLeafNodeInt*) rootPage.get(), key, childIsLeaf);
+			} else {
+				if ((std::size_t) depth >= innerFrames.size())
+					innerFrames.resize(depth + 1, 0);
+				if (!bufMgr->readOptimistic(file, pageNo, innerFrames[depth],
+						[&](const Page& node) { next = childFor((const NonLeafNodeInt*) &node, key, childIsLeaf); },
+						HOT_INDEX_INTERNAL))
+					break;
+			}
+			pageNo = next;
+			isLeaf = childIsLeaf;
+			depth++;
+		}
+
+		// the rest of the lookup runs once this node has been read
+		bufMgr->readPageAsync(file, pageNo, executor,
+				[this, isLeaf, key, depth, &executor, done](PageHandle& page, std::exception_ptr error) {
+			if (error) {
+				done(false, RecordId(), error);
+				return;
+			}
+			if (!isLeaf) {
+				bool childIsLeaf = false;
+				const PageId child = childFor((const NonLeafNodeInt*) page.get(), key, childIsLeaf);
+				page.release();
+				lookupFrom(child, childIsLeaf, key, depth + 1, executor, done);
+				return;
+			}
+			const LeafNodeInt* leaf = (const LeafNodeInt*) page.get();
+			for (int i = 0; i < leaf->numValidKeys; i++) {
+				if (leaf->keyArray[i] == key) {
+					done(true, leaf->ridArray[i], std::exception_ptr());
+					return;
+				}
+			}
+			done(false, RecordId(), std::exception_ptr());
+		}, NULL, isLeaf ? NORMAL : HOT_INDEX_INTERNAL);
+	}
+
 	/**
 	 * @brief Traverse the tree until we get to a 
 	 * node which has a the target page id
@@ -462,19 +517,17 @@ namespace badgerdb
 		if(target==rootPageNum) return target; //root case
 		
 		// Current node
-		Page* page;
 		PageId id = rootPageNum; // Start at root
 
 		// Find a key to look for
-		bufMgr->readPage(file, target, page);
-		int key = ((NonLeafNodeInt*)page)->keyArray[0];
-		bufMgr->unPinPage(file, target, false);
+		PageHandle page = bufMgr->fetchPage(file, target);
+		int key = ((NonLeafNodeInt*)page.get())->keyArray[0];
 
-		// Read root
-		bufMgr->readPage(file, id, page);
+		// Read root, every node on the way down is an inner node
+		page = bufMgr->fetchPage(file, id, NULL, HOT_INDEX_INTERNAL);
 		while (true) { 
 			// By assumption, we are at an internal node
-			NonLeafNodeInt* currNode = (NonLeafNodeInt*) page;
+			NonLeafNodeInt* currNode = (NonLeafNodeInt*) page.get();
 
 			// Determine where to traverse to next
 			int index=0;
@@ -484,23 +537,14 @@ namespace badgerdb
 			// Check if we have found the target page
 			if(currNode->pageNoArray[index] == target) break;
 
-			// used for unpinning
-			PageId old = id;
-
 			// Update to new page id
 			id = currNode->pageNoArray[index];
 
-			// Unpin old page (not modified)
-			bufMgr->unPinPage(file, old, false);
-			
-			// Load the next page into the buffer pool
-			bufMgr->readPage(file, id, page);
+			// Load the next page into the buffer pool, which unpins the old page (not modified)
+			page = bufMgr->fetchPage(file, id, NULL, HOT_INDEX_INTERNAL);
 		}
 
-		// Unpin current
-		bufMgr->unPinPage(file, id, false);
-
-		// return parent id
+		// return parent id, the handle unpins it
 		return id;
 	}
 
@@ -513,7 +557,7 @@ namespace badgerdb
 	 * @param isLeaf is the node a leaf?
 	 * @return int position of location
 	 */
-	int BTreeIndex::findIndex(PageId& pageNo, Page*& page, int key, bool isLeaf){
+	int BTreeIndex::findIndex(PageId& pageNo, Page* page, int key, bool isLeaf){
 		int index=0;	
 		
 		if (isLeaf) {
@@ -543,7 +587,7 @@ namespace badgerdb
 	 * @param index position of
 	 * @param isLeaf is the node a leaf
 	 */
-	void BTreeIndex::shiftData(PageId& pageNo, Page*& page, int index, bool isLeaf){
+	void BTreeIndex::shiftData(PageId& pageNo, Page* page, int index, bool isLeaf){
 		if(isLeaf){
 			// cast to node type
 			LeafNodeInt* node = (LeafNodeInt*) page;
@@ -637,10 +681,11 @@ namespace badgerdb
 		highOp = highOpParm;
 
 		// Sets page data and id to starting leaf page
-		findLeafFromRoot(currentPageNum, currentPageData, lowValInt);
+		findLeafFromRoot(currentPageNum, currentPage, lowValInt);
+		prefetchRightSibling(currentPage.get());
 
 		// cast to leaf node
-		LeafNodeInt* currentNode = (LeafNodeInt*) currentPageData;
+		LeafNodeInt* currentNode = (LeafNodeInt*) currentPage.get();
 		
 		//check if the key satisfies the range
 		while(true){
@@ -664,12 +709,11 @@ namespace badgerdb
 			// Check if this is the last leaf
 			if(!nextPageId) throw NoSuchKeyFoundException();
 
-			// Unpin old page
-			bufMgr->unPinPage(file, currentPageNum, false);
-
-			//change currently scaning page to the next page
+			//change currently scaning page to the next page, unpinning the old page
 			currentPageNum=nextPageId;
-			bufMgr->readPage(file, currentPageNum, currentPageData);
+			currentPage = bufMgr->fetchPage(file, currentPageNum);
+			currentNode = (LeafNodeInt*) currentPage.get();
+			prefetchRightSibling(currentPage.get());
 		}
 	}
 	
@@ -682,6 +726,11 @@ namespace badgerdb
 	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
 	**/
 	void BTreeIndex::scanNext(RecordId &outRid)
+	{
+		if (!tryScanNext(outRid)) throw IndexScanCompletedException();
+	}
+
+	bool BTreeIndex::tryScanNext(RecordId &outRid)
 	{
 		// throw this if no scan is initialized
 		if(!scanExecuting){
@@ -689,21 +738,21 @@ namespace badgerdb
 		}
 		
 		// fetch the record id for the index that satisfies the scan 
-		LeafNodeInt* currentNode = (LeafNodeInt*) currentPageData;
+		LeafNodeInt* currentNode = (LeafNodeInt*) currentPage.get();
 
 		// move to the next pageif needed
 		if(nextEntry >= currentNode->numValidKeys ){ 
 
 			// check if we are at the end of the tree
-			if (!currentNode->rightSibPageNo) throw IndexScanCompletedException(); 
+			if (!currentNode->rightSibPageNo) return false; 
 			
 			//change currently scaning page to the next page
 			PageId nextPageId =currentNode->rightSibPageNo;
-			bufMgr->unPinPage(file, currentPageNum, false);
 			currentPageNum=nextPageId;
-			bufMgr->readPage(file, currentPageNum, currentPageData);
+			currentPage = bufMgr->fetchPage(file, currentPageNum);
 			nextEntry = 0;
-			currentNode = (LeafNodeInt*) currentPageData;
+			currentNode = (LeafNodeInt*) currentPage.get();
+			prefetchRightSibling(currentPage.get());
 		}
 		
 		// set return value
@@ -715,13 +764,21 @@ namespace badgerdb
 		// key value is out of range, or reaches the upper boundary
 		if(keyValue > highValInt 
 				|| (keyValue == highValInt && highOp == LT)) 
-			throw IndexScanCompletedException(); // end scan handles unpinning
+			return false; // end scan handles unpinning
 
 		// increase next entry
 		nextEntry++;
+		return true;
 	}
 
 
+	void BTreeIndex::prefetchRightSibling(Page* page)
+	{
+		// siblings further right are only known once this one is read
+		PageId sibling = ((LeafNodeInt*) page)->rightSibPageNo;
+		if (sibling) bufMgr->prefetchPages(file, std::vector<PageId>(1, sibling));
+	}
+
 	/**
   	 *@brief This method terminates the current scan and unpins all the pages that have been pinned for the purpose of the scan.
      *@throws ScanNotInitializedException when called before a successful startScan call.
@@ -732,7 +789,7 @@ namespace badgerdb
 			throw ScanNotInitializedException(); 
 		}
 		scanExecuting = false;
-		bufMgr->unPinPage(file, currentPageNum, false);
+		currentPage.release();
 		
 	}
 
@@ -745,15 +802,15 @@ namespace badgerdb
 // // Add new element to correct sibiling
 		// if (currKey < secondLeafNode->keyArray[0]) {
 		// 	// Insert into the left leaf node
-		// 	int insertAt = findIndex(currId, currPage, currKey, true);
-		// 	shiftData(currId, currPage, insertAt, true);
+		// 	int insertAt = findIndex(currId, currPage.get(), currKey, true);
+		// 	shiftData(currId, currPage.get(), insertAt, true);
 		// 	leafNode->keyArray[insertAt] = currKey;
 		// 	leafNode->ridArray[insertAt+1] = rid;
 		// 	leafNode->numValidKeys++;
 		// } else {
 		// 	// Insert into the right leaf node
-		// 	int insertAt = findIndex(secondPageId, secondPage, currKey, true);
-		// 	shiftData(secondPageId, secondPage, insertAt, true);
+		// 	int insertAt = findIndex(secondPageId, secondPage.get(), currKey, true);
+		// 	shiftData(secondPageId, secondPage.get(), insertAt, true);
 		// 	secondLeafNode->keyArray[insertAt] = currKey;
 		// 	secondLeafNode->ridArray[insertAt+1] = rid;
 		// 	secondLeafNode->numValidKeys++;
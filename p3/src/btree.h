@@ -7,8 +7,11 @@
 
 #pragma once
 
+#include <exception>
+#include <functional>
 #include <iostream>
 #include <string>
+#include <vector>
 #include "string.h"
 #include <sstream>
 
@@ -201,6 +204,14 @@ struct LeafNodeInt{
   };
 
 
+/**
+ * @brief Continuation of BTreeIndex::lookupAsync(). Gets whether the key was
+ * found and the record id of its first entry, or the error the lookup failed
+ * with.
+*/
+typedef std::function<void(bool found, const RecordId& rid, std::exception_ptr error)> LookupCallback;
+
+
 /**
  * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
  * relation. This index supports only one scan at a time.
@@ -229,6 +240,17 @@ class BTreeIndex {
    */
 	PageId	rootPageNum;
 
+  /**
+   * The root page, kept pinned for as long as the index is open.
+   */
+	PageHandle	rootPage;
+
+  /**
+   * Frame each level of inner nodes below the root was last found in, tried
+   * first by the optimistic reads in findLeaf().
+   */
+	std::vector<FrameId>	innerFrames;
+
   /**
    * Datatype of attribute over which index is built.
    */
@@ -267,9 +289,9 @@ class BTreeIndex {
 	PageId	currentPageNum;
 
   /**
-   * Current Page being scanned.
+   * Current Page being scanned, pinned while the scan is on it.
    */
-	Page		*currentPageData;
+	PageHandle	currentPage;
 
   /**
    * Low INTEGER value for scan.
@@ -320,7 +342,18 @@ class BTreeIndex {
    * @param currDepth current depth in tree (root is 0)
    * @param isLeaf are we at a leaf (does nothing in this case)
    */
-  void findLeaf(PageId& pageNo, Page*& page, int key, int& currDepth, bool isLeaf);
+  void findLeaf(PageId& pageNo, PageHandle& page, int key, int& currDepth, bool isLeaf);
+
+  /**
+   * @brief Find the child of an inner node to descend to for key. The node
+   * may be a torn copy read optimistically, so its key count is clamped.
+   * 
+   * @param node inner node
+   * @param key key to search for
+   * @param childIsLeaf set to whether the child is a leaf
+   * @return page number of the child
+   */
+  static PageId childFor(const NonLeafNodeInt* node, int key, bool& childIsLeaf);
 
   /**
    * @brief From the root, find the leaf node page that holds key
@@ -329,7 +362,7 @@ class BTreeIndex {
    * @param page overwrites passed page with target page
    * @param key key to search for
    */
-  void findLeafFromRoot(PageId& pageNo, Page*& page, int key);
+  void findLeafFromRoot(PageId& pageNo, PageHandle& page, int key);
 
   /**
 	 * @brief Find the non-leaf node page that is the parent of the given root
@@ -352,7 +385,7 @@ class BTreeIndex {
    * @param isLeaf is the node a leaf?
    * @return int position of location
    */
-  int findIndex(PageId& pageNo, Page*& page, int key, bool isLeaf);
+  int findIndex(PageId& pageNo, Page* page, int key, bool isLeaf);
 
   /**
    * @brief traverse the array shifting elements 1 to the right 
@@ -363,7 +396,7 @@ class BTreeIndex {
    * @param index position of
    * @param isLeaf is the node a leaf
    */
-  void shiftData(PageId& pageNo, Page*& page, int index, bool isLeaf);
+  void shiftData(PageId& pageNo, Page* page, int index, bool isLeaf);
 
   /**
 	 * @brief prints out the keys and page ids in the provided node
@@ -373,6 +406,29 @@ class BTreeIndex {
 	 * @param isLeaf is this internal or leaf?
 	 */
   void printNode(PageId pageNo, Page* page, bool isLeaf);
+
+  /**
+   * @brief start reading the right sibling of the leaf being scanned in the
+   * background, so it is in the buffer pool by the time the scan gets to it
+   * 
+   * @param page leaf being scanned
+   */
+  void prefetchRightSibling(Page* page);
+
+  /**
+   * @brief Continue an asynchronous lookup at the given node. Inner nodes
+   * that can be read optimistically are passed at once; the first node that
+   * has to be read is read asynchronously and the lookup goes on in its
+   * continuation.
+   * 
+   * @param pageNo node to continue at
+   * @param isLeaf is the node a leaf
+   * @param key key to search for
+   * @param depth depth of the node in the tree (root is 0)
+   * @param executor executor the lookup runs on
+   * @param done continuation of the lookup
+   */
+  void lookupFrom(PageId pageNo, bool isLeaf, int key, int depth, AsyncExecutor& executor, LookupCallback done);
 	
  public:
 
@@ -441,6 +497,29 @@ class BTreeIndex {
 	void scanNext(RecordId& outRid);  // returned record id
 
 
+  /**
+	 * Same as scanNext, but reports the end of the scan through its return value
+	 * instead of an exception, so scan loops do not pay for a throw.
+   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+	 * @return True if a record was found, false if the scan is completed
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	bool tryScanNext(RecordId& outRid);
+
+
+  /**
+	 * Look a key up without waiting for the pages on the way to be read, so
+	 * that one thread can have many lookups in flight. The lookup continues on
+	 * the thread driving executor as the pages it needs arrive, and ends by
+	 * calling done there. The index must not be modified while lookups are
+	 * outstanding.
+   * @param key			Key to look up, pointer to integer
+   * @param executor	Executor the lookup runs on, see AsyncExecutor::run()
+   * @param done		Continuation, gets the record id of the first entry with the key
+	**/
+	void lookupAsync(const void* key, AsyncExecutor& executor, LookupCallback done);
+
+
   /**
 	 * Terminate the current scan. Unpin any pinned pages. Reset scan specific variables.
 	 * @throws ScanNotInitializedException If no scan has been initialized.
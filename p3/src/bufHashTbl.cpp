@@ -11,104 +11,173 @@
 #include "bufHashTbl.h"
 #include "exceptions/hash_already_present_exception.h"
 #include "exceptions/hash_not_found_exception.h"
-#include "exceptions/hash_table_exception.h"
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
+std::uint64_t BufHashTbl::hash(const File* file, const PageId pageNo)
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+  // combine both halves of the key, then run the splitmix64 finalizer so that
+  // every input bit affects the partition bits as well as the slot bits
+  std::uint64_t h = reinterpret_cast<std::uintptr_t>(file);
+  h ^= (static_cast<std::uint64_t>(pageNo) + 1) * 0x9e3779b97f4a7c15ULL;
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
 }
 
-BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
+std::uint32_t BufHashTbl::partitionSize(const std::uint32_t numEntries)
 {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  // leave every partition at most half full on average
+  std::uint32_t perPartition = 2 * numEntries / NUM_PARTITIONS + 1;
+  std::uint32_t slots = 8;
+  while (slots < perPartition)
+    slots *= 2;
+  return slots;
+}
+
+BufHashTbl::BufHashTbl(const std::uint32_t numEntries)
+{
+  const std::uint32_t slots = partitionSize(numEntries);
+
+  partitions = new hashPartition[NUM_PARTITIONS];
+  for (int i = 0; i < NUM_PARTITIONS; i++)
+  {
+    partitions[i].slots = new hashBucket[slots]();
+    partitions[i].mask = slots - 1;
+    partitions[i].count = 0;
+  }
 }
 
 BufHashTbl::~BufHashTbl()
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
+  for (int i = 0; i < NUM_PARTITIONS; i++)
+    delete [] partitions[i].slots;
+  delete [] partitions;
+}
+
+std::mutex& BufHashTbl::partitionLatch(const File* file, const PageId pageNo)
+{
+  return partitionOf(hash(file, pageNo)).latch;
+}
+
+void BufHashTbl::resize(const std::uint32_t numEntries)
+{
+  const std::uint32_t slots = partitionSize(numEntries);
+  for (int i = 0; i < NUM_PARTITIONS; i++)
+  {
+    std::uint32_t size = slots;
+    while (4 * partitions[i].count > 3 * size)
+      size *= 2;
+    if (size != partitions[i].mask + 1)
+      rehash(partitions[i], size);
+  }
+}
+
+void BufHashTbl::rehash(hashPartition& part, const std::uint32_t slots)
+{
+  hashBucket* oldSlots = part.slots;
+  const std::uint32_t oldSize = part.mask + 1;
+
+  part.slots = new hashBucket[slots]();
+  part.mask = slots - 1;
+  for (std::uint32_t i = 0; i < oldSize; i++)
+  {
+    if (oldSlots[i].file == NULL)
+      continue;
+    std::uint32_t index = hash(oldSlots[i].file, oldSlots[i].pageNo) & part.mask;
+    while (part.slots[index].file != NULL)
+      index = (index + 1) & part.mask;
+    part.slots[index] = oldSlots[i];
   }
-  delete [] ht;
+  delete [] oldSlots;
 }
 
 void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
 {
-  int index = hash(file, pageNo);
+  const std::uint64_t h = hash(file, pageNo);
+  hashPartition& part = partitionOf(h);
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
+  // keep the load factor at or below 3/4
+  if (4 * (part.count + 1) > 3 * (part.mask + 1))
+    rehash(part, 2 * (part.mask + 1));
+
+  std::uint32_t index = h & part.mask;
+  while (part.slots[index].file != NULL)
+  {
+    hashBucket* tmpBuc = &part.slots[index];
     if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
   		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+    index = (index + 1) & part.mask;
   }
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-  	throw HashTableException();
-
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+  part.slots[index].file = (File*) file;
+  part.slots[index].pageNo = pageNo;
+  part.slots[index].frameNo = frameNo;
+  part.count++;
 }
 
 void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
 {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+  if (!tryLookup(file, pageNo, frameNo))
+    throw HashNotFoundException(file->filename(), pageNo);
+}
+
+bool BufHashTbl::tryLookup(const File* file, const PageId pageNo, FrameId &frameNo) 
+{
+  const std::uint64_t h = hash(file, pageNo);
+  hashPartition& part = partitionOf(h);
+
+  for (std::uint32_t index = h & part.mask; part.slots[index].file != NULL;
+       index = (index + 1) & part.mask)
+  {
+    if (part.slots[index].file == file && part.slots[index].pageNo == pageNo)
     {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
+      frameNo = part.slots[index].frameNo; // return frameNo by reference
+      return true;
     }
-    tmpBuc = tmpBuc->next;
   }
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  return false;
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
+  const std::uint64_t h = hash(file, pageNo);
+  hashPartition& part = partitionOf(h);
+
+  std::uint32_t index = h & part.mask;
+  while (true)
+  {
+    if (part.slots[index].file == NULL)
+      throw HashNotFoundException(file->filename(), pageNo);
+    if (part.slots[index].file == file && part.slots[index].pageNo == pageNo)
+      break;
+    index = (index + 1) & part.mask;
+  }
 
-  while (tmpBuc)
-	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
-
-      delete tmpBuc;
-      return;
-    }
-		else
-		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
+  // Shift later entries of the probe run back into the hole, so lookups never
+  // stop early at an empty slot that used to hold this entry.
+  std::uint32_t hole = index;
+  for (std::uint32_t next = (hole + 1) & part.mask; part.slots[next].file != NULL;
+       next = (next + 1) & part.mask)
+  {
+    const std::uint32_t home = hash(part.slots[next].file, part.slots[next].pageNo) & part.mask;
+    // the entry can move into the hole unless its home slot lies cyclically
+    // in (hole, next]
+    const bool homeBetween = (hole <= next) ? (hole < home && home <= next)
+                                            : (hole < home || home <= next);
+    if (!homeBetween)
+    {
+      part.slots[hole] = part.slots[next];
+      hole = next;
     }
   }
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  part.slots[hole].file = NULL;
+  part.count--;
 }
 
 }
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <cstdint>
+#include <mutex>
 #include "file.h"
 
 namespace badgerdb {
@@ -16,7 +18,7 @@ namespace badgerdb {
 */
 struct hashBucket {
 	/**
-	 * pointer a file object (more on this below)
+	 * pointer a file object (more on this below). NULL if the slot is empty.
 	 */
 	File *file;
 
@@ -29,50 +31,150 @@ struct hashBucket {
 	 * frame number of page in the buffer pool
 	 */
 	FrameId frameNo;
+};
 
+/**
+* @brief One independently latched part of the hash table. An open addressing
+* table with linear probing, whose size is a power of two.
+*/
+struct hashPartition {
 	/**
-	 * Next node in the hash table
+	 * Latch guarding this partition
 	 */
-	hashBucket*   next;
+	std::mutex latch;
+
+	/**
+	 * Slot array of the partition
+	 */
+	hashBucket* slots;
+
+	/**
+	 * Number of slots minus one
+	 */
+	std::uint32_t mask;
+
+	/**
+	 * Number of slots in use
+	 */
+	std::uint32_t count;
 };
 
 
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
-* @warning This class is not threadsafe.
+* The table is split into NUM_PARTITIONS partitions, each guarded by its own
+* latch.  insert(), lookup() and remove() do not latch anything themselves:
+* the caller must hold partitionLatch(file, pageNo) for the entry it touches,
+* which lets the buffer manager keep the latch across a lookup and the pin
+* that follows it.
+*
+* Each partition is a flat array of slots using linear probing, and removal
+* shifts the following entries back instead of leaving tombstones.  The slots
+* are allocated up front for the number of entries given to the constructor,
+* so inserting and removing never allocate memory as long as the hash spreads
+* the entries evenly over the partitions.
 */
 class BufHashTbl
 {
+ public:
+	/**
+	 * Number of independently latched partitions of the table
+	 */
+	static const int NUM_PARTITIONS = 64;
+
  private:
 	/**
-	 *	Size of Hash Table
+	 * Number of high hash bits that select the partition
 	 */
-  int HTSIZE;
+	static const int PARTITION_BITS = 6;
+
 	/**
-	 * Actual Hash table object
+	 * The partitions of the table
 	 */
-  hashBucket**  ht;
+  hashPartition* partitions;
 
 	/**
-	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+	 * returns a 64 bit hash of file and pageNo. The top PARTITION_BITS bits
+	 * select the partition and the low bits the home slot within it.
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
 	 * @return  			Hash value.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  static std::uint64_t hash(const File* file, const PageId pageNo);
+
+	/**
+	 * returns the partition an entry with the given hash belongs to
+	 *
+	 * @param h   	Hash value of the entry
+	 * @return  		Partition.
+	 */
+  hashPartition& partitionOf(const std::uint64_t h)
+  {
+    return partitions[h >> (64 - PARTITION_BITS)];
+  }
+
+	/**
+	 * Returns the number of slots a partition starts with for a table expected
+	 * to hold numEntries entries.
+	 *
+	 * @param numEntries  Number of entries the table is expected to hold
+	 * @return  			Number of slots, a power of two.
+	 */
+  static std::uint32_t partitionSize(const std::uint32_t numEntries);
+
+	/**
+	 * Moves the entries of a partition into a new slot array of the given size.
+	 * Used to double partitions that got too full and by resize().
+	 *
+	 * @param part   	Partition to rebuild
+	 * @param slots  	New number of slots, a power of two larger than the number of entries
+	 */
+  void rehash(hashPartition& part, const std::uint32_t slots);
 
  public:
 	/**
    * Constructor of BufHashTbl class
+	 *
+	 * @param numEntries  Number of entries the table is expected to hold
 	 */
-	BufHashTbl(const int htSize);  // constructor
+	BufHashTbl(const std::uint32_t numEntries);  // constructor
 
 	/**
    * Destructor of BufHashTbl class
 	 */
   ~BufHashTbl(); // destructor
+
+	/**
+   * Returns the latch guarding the partition that (file, pageNo) hashes to.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			Partition latch
+	 */
+  std::mutex& partitionLatch(const File* file, const PageId pageNo);
+
+	/**
+   * Returns the latch of the given partition, so that a caller can hold all of
+	 * them at once. They must then be taken in partition order.
+	 *
+	 * @param partition  Partition number, below NUM_PARTITIONS
+	 * @return  			Partition latch
+	 */
+  std::mutex& partitionLatch(const int partition)
+  {
+    return partitions[partition].latch;
+  }
+
+	/**
+   * Resizes the partitions for a new expected number of entries, as if the
+	 * table had been constructed with it, but never so small that a partition
+	 * would be more than 3/4 full. The caller must hold every partition latch.
+	 *
+	 * @param numEntries  Number of entries the table is expected to hold
+	 */
+  void resize(const std::uint32_t numEntries);
 	
 	/**
    * Insert entry into hash table mapping (file, pageNo) to frameNo.
@@ -81,7 +183,6 @@ class BufHashTbl
 	 * @param pageNo 	Page number in the file
 	 * @param frameNo Frame number assigned to that page of the file
    * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as running of memory
 	 */
   void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
@@ -96,6 +197,17 @@ class BufHashTbl
 	 */
   void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
 
+	/**
+   * Check if (file, pageNo) is currently in the buffer pool (ie. in
+   * the hash table), without throwing if it is not.
+	 *
+	 * @param file  	File object
+	 * @param pageNo	Page number in the file
+	 * @param frameNo Frame number reference, only set if the entry is found
+	 * @return  			True if the page entry is in the hash table
+	 */
+  bool tryLookup(const File* file, const PageId pageNo, FrameId &frameNo);
+
 	/**
    * Delete entry (file,pageNo) from hash table.
 	 *
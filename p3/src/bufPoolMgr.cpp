@@ -0,0 +1,155 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <sstream>
+#include "bufPoolMgr.h"
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/pool_not_found_exception.h"
+
+namespace badgerdb {
+
+BufPoolMgr::BufPoolMgr(const std::uint32_t maxFrames)
+	: maxFrames(maxFrames), usedFrames(0)
+{
+}
+
+BufPoolMgr::~BufPoolMgr()
+{
+  for (std::map<std::string, Pool>::iterator it = pools.begin(); it != pools.end(); ++it)
+    delete it->second.bufMgr;
+}
+
+BufPoolMgr::Pool& BufPoolMgr::findPool(const std::string& name)
+{
+  std::map<std::string, Pool>::iterator it = pools.find(name);
+  if (it == pools.end())
+    throw PoolNotFoundException(name);
+  return it->second;
+}
+
+BufPoolMgr::Pool& BufPoolMgr::routeFile(const File* file)
+{
+  std::map<const File*, std::string>::iterator fileIt = fileRoles.find(file);
+  if (fileIt != fileRoles.end())
+  {
+    std::map<std::string, std::string>::iterator roleIt = roles.find(fileIt->second);
+    if (roleIt != roles.end())
+      return findPool(roleIt->second);
+  }
+  return findPool(defaultPool);
+}
+
+BufMgr* BufPoolMgr::addPool(const std::string& name, const std::uint32_t frames, ReplacementPolicyType policyType)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (pools.count(name) > 0)
+    return pools[name].bufMgr;
+  if (frames > maxFrames - usedFrames)
+    throw BufferExceededException();
+
+  Pool newPool;
+  newPool.frames = frames;
+  newPool.bufMgr = new BufMgr(frames, policyType);
+  pools[name] = newPool;
+  usedFrames += frames;
+  roles.insert(std::make_pair(name, name));
+  if (defaultPool.empty())
+    defaultPool = name;
+  return newPool.bufMgr;
+}
+
+BufMgr* BufPoolMgr::pool(const std::string& name)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  return findPool(name).bufMgr;
+}
+
+void BufPoolMgr::resizePool(const std::string& name, const std::uint32_t frames)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  Pool& target = findPool(name);
+  if (frames > target.frames && frames - target.frames > maxFrames - usedFrames)
+    throw BufferExceededException();
+
+  // may throw if pages in the dropped frames are pinned, the quota is
+  // only updated once the pool has changed size
+  target.bufMgr->resize(frames);
+  usedFrames = usedFrames - target.frames + frames;
+  target.frames = frames;
+}
+
+void BufPoolMgr::routeRole(const std::string& role, const std::string& name)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  findPool(name);
+  roles[role] = name;
+}
+
+void BufPoolMgr::assignFile(const File* file, const std::string& role)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  std::map<const File*, std::string>::iterator fileIt = fileRoles.find(file);
+  if (fileIt != fileRoles.end() && !pools.empty())
+  {
+    BufMgr* oldPool = routeFile(file).bufMgr;
+    std::map<std::string, std::string>::iterator roleIt = roles.find(role);
+    BufMgr* newPool = findPool(roleIt != roles.end() ? roleIt->second : defaultPool).bufMgr;
+    if (oldPool != newPool)
+      oldPool->flushFile(file);
+  }
+  fileRoles[file] = role;
+}
+
+void BufPoolMgr::removeFile(const File* file)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (!pools.empty())
+    routeFile(file).bufMgr->flushFile(file);
+  fileRoles.erase(file);
+}
+
+BufMgr* BufPoolMgr::poolFor(const File* file)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  return routeFile(file).bufMgr;
+}
+
+std::vector<std::string> BufPoolMgr::poolNames()
+{
+  std::lock_guard<std::mutex> guard(latch);
+  std::vector<std::string> names;
+  for (std::map<std::string, Pool>::iterator it = pools.begin(); it != pools.end(); ++it)
+    names.push_back(it->first);
+  return names;
+}
+
+std::uint32_t BufPoolMgr::framesInUse()
+{
+  std::lock_guard<std::mutex> guard(latch);
+  return usedFrames;
+}
+
+std::string BufPoolMgr::statsSnapshot(const bool json)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  std::ostringstream out;
+  if (json)
+    out << "{";
+  for (std::map<std::string, Pool>::iterator it = pools.begin(); it != pools.end(); ++it)
+  {
+    // pool names are chosen by the caller and not escaped
+    if (json)
+      out << (it != pools.begin() ? "," : "") << "\"" << it->first << "\":" << it->second.bufMgr->statsSnapshot(true);
+    else
+      out << "pool " << it->first << " (" << it->second.frames << " frames)\n" << it->second.bufMgr->statsSnapshot();
+  }
+  if (json)
+    out << "}";
+  return out.str();
+}
+
+}
@@ -0,0 +1,194 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "buffer.h"
+#include "file.h"
+#include "replacer.h"
+
+namespace badgerdb {
+
+/**
+* @brief Hosts several named buffer pools, each a BufMgr with its own frames
+* and replacement policy, within one overall frame quota.
+*
+* Files are routed to pools by role: every role ("index", "heap", "temp", ...)
+* is mapped to a pool, and every file is given a role. Keeping index files and
+* heap relations in different pools stops a large scan of a relation from
+* evicting the index pages lookups depend on, and lets each pool be sized and
+* given a policy for its own access pattern.
+*
+* The pools are ordinary BufMgr objects; callers look up the pool of a file
+* once and use it directly, so routing adds nothing to the page access path.
+* A file's pages must only ever be read through the pool it is routed to.
+*/
+class BufPoolMgr
+{
+ private:
+	/**
+   * Frames a pool was given, and the pool
+	 */
+  struct Pool
+  {
+    std::uint32_t frames;
+    BufMgr* bufMgr;
+  };
+
+	/**
+   * Maximum number of frames over all pools
+	 */
+  const std::uint32_t maxFrames;
+
+	/**
+   * Number of frames given to pools so far
+	 */
+  std::uint32_t usedFrames;
+
+	/**
+   * Pools by name
+	 */
+  std::map<std::string, Pool> pools;
+
+	/**
+   * Pool of each role, and role of each file
+	 */
+  std::map<std::string, std::string> roles;
+  std::map<const File*, std::string> fileRoles;
+
+	/**
+   * Pool files of roles not routed anywhere go to, the first pool added
+	 */
+  std::string defaultPool;
+
+	/**
+   * Guards all of the above. Not taken by the pools themselves.
+	 */
+  std::mutex latch;
+
+	/**
+   * Pool of the given name, latch must be held
+	 *
+	 * @throws  PoolNotFoundException If there is no pool of that name
+	 */
+  Pool& findPool(const std::string& name);
+
+	/**
+   * Pool the given file is routed to, latch must be held
+	 *
+	 * @throws  PoolNotFoundException If no pool was added yet
+	 */
+  Pool& routeFile(const File* file);
+
+ public:
+	/**
+   * Constructor of BufPoolMgr class
+	 *
+	 * @param maxFrames   Number of frames all pools together may use
+	 */
+  BufPoolMgr(const std::uint32_t maxFrames);
+
+	/**
+   * Destructor of BufPoolMgr class, deletes the pools (writing back their
+	 * dirty pages)
+	 */
+  ~BufPoolMgr();
+
+	/**
+   * Creates a pool. Its name is also routed to it as a role. If a pool of
+	 * that name exists it is returned unchanged.
+	 *
+	 * @param name   	Name of the pool
+	 * @param frames	Number of frames in the pool
+	 * @param policyType	Page replacement policy of the pool
+	 * @return  			The new pool, owned by the BufPoolMgr
+   * @throws  BufferExceededException If the pools would use more than maxFrames frames
+	 */
+  BufMgr* addPool(const std::string& name, const std::uint32_t frames, ReplacementPolicyType policyType = CLOCK);
+
+	/**
+   * Returns the pool of the given name.
+	 *
+   * @throws  PoolNotFoundException If there is no pool of that name
+	 */
+  BufMgr* pool(const std::string& name);
+
+	/**
+   * Grows or shrinks a pool, see BufMgr::resize().
+	 *
+	 * @param name   	Name of the pool
+	 * @param frames	New number of frames in the pool
+   * @throws  BufferExceededException If the pools would use more than maxFrames frames
+   * @throws  PoolNotFoundException If there is no pool of that name
+	 */
+  void resizePool(const std::string& name, const std::uint32_t frames);
+
+	/**
+   * Routes files of a role to a pool.
+	 *
+	 * @param role   	Role of files
+	 * @param name   	Name of the pool
+   * @throws  PoolNotFoundException If there is no pool of that name
+	 */
+  void routeRole(const std::string& role, const std::string& name);
+
+	/**
+   * Gives a file a role. If the file was already routed to a different pool,
+	 * its pages are flushed from that pool first.
+	 *
+	 * @param file   	File object
+	 * @param role   	Role of the file
+   * @throws  PagePinnedException If a page of the file is pinned in its old pool
+	 */
+  void assignFile(const File* file, const std::string& role);
+
+	/**
+   * Flushes the file from its pool and forgets its role. Call before the file
+	 * is closed.
+	 *
+	 * @param file   	File object
+	 */
+  void removeFile(const File* file);
+
+	/**
+   * Returns the pool the file's role is routed to, or the default pool if the
+	 * file has no role or its role is not routed.
+	 *
+	 * @param file   	File object
+   * @throws  PoolNotFoundException If no pool was added yet
+	 */
+  BufMgr* poolFor(const File* file);
+
+	/**
+   * Returns the names of all pools.
+	 */
+  std::vector<std::string> poolNames();
+
+	/**
+   * Returns the number of frames given to pools and the quota.
+	 */
+  std::uint32_t framesInUse();
+  std::uint32_t frameQuota() const
+  {
+    return maxFrames;
+  }
+
+	/**
+   * Renders BufMgr::statsSnapshot() of every pool, as text or as a JSON
+	 * object keyed by pool name.
+	 *
+	 * @param json  True for JSON
+	 */
+  std::string statsSnapshot(const bool json = false);
+};
+
+}
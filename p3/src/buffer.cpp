@@ -5,14 +5,22 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
 #include <memory>
 #include <iostream>
+#include <sstream>
+#include <tuple>
+#include <vector>
 #include "buffer.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
+#include "exceptions/file_not_found_exception.h"
 
 namespace badgerdb { 
 
@@ -20,9 +28,10 @@ namespace badgerdb {
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
-	bufDescTable = new BufDesc[bufs];
+BufMgr::BufMgr(std::uint32_t bufs, ReplacementPolicyType policyType)
+	: numBufs(bufs), resizes(0), pinnedFrames(0), reservedFrames(0), frameWaiters(0), reservedPinned(0), bgStop(false),
+    ioEngine(NULL), ioEngineType(IO_ENGINE_AUTO), prefetchesInFlight(0), ioStop(false) {
+	bufDescTable.resize(bufs);
 
   for (FrameId i = 0; i < bufs; i++) 
   {
@@ -30,202 +39,1727 @@ BufMgr::BufMgr(std::uint32_t bufs)
   	bufDescTable[i].valid = false;
   }
 
-  bufPool = new Page[bufs];
+  bufPool.resize(bufs);
 
-  int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+  for (int i = 0; i < NUM_READER_SLOTS; i++)
+  {
+    readerSlots[i].active = 0;
+    readerSlots[i].reads = 0;
+  }
 
-  clockHand = bufs - 1;
+  hashTable = new BufHashTbl (bufs);  // allocate the buffer hash table
+
+  policy = ReplacementPolicy::create(policyType, bufs);
 }
 
 
 BufMgr::~BufMgr() {
-  //Flush out all unwritten pages
-  for (std::uint32_t i = 0; i < numBufs; i++) 
+  stopBgWriter();
+
+  // let the I/O threads finish the reads they have been given
   {
-  	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if (tmpbuf->valid == true && tmpbuf->dirty == true)
-		{
-			tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-  	}
+    std::lock_guard<std::mutex> prefetchGuard(prefetchLatch);
+    ioStop = true;
   }
+  prefetchQueued.notify_all();
+  for (std::size_t i = 0; i < ioThreads.size(); i++)
+    ioThreads[i].join();
+
+  //Flush out all unwritten pages, file by file in page order
+  std::vector<FrameId> frames;
+  std::map<const File*, std::map<PageId, FrameId> >::iterator fileIt;
+  for (fileIt = residentFrames.begin(); fileIt != residentFrames.end(); ++fileIt)
+  {
+    std::map<PageId, FrameId>::iterator pageIt;
+    for (pageIt = fileIt->second.begin(); pageIt != fileIt->second.end(); ++pageIt)
+      frames.push_back(pageIt->second);
+  }
+  std::vector<File*> files;
+  writeFrames(frames, true, &files);
+  for (std::size_t i = 0; i < files.size(); i++)
+    files[i]->flush();
 
 	delete hashTable;
-  delete [] bufDescTable;
-  delete [] bufPool;
+	delete policy;
+  delete ioEngine;
 }
 
-void BufMgr::allocBuf(FrameId & frame) 
+void BufMgr::allocBuf(FrameId & frame, const bool wait) 
 {
-  // perform first part of clock algorithm to search for 
-  // open buffer frame
-  // Assumes non-concurrent access to buffer manager
-  std::uint32_t numScanned = 0;
-  bool found = 0;
+  // frames we failed to claim in this call, so the policy moves on to others
+  std::vector<FrameId> skipped;
+  VictimFilter evictable = [this, &skipped](FrameId f) {
+    return bufDescTable[f].pinCnt == 0
+        && std::find(skipped.begin(), skipped.end(), f) == skipped.end();
+  };
 
-  while (numScanned < 2*numBufs)	//Need to scn twice
+  FrameId victim = 0;
+  std::chrono::steady_clock::time_point deadline;
+  bool waited = false;
+  while (true)
   {
-    // advance the clock
-    advanceClock();
-    numScanned++;
+    const std::uint32_t resizesBefore = resizes;
 
-    // if invalid, use frame
-    if (! bufDescTable[clockHand].valid)
+    // with every frame pinned a sweep can only come back empty handed
+    while (pinnedFrames < numBufs && policy->pickVictim(victim, evictable))
     {
-      break;
+      if (claimBuf(victim))
+      {
+        // return new frame number
+        frame = victim;
+        return;
+      }
+      skipped.push_back(victim);
     }
 
-    // is valid, check referenced bit
-    if (! bufDescTable[clockHand].refbit)
+    // a resize() holds every partition latch, so claims made while it ran
+    // failed; wait for it to finish and start over
+    if (resizesBefore % 2 == 0 && resizes == resizesBefore)
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
-      {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        found = true;
+      // a client still within its reservation was promised a frame, so it
+      // waits for one to be unpinned rather than fail
+      BufClient* client = wait ? BufClient::current(this) : NULL;
+      if (client == NULL || client->pinCount >= (int)client->frames)
         break;
+      if (!waited)
+      {
+        deadline = client->timeout == std::chrono::milliseconds::max()
+            ? std::chrono::steady_clock::time_point::max()
+            : std::chrono::steady_clock::now() + client->timeout;
+        waited = true;
       }
+      if (!waitForUnpin(deadline))
+        break;
     }
     else
     {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
+      std::lock_guard<std::mutex> resizeGuard(resizeLatch);
     }
+    skipped.clear();
   }
-  
-  // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+
+  // buffer pool is full
+  throw BufferExceededException();
+} // end allocBuf
+
+bool BufMgr::allocRingBuf(BufferRing & ring, FrameId & frame)
+{
+  BufferRing::ringSlot& slot = ring.slots[ring.next];
+  if (!slot.used)
   {
-    throw BufferExceededException();
+    return false;
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
+
+  if (claimBuf(slot.frameNo, slot.file, slot.pageNo))
+  {
+    frame = slot.frameNo;
+    return true;
+  }
+
+  // someone else is using the frame now, let the ring take another one
+  slot.used = false;
+  return false;
+}
+
+bool BufMgr::claimBuf(const FrameId frame, const File* ringFile, const PageId ringPageNo)
+{
+  BufDesc* tmpbuf = &(bufDescTable[frame]);
+
+  // someone else is working on this frame, move on rather than wait
+  std::unique_lock<std::mutex> frameGuard(tmpbuf->latch, std::try_to_lock);
+  if (!frameGuard.owns_lock())
+  {
+    return false;
+  }
+
+  // dropped by resize() since the policy proposed it
+  if (frame >= numBufs)
+  {
+    return false;
+  }
+
+  // if invalid, use frame
+  if (!tmpbuf->valid)
+  {
+    if (tmpbuf->pinCnt > 0)
+      return false;
+    pinFrame(tmpbuf);
+    return true;
+  }
+
+  if (tmpbuf->pinCnt > 0)
+  {
+    return false;
+  }
+
+  // the ring's page has been evicted and the frame reused for another page
+  if (ringFile != NULL && (tmpbuf->file != ringFile || tmpbuf->pageNo != ringPageNo))
+  {
+    return false;
+  }
+
+  // flush any existing changes to disk while the page is still in the hash
+  // table, so a concurrent reader of this page never reads a stale copy
+  const bool wroteBack = tmpbuf->dirty.exchange(false);
+  if (wroteBack)
+  {
+    try
+    {
+      writeFrame(tmpbuf);
+    }
+    catch(...)
+    {
+      // the change is still only in the pool
+      tmpbuf->dirty = true;
+      throw;
+    }
+  }
+
+  // compressed before taking the partition latch; if the page is pinned or
+  // dirtied meanwhile the checks below give the frame up
+  std::string packed;
+  const bool keep = ringFile == NULL && victimCache.enabled()
+      && CompressedVictimCache::compress(bufPool[frame], packed);
+
+  std::unique_lock<std::mutex> partitionGuard(
+      hashTable->partitionLatch(tmpbuf->file, tmpbuf->pageNo), std::try_to_lock);
+  if (!partitionGuard.owns_lock())
+  {
+    return false;
+  }
+
+  // pinned or dirtied again while we were writing it out
+  if (tmpbuf->pinCnt > 0 || tmpbuf->dirty)
   {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    return false;
   }
 
+  // remove previous entry from hash table
+  hashTable->remove(tmpbuf->file, tmpbuf->pageNo);
+  removeResident(tmpbuf->file, tmpbuf->pageNo);
+  if (ringFile != NULL)
+    policy->pageRemoved(frame);
+  else
+    policy->pageEvicted(frame);
+  if (wroteBack)
+    bufStats.dirtyEvictions++;
+  else
+    bufStats.cleanEvictions++;
+  countFileStat(tmpbuf->file, &FileStats::evictions);
+  retireHits(tmpbuf);
+
+  // stored under the partition latch, so a miss on the page finds it
+  if (keep)
+    victimCache.insert(tmpbuf->file, tmpbuf->pageNo, packed);
+
 	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+  clearFrame(tmpbuf);
+  pinFrame(tmpbuf);
+  return true;
+}
 
-  // return new frame number
-  frame = clockHand;
-} // end allocBuf
+void BufMgr::releaseBuf(const FrameId frame)
+{
+  std::lock_guard<std::mutex> frameGuard(bufDescTable[frame].latch);
+  clearFrame(&bufDescTable[frame]);
+}
+
+bool BufMgr::installPage(File* file, const PageId pageNo, FrameId & frame, const AccessHint hint)
+{
+  std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+  FrameId existing = 0;
+  if (hashTable->tryLookup(file, pageNo, existing))
+  {
+    // another thread got to the page first
+    releaseBuf(frame);
+    pinFrame(&bufDescTable[existing]);
+    policy->pageAccessed(existing, hint);
+    frame = existing;
+    return false;
+  }
 
-	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+  // set up the entry properly
+  {
+    std::lock_guard<std::mutex> frameGuard(bufDescTable[frame].latch);
+    bufDescTable[frame].Set(file, pageNo);
+    bufDescTable[frame].ioInProgress = true;
+  }
+
+  // insert in the hash table
+  hashTable->insert(file, pageNo, frame);
+  addResident(file, pageNo, frame);
+  policy->pageLoaded(frame, file, pageNo, hint);
+  return true;
+}
+
+void BufMgr::finishIo(const FrameId frame)
+{
+  std::vector<ioWaiter> waiters;
+  {
+    std::lock_guard<std::mutex> ioGuard(ioLatch);
+    bufDescTable[frame].ioInProgress = false;
+    std::map<FrameId, std::vector<ioWaiter> >::iterator it = ioWaiters.find(frame);
+    if (it != ioWaiters.end())
+    {
+      waiters.swap(it->second);
+      ioWaiters.erase(it);
+    }
+  }
+  ioDone.notify_all();
+
+  for (std::size_t i = 0; i < waiters.size(); i++)
+    completeRead(waiters[i].file, waiters[i].pageNo, frame, *waiters[i].executor, waiters[i].done,
+                 waiters[i].hint);
+}
+
+void BufMgr::abortIo(File* file, const PageId pageNo, const FrameId frame)
+{
+  {
+    std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+    hashTable->remove(file, pageNo);
+    removeResident(file, pageNo);
+    policy->pageRemoved(frame);
+
+    // threads waiting for the read keep their pins until they see it failed
+    std::lock_guard<std::mutex> frameGuard(bufDescTable[frame].latch);
+    int waiters = bufDescTable[frame].pinCnt - 1;
+    retireHits(&bufDescTable[frame]);
+    clearFrame(&bufDescTable[frame]);
+    bufDescTable[frame].pinCnt = waiters;
+    if (waiters > 0)
+      pinnedFrames++;
+    bufDescTable[frame].ioInProgress = true;
+  }
+  finishIo(frame);
+}
+
+bool BufMgr::waitForIo(const FrameId frame)
+{
+  BufDesc* tmpbuf = &(bufDescTable[frame]);
+  if (tmpbuf->ioInProgress)
+  {
+    bufStats.pinWaits++;
+    std::unique_lock<std::mutex> ioGuard(ioLatch);
+    ioDone.wait(ioGuard, [tmpbuf]() { return !tmpbuf->ioInProgress; });
+  }
+
+  // our pin keeps the frame from being reused, so valid can't change under us
+  if (tmpbuf->valid)
+    return true;
+
+  std::lock_guard<std::mutex> frameGuard(tmpbuf->latch);
+  dropFramePin(tmpbuf);
+  return false;
+}
+
+const Page* BufMgr::beginOptimistic(File* file, const PageId pageNo, OptimisticRead & read)
+{
+  // threads take reader slots in turn, so up to NUM_READER_SLOTS of them
+  // never share one
+  static std::atomic<std::uint32_t> nextSlot(0);
+  static thread_local const std::uint32_t slot = nextSlot++ % NUM_READER_SLOTS;
+  read.slot = slot;
+  ReaderSlot& readers = readerSlots[slot];
+
+  // counted as active before numBufs is looked at, so either resize() waits
+  // for us or we see the frames it drops are gone
+  readers.active++;
+  if (read.frame < numBufs && frameHolds(read, file, pageNo))
+    return &bufPool[read.frame];
+
+  {
+    std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+    if (!hashTable->tryLookup(file, pageNo, read.frame))
+    {
+      readers.active--;
+      return NULL;
+    }
+  }
+  if (frameHolds(read, file, pageNo))
+    return &bufPool[read.frame];
+  readers.active--;
+  return NULL;
+}
+
+bool BufMgr::frameHolds(OptimisticRead & read, const File* file, const PageId pageNo)
+{
+  BufDesc* tmpbuf = &(bufDescTable[read.frame]);
+  read.version = tmpbuf->version.load(std::memory_order_acquire);
+  return tmpbuf->pinCnt == 0 && tmpbuf->valid && !tmpbuf->ioInProgress
+      && tmpbuf->file == file && tmpbuf->pageNo == pageNo;
+}
+
+bool BufMgr::endOptimistic(File* file, const PageId pageNo, const OptimisticRead & read, const AccessHint hint)
+{
+  // the page is read before the pin count and version are checked again
+  std::atomic_thread_fence(std::memory_order_acquire);
+  BufDesc* tmpbuf = &(bufDescTable[read.frame]);
+  const bool intact = tmpbuf->pinCnt == 0 && tmpbuf->version == read.version;
+
+  ReaderSlot& readers = readerSlots[read.slot];
+  readers.active--;
+  if (!intact)
+    return false;
+  if (++readers.reads % TOUCH_INTERVAL == 0)
+    touchPage(file, pageNo, hint);
+  return true;
+}
+
+void BufMgr::touchPage(File* file, const PageId pageNo, const AccessHint hint)
+{
+  FrameId frameNo = 0;
+  {
+    std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+    if (!hashTable->tryLookup(file, pageNo, frameNo))
+      return;
+    pinFrame(&bufDescTable[frameNo]);
+  }
+  policy->pageAccessed(frameNo, hint);
+  if (waitForIo(frameNo))
+    unPinFrame(frameNo, false);
+}
+
+void PageHandle::release()
+{
+  if (bufMgr != NULL)
+  {
+    // counted first, so the frame never looks free to admission before the
+    // client's reservation takes it back
+    if (BufClient* client = BufClient::current(bufMgr))
+      client->countPin(-1);
+    bufMgr->unPinFrame(frameNo, dirty);
+    bufMgr = NULL;
+    page = NULL;
+    dirty = false;
+  }
+}
+
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, BufferRing* ring, const AccessHint hint)
+{
+  page = &bufPool[fetchFrame(file, pageNo, ring, hint)];
+  if (BufClient* client = BufClient::current(this))
+    client->countPin(1);
+}
+
+PageHandle BufMgr::fetchPage(File* file, const PageId pageNo, BufferRing* ring, const AccessHint hint)
+{
+  FrameId frameNo = fetchFrame(file, pageNo, ring, hint);
+  if (BufClient* client = BufClient::current(this))
+    client->countPin(1);
+  return PageHandle(this, frameNo, pageNo, &bufPool[frameNo]);
+}
+
+FrameId BufMgr::fetchFrame(File* file, const PageId pageNo, BufferRing* ring, const AccessHint hint)
 {
   // check to see if it is already in the buffer pool
   // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
+  bufStats.accesses++;
   FrameId frameNo = 0;
-	try
-	{
-  	hashTable->lookup(file, pageNo, frameNo);
+  while (true)
+  {
+    bool found;
+    {
+      std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+      found = hashTable->tryLookup(file, pageNo, frameNo);
+      if (found)
+      {
+        pinFrame(&bufDescTable[frameNo]);
+        bufDescTable[frameNo].hits++;
+      }
+    }
+
+    //not in the buffer pool, must allocate a new page
+    if (!found)
+    {
+      // alloc a new frame
+      if (ring == NULL || !allocRingBuf(*ring, frameNo))
+        allocBuf(frameNo, true);
+
+      // the page is in the hash table before it is read, so a concurrent
+      // reader waits for this read rather than reading its own copy
+      if (installPage(file, pageNo, frameNo, hint))
+      {
+        if (ring != NULL)
+          addToRing(*ring, file, pageNo, frameNo);
+
+        // read the page into the new frame, no latch needed as the frame is ours
+        bufStats.misses++;
+        countFileStat(file, &FileStats::misses);
+        if (victimCache.enabled() && victimCache.take(file, pageNo, bufPool[frameNo]))
+        {
+          bufStats.victimHits++;
+          finishIo(frameNo);
+          return frameNo;
+        }
+        try
+        {
+          const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+          bufStats.diskreads++;
+          file->readPage(pageNo, bufPool[frameNo]);
+          bufStats.readLatency.record(std::chrono::steady_clock::now() - start);
+          countFileStat(file, &FileStats::diskreads);
+        }
+        catch(...)
+        {
+          abortIo(file, pageNo, frameNo);
+          throw;
+        }
+        finishIo(frameNo);
+        return frameNo;
+      }
+
+      // another thread installed the page first and pinned it for us
+      bufDescTable[frameNo].hits++;
+    }
+    else
+    {
+      // our pin keeps the frame from being evicted before the policy hears of it
+      policy->pageAccessed(frameNo, hint);
+    }
+    bufStats.hits++;
 
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
+    if (waitForIo(frameNo))
+    {
+      return frameNo;
+    }
+    // the read we waited for failed, try again
   }
-  catch(const HashNotFoundException &e) //not in the buffer pool, must allocate a new page
+}
+
+
+void BufMgr::addToRing(BufferRing & ring, const File* file, const PageId pageNo, const FrameId frame)
+{
+  BufferRing::ringSlot& slot = ring.slots[ring.next];
+  slot.used = true;
+  slot.frameNo = frame;
+  slot.file = file;
+  slot.pageNo = pageNo;
+  ring.next = (ring.next + 1) % ring.slots.size();
+}
+
+void BufMgr::prefetchPages(File* file, const std::vector<PageId> & pageNos, BufferRing* ring)
+{
+  for (std::size_t i = 0; i < pageNos.size(); i++)
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    const PageId pageNo = pageNos[i];
+    {
+      // frames being prefetched into are pinned, leave most of the pool to readers
+      std::lock_guard<std::mutex> prefetchGuard(prefetchLatch);
+      if (prefetchesInFlight >= std::max<std::uint32_t>(1, numBufs / 4))
+        return;
+    }
+    {
+      // already in the pool or on its way
+      std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+      FrameId frameNo = 0;
+      if (hashTable->tryLookup(file, pageNo, frameNo))
+        continue;
+    }
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+    // the frame is allocated and the page installed here, so a ring is only
+    // ever used by its owner's thread; the I/O thread only does the read
+    FrameId frameNo = 0;
+    if (ring == NULL || !allocRingBuf(*ring, frameNo))
+    {
+      try
+      {
+        allocBuf(frameNo);
+      }
+      catch(const BufferExceededException &)
+      {
+        return;
+      }
+    }
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+    if (!installPage(file, pageNo, frameNo, NORMAL))
+    {
+      // lost a race with a reader of the page, which pinned it for us
+      dropPin(file, pageNo, frameNo);
+      continue;
+    }
+    if (ring != NULL)
+      addToRing(*ring, file, pageNo, frameNo);
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+    {
+      std::lock_guard<std::mutex> prefetchGuard(prefetchLatch);
+      prefetchesInFlight++;
+    }
+    prefetchRequest request = {file, pageNo, frameNo, NULL, PageCallback()};
+    queueRead(request);
   }
 }
 
-
-void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) 
+void BufMgr::readPageAsync(File* file, const PageId pageNo, AsyncExecutor & executor, PageCallback done,
+                           BufferRing* ring, const AccessHint hint)
 {
-  // lookup in hashtable
+  executor.startRequest();
+  bufStats.accesses++;
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  bool found;
+  {
+    std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+    found = hashTable->tryLookup(file, pageNo, frameNo);
+    if (found)
+    {
+      pinFrame(&bufDescTable[frameNo]);
+      bufDescTable[frameNo].hits++;
+    }
+  }
+
+  if (!found)
+  {
+    try
+    {
+      if (ring == NULL || !allocRingBuf(*ring, frameNo))
+        allocBuf(frameNo);
+    }
+    catch(...)
+    {
+      const std::exception_ptr error = std::current_exception();
+      executor.completeRequest([done, error]() {
+        PageHandle none;
+        done(none, error);
+      });
+      return;
+    }
 
-  if (dirty == true) bufDescTable[frameNo].dirty = dirty;
+    if (installPage(file, pageNo, frameNo, hint))
+    {
+      if (ring != NULL)
+        addToRing(*ring, file, pageNo, frameNo);
+      bufStats.misses++;
+      countFileStat(file, &FileStats::misses);
+      prefetchRequest request = {file, pageNo, frameNo, &executor, done};
+      queueRead(request);
+      return;
+    }
 
-  // make sure the page is actually pinned
-  if (bufDescTable[frameNo].pinCnt == 0)
+    // another thread installed the page first and pinned it for us
+    bufDescTable[frameNo].hits++;
+  }
+  else
   {
-  	throw PageNotPinnedException(file->filename(), pageNo, frameNo);
+    policy->pageAccessed(frameNo, hint);
+  }
+  bufStats.hits++;
+
+  // a page still being read is handed over by finishIo() once it is in
+  {
+    std::lock_guard<std::mutex> ioGuard(ioLatch);
+    if (bufDescTable[frameNo].ioInProgress)
+    {
+      bufStats.pinWaits++;
+      ioWaiter waiter = {file, pageNo, &executor, done, hint};
+      ioWaiters[frameNo].push_back(waiter);
+      return;
+    }
   }
-  else bufDescTable[frameNo].pinCnt--;
+  completeRead(file, pageNo, frameNo, executor, done, hint);
 }
 
-void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
+void BufMgr::completeRead(File* file, const PageId pageNo, const FrameId frame, AsyncExecutor & executor,
+                          PageCallback done, const AccessHint hint)
 {
-  FrameId frameNo;
+  executor.completeRequest([this, file, pageNo, frame, &executor, done, hint]() {
+    // the read is done, so this does not block
+    if (waitForIo(frame))
+    {
+      PageHandle page(this, frame, pageNo, &bufPool[frame]);
+      done(page, std::exception_ptr());
+    }
+    else
+    {
+      // the read we waited for failed, try again
+      readPageAsync(file, pageNo, executor, done, NULL, hint);
+    }
+  });
+}
 
-  // alloc a new frame
-  allocBuf(frameNo);
+void BufMgr::queueRead(const prefetchRequest & request)
+{
+  {
+    std::lock_guard<std::mutex> prefetchGuard(prefetchLatch);
+    if (ioThreads.empty())
+    {
+      for (int t = 0; t < NUM_IO_THREADS; t++)
+        ioThreads.push_back(std::thread(&BufMgr::ioThreadLoop, this));
+    }
+    prefetchQueue.push_back(request);
+    pendingPrefetches[request.file]++;
+  }
+  prefetchQueued.notify_one();
+}
 
-  // allocate a new page in the file
-	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
-  page = &bufPool[frameNo];
+IoEngine& BufMgr::engine()
+{
+  std::lock_guard<std::mutex> engineGuard(ioEngineLatch);
+  if (ioEngine == NULL)
+    ioEngine = IoEngine::create(ioEngineType);
+  return *ioEngine;
+}
 
-  // set up the entry properly
-  bufDescTable[frameNo].Set(file, pageNo);
+void BufMgr::setIoEngine(const IoEngineType type)
+{
+  std::lock_guard<std::mutex> engineGuard(ioEngineLatch);
+  delete ioEngine;
+  ioEngine = NULL;
+  ioEngineType = type;
+}
 
-  // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+const char* BufMgr::ioEngineName()
+{
+  // the engine is set up by the first batched read or write, not by asking
+  std::lock_guard<std::mutex> engineGuard(ioEngineLatch);
+  return ioEngine == NULL ? "none" : ioEngine->name();
 }
 
-void BufMgr::flushFile(const File* file) 
+void BufMgr::readBatch(const std::vector<prefetchRequest> & batch)
 {
-  for (std::uint32_t i = 0; i < numBufs; i++)
-	{
-  	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if(tmpbuf->file && tmpbuf->valid == true && tmpbuf->file == file)
-		{
-	    if (tmpbuf->pinCnt > 0)
-  			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+  // the frames are pinned by the requests, nobody else writes to them
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<bool> cached(batch.size(), false);
+  std::vector<PageIo> pages(batch.size());
+  std::map<File*, std::vector<std::size_t> > byFile;
+  for (std::size_t i = 0; i < batch.size(); i++)
+  {
+    const prefetchRequest & request = batch[i];
+    cached[i] = victimCache.enabled()
+        && victimCache.take(request.file, request.pageNo, bufPool[request.frameNo]);
+    if (cached[i])
+      continue;
+    pages[i].page_number = request.pageNo;
+    pages[i].page = &bufPool[request.frameNo];
+    byFile[request.file].push_back(i);
+  }
+
+  std::map<File*, std::vector<std::size_t> >::iterator it;
+  for (it = byFile.begin(); it != byFile.end(); ++it)
+  {
+    std::vector<PageIo> filePages;
+    for (std::size_t k = 0; k < it->second.size(); k++)
+      filePages.push_back(pages[it->second[k]]);
+    try
+    {
+      it->first->readPages(filePages.data(), filePages.size(), engine());
+    }
+    catch(...)
+    {
+      for (std::size_t k = 0; k < filePages.size(); k++)
+        filePages[k].error = std::current_exception();
+    }
+    for (std::size_t k = 0; k < it->second.size(); k++)
+      pages[it->second[k]].error = filePages[k].error;
+  }
+  const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
 
-	    if (tmpbuf->dirty == true)
-			{
-				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-				tmpbuf->dirty = false;
-    	}
+  for (std::size_t i = 0; i < batch.size(); i++)
+  {
+    const prefetchRequest & request = batch[i];
+    const bool read = !pages[i].error;
+    if (cached[i])
+    {
+      bufStats.victimHits++;
+      finishIo(request.frameNo);
+    }
+    else if (read)
+    {
+      bufStats.diskreads++;
+      countFileStat(request.file, &FileStats::diskreads);
+      if (request.executor == NULL)
+        bufStats.prefetches++;
+      else
+        bufStats.readLatency.record(elapsed);
+      finishIo(request.frameNo);
+    }
+    else
+    {
+      // takes the request's pin with it
+      abortIo(request.file, request.pageNo, request.frameNo);
+    }
 
-    	hashTable->remove(file,tmpbuf->pageNo);
-    	tmpbuf->Clear();
-  	}
-		else if (tmpbuf->valid == false && tmpbuf->file == file)
-  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+    if (request.executor == NULL)
+    {
+      if (read)
+        dropPin(request.file, request.pageNo, request.frameNo);
+    }
+    else
+    {
+      // the pin of the read is handed to the continuation
+      BufMgr* bufMgr = this;
+      const PageCallback done = request.done;
+      const FrameId frameNo = request.frameNo;
+      const PageId pageNo = request.pageNo;
+      const std::exception_ptr error = pages[i].error;
+      request.executor->completeRequest([bufMgr, done, frameNo, pageNo, read, error]() {
+        PageHandle page;
+        if (read)
+          page = PageHandle(bufMgr, frameNo, pageNo, &bufMgr->bufPool[frameNo]);
+        done(page, error);
+      });
+    }
   }
 }
 
-void BufMgr::disposePage(File* file, const PageId pageNo)
+void BufMgr::ioThreadLoop()
 {
-	//Deallocate from file altogether
-  //See if it is in the buffer pool
-  FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  std::vector<prefetchRequest> batch;
+  std::unique_lock<std::mutex> prefetchGuard(prefetchLatch);
+  while (true)
+  {
+    prefetchQueued.wait(prefetchGuard, [this]() { return ioStop || !prefetchQueue.empty(); });
+    if (prefetchQueue.empty())
+      return;
 
-	// clear the page
-	bufDescTable[frameNo].Clear();
+    // whatever is queued is read together
+    batch.clear();
+    while (!prefetchQueue.empty() && batch.size() < IO_BATCH)
+    {
+      batch.push_back(prefetchQueue.front());
+      prefetchQueue.pop_front();
+    }
+    prefetchGuard.unlock();
 
-	hashTable->remove(file, pageNo);
+    readBatch(batch);
 
-  // deallocate it in the file	
-  file->deletePage(pageNo);
+    prefetchGuard.lock();
+    for (std::size_t i = 0; i < batch.size(); i++)
+    {
+      if (batch[i].executor == NULL)
+        prefetchesInFlight--;
+      if (--pendingPrefetches[batch[i].file] == 0)
+      {
+        pendingPrefetches.erase(batch[i].file);
+        prefetchDone.notify_all();
+      }
+    }
+  }
+}
+
+void BufMgr::waitForPrefetches(const File* file)
+{
+  std::unique_lock<std::mutex> prefetchGuard(prefetchLatch);
+  prefetchDone.wait(prefetchGuard, [this, file]() { return pendingPrefetches.count(file) == 0; });
+}
+
+void BufMgr::dropPin(const File* file, const PageId pageNo, const FrameId frame)
+{
+  std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+  dropFramePin(&bufDescTable[frame]);
+}
+
+void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) 
+{
+  std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+
+  // lookup in hashtable
+  FrameId frameNo = 0;
+  if (!hashTable->tryLookup(file, pageNo, frameNo))
+  {
+    throw HashNotFoundException(file->filename(), pageNo);
+  }
+
+  if (dirty == true)
+  {
+    bufDescTable[frameNo].dirty = dirty;
+    bufDescTable[frameNo].version++;
+  }
+
+  // make sure the page is actually pinned
+  if (bufDescTable[frameNo].pinCnt == 0)
+  {
+  	throw PageNotPinnedException(file->filename(), pageNo, frameNo);
+  }
+  else dropFramePin(&bufDescTable[frameNo]);
+
+  if (BufClient* client = BufClient::current(this))
+    client->countPin(-1);
+}
+
+void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
+{
+  page = &bufPool[allocFrame(file, pageNo)];
+  if (BufClient* client = BufClient::current(this))
+    client->countPin(1);
+}
+
+PageHandle BufMgr::newPage(File* file, PageId &pageNo)
+{
+  FrameId frameNo = allocFrame(file, pageNo);
+  if (BufClient* client = BufClient::current(this))
+    client->countPin(1);
+  return PageHandle(this, frameNo, pageNo, &bufPool[frameNo]);
+}
+
+FrameId BufMgr::allocFrame(File* file, PageId &pageNo)
+{
+  FrameId frameNo;
+
+  // alloc a new frame
+  allocBuf(frameNo, true);
+
+  // allocate a new page in the file
+  try
+  {
+    file->allocatePage(pageNo, bufPool[frameNo]);
+
+    // insert in the hash table, nobody else can know the new page number yet
+    std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+    hashTable->insert(file, pageNo, frameNo);
+    addResident(file, pageNo, frameNo);
+  }
+  catch(...)
+  {
+    releaseBuf(frameNo);
+    throw;
+  }
+
+  // set up the entry properly
+  {
+    std::lock_guard<std::mutex> frameGuard(bufDescTable[frameNo].latch);
+    bufDescTable[frameNo].Set(file, pageNo);
+  }
+  policy->pageLoaded(frameNo, file, pageNo, NORMAL);
+  return frameNo;
+}
+
+void BufMgr::flushFile(const File* file) 
+{
+  dropFilePages(file, true);
+  file->flush();
+}
+
+void BufMgr::evictFile(const File* file)
+{
+  dropFilePages(file, false);
+}
+
+void BufMgr::dropFilePages(const File* file, const bool writeDirty)
+{
+  // prefetched pages stay pinned until they have been read
+  waitForPrefetches(file);
+
+  std::vector<std::pair<PageId, FrameId> > pages;
+  residentPages(file, pages);
+
+  // write the dirty pages in batches first; what is dirtied again meanwhile
+  // is written one page at a time below
+  if (writeDirty)
+  {
+    std::vector<FrameId> frames;
+    for (std::size_t i = 0; i < pages.size(); i++)
+      frames.push_back(pages[i].second);
+    writeFrames(frames, true);
+  }
+
+  for (std::size_t i = 0; i < pages.size(); i++)
+	{
+    const PageId pageNo = pages[i].first;
+  	BufDesc* tmpbuf = &(bufDescTable[pages[i].second]);
+
+    // partition latch has to be taken before the frame latch
+    std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+    std::lock_guard<std::mutex> frameGuard(tmpbuf->latch);
+
+    // evicted and possibly reused since the snapshot was taken
+    if (tmpbuf->file != file || tmpbuf->pageNo != pageNo || tmpbuf->valid == false)
+      continue;
+
+    if (tmpbuf->pinCnt > 0)
+      throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+
+    if (writeDirty && tmpbuf->dirty == true)
+    {
+      writeFrame(tmpbuf);
+      tmpbuf->dirty = false;
+    }
+
+    hashTable->remove(file, pageNo);
+    removeResident(file, pageNo);
+    policy->pageRemoved(tmpbuf->frameNo);
+    retireHits(tmpbuf);
+    clearFrame(tmpbuf);
+  }
+
+  // the File object may be deleted once flushed
+  victimCache.eraseFile(file);
+}
+
+void BufMgr::flushAll()
+{
+  std::vector<const File*> files;
+  {
+    std::lock_guard<std::mutex> residentGuard(residentLatch);
+    std::map<const File*, std::map<PageId, FrameId> >::iterator it;
+    for (it = residentFrames.begin(); it != residentFrames.end(); ++it)
+      files.push_back(it->first);
+  }
+
+  // pinned pages may be in the middle of a change, they are written when evicted
+  std::vector<std::pair<PageId, FrameId> > pages;
+  std::vector<FrameId> frames;
+  for (std::size_t f = 0; f < files.size(); f++)
+  {
+    residentPages(files[f], pages);
+    for (std::size_t i = 0; i < pages.size(); i++)
+      frames.push_back(pages[i].second);
+  }
+
+  std::vector<File*> written;
+  writeFrames(frames, true, &written);
+  for (std::size_t f = 0; f < written.size(); f++)
+    written[f]->flush();
+}
+
+std::uint32_t BufMgr::writeFrames(std::vector<FrameId> frames, const bool wait, std::vector<File*>* files)
+{
+  std::sort(frames.begin(), frames.end());
+  frames.erase(std::unique(frames.begin(), frames.end()), frames.end());
+
+  std::uint32_t written = 0;
+  std::exception_ptr firstError;
+  for (std::size_t from = 0; from < frames.size(); from += IO_BATCH)
+  {
+    const std::size_t to = std::min(frames.size(), from + IO_BATCH);
+    std::vector<std::unique_lock<std::mutex> > frameGuards;
+    std::vector<BufDesc*> dirty;
+    for (std::size_t i = from; i < to; i++)
+    {
+      BufDesc* tmpbuf = &(bufDescTable[frames[i]]);
+      std::unique_lock<std::mutex> frameGuard(tmpbuf->latch, std::defer_lock);
+      if (wait)
+        frameGuard.lock();
+      else if (!frameGuard.try_lock())
+        continue;
+
+      // dropped by resize(), or nothing to write
+      if (frames[i] >= numBufs || !tmpbuf->valid || tmpbuf->pinCnt > 0 || !tmpbuf->dirty.exchange(false))
+        continue;
+      frameGuards.push_back(std::move(frameGuard));
+      dirty.push_back(tmpbuf);
+    }
+
+    // one batch per file, in page order
+    std::sort(dirty.begin(), dirty.end(), [](const BufDesc* a, const BufDesc* b) {
+      return a->file != b->file ? a->file < b->file : a->pageNo < b->pageNo;
+    });
+    for (std::size_t first = 0; first < dirty.size(); )
+    {
+      File* file = dirty[first]->file;
+      std::size_t last = first;
+      std::vector<PageIo> pages;
+      while (last < dirty.size() && dirty[last]->file == file)
+      {
+        PageIo page = {dirty[last]->pageNo, &bufPool[dirty[last]->frameNo], std::exception_ptr()};
+        pages.push_back(page);
+        last++;
+      }
+
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      try
+      {
+        file->writePages(pages.data(), pages.size(), engine());
+      }
+      catch(...)
+      {
+        for (std::size_t k = 0; k < pages.size(); k++)
+          pages[k].error = std::current_exception();
+      }
+      const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+
+      std::uint64_t fileWrites = 0;
+      for (std::size_t k = 0; k < pages.size(); k++)
+      {
+        if (pages[k].error)
+        {
+          dirty[first + k]->dirty = true;
+          if (!firstError)
+            firstError = pages[k].error;
+          continue;
+        }
+        bufStats.writeLatency.record(elapsed);
+        fileWrites++;
+      }
+      if (fileWrites > 0)
+      {
+        bufStats.diskwrites += fileWrites;
+        countFileStat(file, &FileStats::diskwrites, fileWrites);
+        if (files != NULL && std::find(files->begin(), files->end(), file) == files->end())
+          files->push_back(file);
+      }
+      written += fileWrites;
+      first = last;
+    }
+  }
+
+  if (wait && firstError)
+    std::rethrow_exception(firstError);
+  return written;
+}
+
+void BufMgr::addResident(const File* file, const PageId pageNo, const FrameId frame)
+{
+  std::lock_guard<std::mutex> residentGuard(residentLatch);
+  residentFrames[file][pageNo] = frame;
+}
+
+void BufMgr::removeResident(const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> residentGuard(residentLatch);
+  std::map<const File*, std::map<PageId, FrameId> >::iterator it = residentFrames.find(file);
+  if (it == residentFrames.end())
+    return;
+  it->second.erase(pageNo);
+  if (it->second.empty())
+    residentFrames.erase(it);
+}
+
+void BufMgr::residentPages(const File* file, std::vector<std::pair<PageId, FrameId> > & pages)
+{
+  pages.clear();
+  std::lock_guard<std::mutex> residentGuard(residentLatch);
+  std::map<const File*, std::map<PageId, FrameId> >::iterator it = residentFrames.find(file);
+  if (it != residentFrames.end())
+    pages.assign(it->second.begin(), it->second.end());
+}
+
+void BufMgr::disposePage(File* file, const PageId pageNo)
+{
+  waitForPrefetches(file);
+
+	//Deallocate from file altogether
+  {
+    //See if it is in the buffer pool
+    std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+    FrameId frameNo = 0;
+    if (hashTable->tryLookup(file, pageNo, frameNo))
+    {
+      // clear the page, unless a pin (a PageHandle, say) would later drop
+      // a pin on whatever the frame holds by then
+      {
+        BufDesc* tmpbuf = &bufDescTable[frameNo];
+        std::lock_guard<std::mutex> frameGuard(tmpbuf->latch);
+        if (tmpbuf->pinCnt > 0)
+          throw PagePinnedException(file->filename(), pageNo, frameNo);
+        retireHits(tmpbuf);
+        clearFrame(tmpbuf);
+      }
+
+      hashTable->remove(file, pageNo);
+      removeResident(file, pageNo);
+      policy->pageRemoved(frameNo);
+    }
+    victimCache.erase(file, pageNo);
+  }
+
+  // deallocate it in the file	
+  file->deletePage(pageNo);
+}
+
+void BufMgr::reserveFrames(const std::uint32_t frames, const std::chrono::milliseconds timeout)
+{
+  std::unique_lock<std::mutex> admissionGuard(admissionLatch);
+  if (frames > numBufs)
+    throw BufferExceededException();
+
+  // frames pinned outside the reservations are not free either
+  auto fits = [this, frames]() {
+    const std::uint32_t pinned = pinnedFrames;
+    const std::uint32_t unreserved = pinned - std::min<std::uint32_t>(pinned, reservedPinned);
+    return reservedFrames + frames + unreserved <= numBufs;
+  };
+  frameWaiters++;
+  bool admitted = true;
+  if (timeout == std::chrono::milliseconds::max())
+    admissionOpen.wait(admissionGuard, fits);
+  else
+    admitted = admissionOpen.wait_for(admissionGuard, timeout, fits);
+  frameWaiters--;
+  if (!admitted)
+    throw BufferExceededException();
+  reservedFrames += frames;
+}
+
+bool BufMgr::waitForUnpin(const std::chrono::steady_clock::time_point deadline)
+{
+  std::unique_lock<std::mutex> admissionGuard(admissionLatch);
+  auto unpinned = [this]() { return pinnedFrames < numBufs; };
+  frameWaiters++;
+  bool freed = true;
+  if (deadline == std::chrono::steady_clock::time_point::max())
+    admissionOpen.wait(admissionGuard, unpinned);
+  else
+    freed = admissionOpen.wait_until(admissionGuard, deadline, unpinned);
+  frameWaiters--;
+  return freed;
+}
+
+void BufMgr::releaseFrames(const std::uint32_t frames)
+{
+  {
+    std::lock_guard<std::mutex> admissionGuard(admissionLatch);
+    reservedFrames -= frames;
+  }
+  admissionOpen.notify_all();
+}
+
+std::uint32_t BufMgr::getReservedFrames()
+{
+  std::lock_guard<std::mutex> admissionGuard(admissionLatch);
+  return reservedFrames;
+}
+
+thread_local BufClient* BufClient::newest = NULL;
+
+BufClient::BufClient(BufMgr* mgr, const std::uint32_t reserve, const std::chrono::milliseconds timeoutIn)
+  : bufMgr(mgr), frames(reserve), timeout(timeoutIn), pinCount(0), peak(0), previous(newest)
+{
+  bufMgr->reserveFrames(frames, timeout);
+  newest = this;
+}
+
+BufClient::~BufClient()
+{
+  // clients are destroyed in the reverse order of their creation, being
+  // objects with scope; only unlink this one in case that is not so
+  for (BufClient** link = &newest; *link != NULL; link = &(*link)->previous)
+  {
+    if (*link == this)
+    {
+      *link = previous;
+      break;
+    }
+  }
+  // pins still held count against the pool from now on
+  if (pinCount > 0)
+    bufMgr->reservedPinned -= std::min<std::uint32_t>(pinCount, frames);
+  bufMgr->releaseFrames(frames);
+}
+
+BufClient* BufClient::current(const BufMgr* bufMgr)
+{
+  for (BufClient* client = newest; client != NULL; client = client->previous)
+    if (client->bufMgr == bufMgr)
+      return client;
+  return NULL;
+}
+
+void BufClient::countPin(const int delta)
+{
+  // pins taken before the client was created may be dropped while it lives
+  if (delta < 0 && pinCount <= 0)
+    return;
+  const int pins = pinCount += delta;
+  // pins within the reservation come out of it, the others out of the pool
+  if (delta > 0 && pins <= (int)frames)
+    bufMgr->reservedPinned++;
+  else if (delta < 0 && pins < (int)frames)
+    bufMgr->reservedPinned--;
+  if (pins > peak)
+    peak = pins;
+}
+
+void BufMgr::setVictimCacheSize(const std::size_t bytes)
+{
+  victimCache.setCapacity(bytes);
+}
+
+void BufMgr::resize(const std::uint32_t newFrames)
+{
+  std::lock_guard<std::mutex> resizeGuard(resizeLatch);
+  resizes++;
+  try
+  {
+    resizeFrames(newFrames);
+  }
+  catch(...)
+  {
+    resizes++;
+    throw;
+  }
+  resizes++;
+}
+
+void BufMgr::resizeFrames(const std::uint32_t newFrames)
+{
+  const std::uint32_t oldFrames = numBufs;
+  if (newFrames == oldFrames)
+    return;
+  {
+    std::lock_guard<std::mutex> admissionGuard(admissionLatch);
+    if (newFrames < reservedFrames)
+      throw BufferExceededException();
+  }
+
+  // new frames get their memory before anybody can see them
+  if (newFrames > oldFrames)
+  {
+    if (newFrames > bufDescTable.capacity())
+      bufDescTable.resize(newFrames);
+    bufPool.resize(newFrames);
+    for (FrameId i = oldFrames; i < newFrames; i++)
+    {
+      std::lock_guard<std::mutex> frameGuard(bufDescTable[i].latch);
+      clearFrame(&bufDescTable[i]);
+      bufDescTable[i].frameNo = i;
+    }
+  }
+
+  // stop every hit, install and eviction while frames come and go
+  std::vector<std::unique_lock<std::mutex> > partitionGuards;
+  for (int i = 0; i < BufHashTbl::NUM_PARTITIONS; i++)
+    partitionGuards.push_back(std::unique_lock<std::mutex>(hashTable->partitionLatch(i)));
+
+  if (newFrames < oldFrames)
+  {
+    // from here on claimBuf() refuses the frames being dropped
+    numBufs = newFrames;
+    for (FrameId i = newFrames; i < oldFrames; i++)
+    {
+      BufDesc* tmpbuf = &(bufDescTable[i]);
+      std::lock_guard<std::mutex> frameGuard(tmpbuf->latch);
+      if (tmpbuf->pinCnt > 0 || tmpbuf->ioInProgress)
+      {
+        // frames dropped so far are just free frames again
+        numBufs = oldFrames;
+        throw PagePinnedException(tmpbuf->file != NULL ? tmpbuf->file->filename() : "",
+                                  tmpbuf->pageNo, tmpbuf->frameNo);
+      }
+      if (!tmpbuf->valid)
+        continue;
+
+      if (tmpbuf->dirty == true)
+      {
+        try
+        {
+          writeFrame(tmpbuf);
+        }
+        catch(...)
+        {
+          numBufs = oldFrames;
+          throw;
+        }
+      }
+      hashTable->remove(tmpbuf->file, tmpbuf->pageNo);
+      removeResident(tmpbuf->file, tmpbuf->pageNo);
+      policy->pageRemoved(i);
+      retireHits(tmpbuf);
+      clearFrame(tmpbuf);
+    }
+  }
+
+  policy->resize(newFrames);
+  hashTable->resize(newFrames);
+  numBufs = newFrames;
+  partitionGuards.clear();
+
+  // only frames nobody can reach any more lose their memory; their
+  // descriptors are kept. An optimistic reader may have found a dropped
+  // frame before numBufs went down and still be reading it.
+  if (newFrames < oldFrames)
+  {
+    for (int i = 0; i < NUM_READER_SLOTS; i++)
+      while (readerSlots[i].active > 0)
+        std::this_thread::yield();
+    bufPool.resize(newFrames);
+  }
+  else
+  {
+    // clients waiting for frames may fit now
+    std::lock_guard<std::mutex> admissionGuard(admissionLatch);
+    admissionOpen.notify_all();
+  }
+}
+
+void BufMgr::startBgWriter(const BgWriterConfig & config)
+{
+  stopBgWriter();
+  bgConfig = config;
+  bgStop = false;
+  bgWriter = std::thread(&BufMgr::bgWriterLoop, this);
+}
+
+void BufMgr::stopBgWriter()
+{
+  if (!bgWriter.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> bgGuard(bgLatch);
+    bgStop = true;
+  }
+  bgWake.notify_all();
+  bgWriter.join();
+}
+
+void BufMgr::bgWriterLoop()
+{
+  std::chrono::steady_clock::time_point lastSave = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> bgGuard(bgLatch);
+  while (!bgStop)
+  {
+    bgGuard.unlock();
+    bgWriterRound();
+    if (!bgConfig.residentSetPath.empty()
+        && std::chrono::steady_clock::now() - lastSave >= bgConfig.residentSetInterval)
+    {
+      saveResidentSetQuietly();
+      lastSave = std::chrono::steady_clock::now();
+    }
+    bgGuard.lock();
+    bgWake.wait_for(bgGuard, bgConfig.interval, [this]() { return bgStop; });
+  }
+
+  bgGuard.unlock();
+  if (!bgConfig.residentSetPath.empty())
+    saveResidentSetQuietly();
+}
+
+void BufMgr::saveResidentSetQuietly()
+{
+  try
+  {
+    saveResidentSet(bgConfig.residentSetPath);
+  }
+  catch(...)
+  {
+    // nobody to report to, the next save tries again
+  }
+}
+
+std::uint32_t BufMgr::bgWriterRound()
+{
+  std::uint32_t dirtyFrames = 0;
+  for (std::uint32_t i = 0; i < numBufs; i++)
+  {
+    if (bufDescTable[i].dirty)
+      dirtyFrames++;
+  }
+  const std::uint32_t high = (std::uint32_t)(bgConfig.highWatermark * numBufs);
+  const std::uint32_t low = (std::uint32_t)(bgConfig.lowWatermark * numBufs);
+  const bool overHigh = dirtyFrames > high;
+
+  // past the watermark look at the whole pool, not just the next few victims
+  std::vector<FrameId> victims;
+  policy->upcomingVictims(victims, overHigh ? numBufs.load() : bgConfig.lookahead);
+
+  std::vector<FrameId> dirty;
+  for (std::size_t i = 0; i < victims.size() && dirty.size() < bgConfig.maxPagesPerRound; i++)
+  {
+    if (i >= bgConfig.lookahead && dirtyFrames <= low)
+      break;
+    const BufDesc* tmpbuf = &(bufDescTable[victims[i]]);
+    if (tmpbuf->dirty && tmpbuf->pinCnt == 0)
+    {
+      dirty.push_back(victims[i]);
+      dirtyFrames--;
+    }
+  }
+
+  // frames being evicted or flushed are skipped; errors are left to the
+  // eviction, which reports them to its caller
+  const std::uint32_t written = writeFrames(dirty, false);
+  bufStats.bgwrites += written;
+  return written;
+}
+
+void BufMgr::saveResidentSet(const std::string& path)
+{
+  // rank of each frame in eviction order, later is hotter; pinned frames
+  // are in use right now and frames the policy does not list are not up
+  // for eviction, so both rank above every other
+  std::vector<FrameId> victims;
+  policy->upcomingVictims(victims, numBufs);
+  std::map<FrameId, std::uint32_t> hotness;
+  for (std::size_t i = 0; i < victims.size(); i++)
+    hotness[victims[i]] = i;
+
+  const std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream out(tmpPath.c_str(), std::ios::out | std::ios::trunc);
+    if (!out)
+      throw FileNotFoundException(tmpPath);
+
+    for (std::uint32_t i = 0; i < numBufs; i++)
+    {
+      BufDesc* tmpbuf = &(bufDescTable[i]);
+      std::lock_guard<std::mutex> frameGuard(tmpbuf->latch);
+      if (tmpbuf->valid == false || tmpbuf->ioInProgress)
+        continue;
+      std::map<FrameId, std::uint32_t>::iterator rank = hotness.find(i);
+      const bool hottest = rank == hotness.end() || tmpbuf->pinCnt > 0;
+      out << (hottest ? victims.size() : rank->second) << " " << tmpbuf->pageNo
+          << " " << tmpbuf->file->filename() << "\n";
+    }
+    if (!out.flush())
+      throw FileNotFoundException(tmpPath);
+  }
+
+  if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    throw FileNotFoundException(path);
+}
+
+std::uint32_t BufMgr::loadResidentSet(const std::string& path, const std::vector<File*>& files)
+{
+  std::ifstream in(path.c_str());
+  if (!in)
+    throw FileNotFoundException(path);
+
+  std::map<std::string, File*> byName;
+  for (std::size_t i = 0; i < files.size(); i++)
+    byName[files[i]->filename()] = files[i];
+
+  // (hotness, file, page number) of the pages of the given files
+  std::vector<std::tuple<std::uint32_t, File*, PageId> > entries;
+  std::uint32_t rank;
+  PageId pageNo;
+  std::string name;
+  while (in >> rank >> pageNo && std::getline(in >> std::ws, name))
+  {
+    std::map<std::string, File*>::iterator file = byName.find(name);
+    if (file != byName.end())
+      entries.push_back(std::make_tuple(rank, file->second, pageNo));
+  }
+
+  // keep the hottest pages that fit
+  std::sort(entries.begin(), entries.end());
+  if (entries.size() > numBufs)
+    entries.erase(entries.begin(), entries.end() - numBufs);
+
+  // sorted reads per file, as many at a time as prefetchPages() takes
+  std::map<File*, std::vector<PageId> > pagesOf;
+  for (std::size_t i = 0; i < entries.size(); i++)
+    pagesOf[std::get<1>(entries[i])].push_back(std::get<2>(entries[i]));
+  const std::size_t batch = std::max<std::uint32_t>(1, numBufs / 4);
+  std::map<File*, std::vector<PageId> >::iterator it;
+  for (it = pagesOf.begin(); it != pagesOf.end(); ++it)
+  {
+    std::vector<PageId>& pageNos = it->second;
+    std::sort(pageNos.begin(), pageNos.end());
+    for (std::size_t first = 0; first < pageNos.size(); first += batch)
+    {
+      std::vector<PageId> pages(pageNos.begin() + first,
+                                pageNos.begin() + std::min(first + batch, pageNos.size()));
+      prefetchPages(it->first, pages);
+      waitForPrefetches(it->first);
+    }
+  }
+
+  // replay the accesses from coldest to hottest
+  std::uint32_t loaded = 0;
+  for (std::size_t i = 0; i < entries.size(); i++)
+  {
+    File* file = std::get<1>(entries[i]);
+    pageNo = std::get<2>(entries[i]);
+    std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+    FrameId frameNo = 0;
+    if (hashTable->tryLookup(file, pageNo, frameNo))
+    {
+      policy->pageAccessed(frameNo, NORMAL);
+      loaded++;
+    }
+  }
+  return loaded;
+}
+
+void LatencyHistogram::record(const std::chrono::steady_clock::duration latency)
+{
+  std::uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+  int bucket = 0;
+  while (us > 0 && bucket < NUM_BUCKETS - 1)
+  {
+    us >>= 1;
+    bucket++;
+  }
+  buckets[bucket]++;
+}
+
+std::uint64_t LatencyHistogram::count() const
+{
+  std::uint64_t total = 0;
+  for (int i = 0; i < NUM_BUCKETS; i++)
+    total += buckets[i];
+  return total;
+}
+
+std::uint64_t LatencyHistogram::percentile(const double fraction) const
+{
+  const std::uint64_t total = count();
+  if (total == 0)
+    return 0;
+  std::uint64_t seen = 0;
+  for (int i = 0; i < NUM_BUCKETS; i++)
+  {
+    seen += buckets[i];
+    if (seen >= fraction * total)
+      return (std::uint64_t)1 << i;
+  }
+  return (std::uint64_t)1 << (NUM_BUCKETS - 1);
+}
+
+void LatencyHistogram::clear()
+{
+  for (int i = 0; i < NUM_BUCKETS; i++)
+    buckets[i] = 0;
+}
+
+void BufMgr::countFileStat(const File* file, std::uint64_t FileStats::*counter, const std::uint64_t n)
+{
+  std::lock_guard<std::mutex> statsGuard(statsLatch);
+  fileStats[file->filename()].*counter += n;
+}
+
+void BufMgr::retireHits(BufDesc* tmpbuf)
+{
+  if (tmpbuf->valid && tmpbuf->hits > 0)
+    countFileStat(tmpbuf->file, &FileStats::hits, tmpbuf->hits);
+}
+
+void BufMgr::writeFrame(BufDesc* tmpbuf)
+{
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[tmpbuf->frameNo]);
+  bufStats.writeLatency.record(std::chrono::steady_clock::now() - start);
+  bufStats.diskwrites++;
+  countFileStat(tmpbuf->file, &FileStats::diskwrites);
+}
+
+void BufMgr::getFileStats(std::map<std::string, FileStats> & stats)
+{
+  {
+    std::lock_guard<std::mutex> statsGuard(statsLatch);
+    stats = fileStats;
+  }
+
+  // hits on pages still in the pool have not been added yet
+  for (std::uint32_t i = 0; i < numBufs; i++)
+  {
+    BufDesc* tmpbuf = &(bufDescTable[i]);
+    std::lock_guard<std::mutex> frameGuard(tmpbuf->latch);
+    if (tmpbuf->valid && tmpbuf->hits > 0)
+      stats[tmpbuf->file->filename()].hits += tmpbuf->hits;
+  }
+}
+
+void BufMgr::clearBufStats()
+{
+  bufStats.clear();
+  {
+    std::lock_guard<std::mutex> statsGuard(statsLatch);
+    fileStats.clear();
+  }
+  for (std::uint32_t i = 0; i < numBufs; i++)
+    bufDescTable[i].hits = 0;
+  for (int i = 0; i < NUM_READER_SLOTS; i++)
+    readerSlots[i].reads = 0;
+}
+
+/**
+ * Writes a string as a JSON string literal.
+ */
+static void writeJsonString(std::ostream& out, const std::string& str)
+{
+  out << '"';
+  for (std::size_t i = 0; i < str.size(); i++)
+  {
+    const unsigned char c = str[i];
+    if (c == '"' || c == '\\')
+      out << '\\' << c;
+    else if (c < 0x20)
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+    else
+      out << c;
+  }
+  out << '"';
+}
+
+/**
+ * Writes a latency histogram as text or as a JSON object.
+ */
+static void writeHistogram(std::ostream& out, const LatencyHistogram& histogram, const bool json)
+{
+  if (json)
+  {
+    out << "{\"count\":" << histogram.count() << ",\"p50_us\":" << histogram.percentile(0.5)
+        << ",\"p99_us\":" << histogram.percentile(0.99) << ",\"buckets\":[";
+    for (int i = 0; i < LatencyHistogram::NUM_BUCKETS; i++)
+      out << (i > 0 ? "," : "") << histogram.buckets[i];
+    out << "]}";
+    return;
+  }
+
+  out << histogram.count() << " (p50 <" << histogram.percentile(0.5) << "us, p99 <"
+      << histogram.percentile(0.99) << "us)\n";
+  for (int i = 0; i < LatencyHistogram::NUM_BUCKETS; i++)
+  {
+    if (histogram.buckets[i] > 0)
+      out << "    <" << ((std::uint64_t)1 << i) << "us: " << histogram.buckets[i] << "\n";
+  }
+}
+
+std::string BufMgr::statsSnapshot(const bool json)
+{
+  std::map<std::string, FileStats> files;
+  getFileStats(files);
+  const BufStats& stats = getBufStats();
+  const double hitRatio = bufStats.accesses > 0 ? (double)bufStats.hits / bufStats.accesses : 0;
+  std::size_t victimPages, victimBytes;
+  getVictimCacheUsage(victimPages, victimBytes);
+
+  std::ostringstream out;
+  if (json)
+  {
+    out << "{\"frames\":" << numBufs << ",\"free_frames\":" << freeFrames()
+        << ",\"reserved_frames\":" << getReservedFrames() << ",\"accesses\":" << bufStats.accesses
+        << ",\"hits\":" << bufStats.hits << ",\"misses\":" << bufStats.misses
+        << ",\"hit_ratio\":" << hitRatio << ",\"pin_waits\":" << bufStats.pinWaits
+        << ",\"diskreads\":" << bufStats.diskreads << ",\"diskwrites\":" << bufStats.diskwrites
+        << ",\"bgwrites\":" << bufStats.bgwrites << ",\"prefetches\":" << bufStats.prefetches
+        << ",\"io_engine\":\"" << ioEngineName() << "\""
+        << ",\"optimistic\":{\"reads\":" << stats.optimisticReads
+        << ",\"fallbacks\":" << stats.optimisticFallbacks << "}"
+        << ",\"victim_cache\":{\"hits\":" << bufStats.victimHits << ",\"pages\":" << victimPages
+        << ",\"bytes\":" << victimBytes << "}"
+        << ",\"evictions\":{\"clean\":" << bufStats.cleanEvictions
+        << ",\"dirty\":" << bufStats.dirtyEvictions << "}"
+        << ",\"read_latency\":";
+    writeHistogram(out, bufStats.readLatency, true);
+    out << ",\"write_latency\":";
+    writeHistogram(out, bufStats.writeLatency, true);
+    out << ",\"files\":{";
+    for (std::map<std::string, FileStats>::iterator it = files.begin(); it != files.end(); ++it)
+    {
+      if (it != files.begin())
+        out << ",";
+      writeJsonString(out, it->first);
+      out << ":{\"hits\":" << it->second.hits << ",\"misses\":" << it->second.misses
+          << ",\"diskreads\":" << it->second.diskreads << ",\"diskwrites\":" << it->second.diskwrites
+          << ",\"evictions\":" << it->second.evictions << "}";
+    }
+    out << "}}";
+    return out.str();
+  }
+
+  out << "frames: " << numBufs << " (" << freeFrames() << " free, "
+      << getReservedFrames() << " reserved)\n"
+      << "accesses: " << bufStats.accesses << " (hits " << bufStats.hits << ", misses "
+      << bufStats.misses << ", hit ratio " << hitRatio << ")\n"
+      << "pin waits: " << bufStats.pinWaits << "\n"
+      << "disk reads: " << bufStats.diskreads << " (prefetched " << bufStats.prefetches << ")\n"
+      << "disk writes: " << bufStats.diskwrites << " (background " << bufStats.bgwrites << ")\n"
+      << "io engine: " << ioEngineName() << "\n"
+      << "optimistic reads: " << stats.optimisticReads << " (fallbacks " << stats.optimisticFallbacks << ")\n"
+      << "victim cache: " << bufStats.victimHits << " hits, " << victimPages << " pages in " << victimBytes << " bytes\n"
+      << "evictions: " << bufStats.cleanEvictions << " clean, " << bufStats.dirtyEvictions << " dirty\n"
+      << "read latency: ";
+  writeHistogram(out, bufStats.readLatency, false);
+  out << "write latency: ";
+  writeHistogram(out, bufStats.writeLatency, false);
+  for (std::map<std::string, FileStats>::iterator it = files.begin(); it != files.end(); ++it)
+  {
+    out << "file " << it->first << ": hits " << it->second.hits << ", misses " << it->second.misses
+        << ", disk reads " << it->second.diskreads << ", disk writes " << it->second.diskwrites
+        << ", evictions " << it->second.evictions << "\n";
+  }
+  return out.str();
 }
 
 void BufMgr::printSelf(void) 
@@ -236,6 +1770,7 @@ void BufMgr::printSelf(void)
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	tmpbuf = &(bufDescTable[i]);
+    std::lock_guard<std::mutex> frameGuard(tmpbuf->latch);
 		std::cout << "FrameNo:" << i << " ";
 		tmpbuf->Print();
 
@@ -8,8 +8,25 @@
 #pragma once
 
 #include "file.h"
+#include "frameArray.h"
+#include "asyncExecutor.h"
 #include "bufHashTbl.h"
+#include "ioEngine.h"
+#include "replacer.h"
+#include "victimCache.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace badgerdb {
 
@@ -17,15 +34,31 @@ namespace badgerdb {
 * forward declaration of BufMgr class 
 */
 class BufMgr;
+class BufClient;
 
 /**
 * @brief Class for maintaining information about buffer pool frames
+*
+* file, pageNo and valid only change while both the frame latch and the hash
+* table partition latch of the page are held.  pinCnt only goes up under the
+* partition latch of the page held in the frame (or, for an invalid frame,
+* under the frame latch), so holding the partition latch is enough to pin a
+* resident page without touching the frame latch.  A PageHandle drops its pin
+* without any latch: lowering the count can only make a frame look pinned for
+* longer, and dirty is set before the count drops. So is version, which lets
+* BufMgr::readOptimistic() read an unpinned page without any latch.
 */
 class BufDesc {
 
 	friend class BufMgr;
+	template <class T> friend class FrameArray;
 
  private:
+	/**
+   * Latch held while the frame is being claimed, refilled or written back
+	 */
+  std::mutex latch;
+
 	/**
    * Pointer to file to which corresponding frame is assigned
 	 */
@@ -44,34 +77,52 @@ class BufDesc {
 	/**
    * Number of times this page has been pinned
 	 */
-  int pinCnt;
+  std::atomic<int> pinCnt;
 
 	/**
    * True if page is dirty;  false otherwise
 	 */
-  bool dirty;
+  std::atomic<bool> dirty;
 
 	/**
    * True if page is valid
 	 */
-  bool valid;
+  std::atomic<bool> valid;
+
+	/**
+   * True while the page is being read into the frame. The frame is already in
+	 * the hash table then, and threads pinning it wait until the read is done.
+	 */
+  std::atomic<bool> ioInProgress;
+
+	/**
+   * Number of hits on the page since it was brought into the frame. Added to
+	 * the statistics of its file when the page leaves the frame, so counting a
+	 * hit does not take a latch.
+	 */
+  std::atomic<int> hits;
 
 	/**
-   * Has this buffer frame been reference recently
+   * Changed whenever the page in the frame is replaced or may have been
+	 * modified: when the frame is cleared or given a page, and before a dirty
+	 * pin is dropped. An optimistic reader checks it did not change while it
+	 * read the page, see BufMgr::readOptimistic().
 	 */
-  bool refbit;
+  std::atomic<std::uint64_t> version;
 
 	/**
    * Initialize buffer frame for a new user
 	 */
   void Clear()
 	{
+    version++;
     pinCnt = 0;
 		file = NULL;
 		pageNo = Page::INVALID_NUMBER;
     dirty = false;
-    refbit = false;
 		valid = false;
+    ioInProgress = false;
+    hits = 0;
   };
 
 	/**
@@ -83,12 +134,12 @@ class BufDesc {
 	 */
   void Set(File* filePtr, PageId pageNum)
 	{ 
+    version++;
 		file = filePtr;
     pageNo = pageNum;
     pinCnt = 1;
     dirty = false;
     valid = true;
-    refbit = true;
   }
 
   void Print()
@@ -103,8 +154,7 @@ class BufDesc {
 
 		std::cout << "valid:" << valid << " ";
 		std::cout << "pinCnt:" << pinCnt << " ";
-		std::cout << "dirty:" << dirty << " ";
-		std::cout << "refbit:" << refbit << "\n";
+		std::cout << "dirty:" << dirty << "\n";
   }
 
 	/**
@@ -112,37 +162,157 @@ class BufDesc {
 	 */
   BufDesc()
 	{
+    version = 0;
   	Clear();
   }
 };
 
 
+/**
+* @brief Log-bucketed histogram of latencies. Bucket 0 counts latencies under
+* 1 microsecond, bucket i those in [2^(i-1), 2^i) microseconds, and the last
+* bucket everything longer.
+*/
+struct LatencyHistogram
+{
+	/**
+   * Number of buckets
+	 */
+  static const int NUM_BUCKETS = 24;
+
+	/**
+   * Number of latencies counted in each bucket
+	 */
+  std::atomic<std::uint64_t> buckets[NUM_BUCKETS];
+
+	/**
+   * Count a latency
+	 *
+	 * @param latency   Time the operation took
+	 */
+  void record(const std::chrono::steady_clock::duration latency);
+
+	/**
+   * Number of latencies counted
+	 */
+  std::uint64_t count() const;
+
+	/**
+   * Upper bound, in microseconds, of the bucket that holds the given fraction
+	 * of the latencies counted, e.g. 0.99 for the 99th percentile. 0 if nothing
+	 * was counted.
+	 *
+	 * @param fraction  Fraction of latencies, between 0 and 1
+	 */
+  std::uint64_t percentile(const double fraction) const;
+
+	/**
+   * Clear all buckets
+	 */
+  void clear();
+
+  LatencyHistogram()
+  {
+		clear();
+  }
+};
+
+/**
+* @brief Buffer pool usage of one file, see BufMgr::getFileStats()
+*/
+struct FileStats
+{
+  std::uint64_t hits;
+  std::uint64_t misses;
+  std::uint64_t diskreads;
+  std::uint64_t diskwrites;
+  std::uint64_t evictions;
+
+  FileStats()
+		: hits(0), misses(0), diskreads(0), diskwrites(0), evictions(0)
+  {
+  }
+};
+
 /**
 * @brief Class to maintain statistics of buffer usage 
 */
 struct BufStats
 {
 	/**
-   * Total number of accesses to buffer pool
+   * Total number of page reads through the buffer pool
+	 */
+  std::atomic<int> accesses;
+
+	/**
+   * Number of those that found the page in the buffer pool, and that had to
+	 * read it from disk
+	 */
+  std::atomic<int> hits;
+  std::atomic<int> misses;
+
+	/**
+   * Number of hits that found the page still being read by another thread
+	 * and had to wait for it
 	 */
-  int accesses;
+  std::atomic<int> pinWaits;
+
+	/**
+   * Number of pages evicted to make room for others, split by whether they
+	 * had to be written back first
+	 */
+  std::atomic<int> cleanEvictions;
+  std::atomic<int> dirtyEvictions;
 
 	/**
    * Number of pages read from disk (including allocs)
 	 */
-  int diskreads;
+  std::atomic<int> diskreads;
 
 	/**
    * Number of pages written back to disk
 	 */
-  int diskwrites;
+  std::atomic<int> diskwrites;
+
+	/**
+   * Number of those pages written by the background writer
+	 */
+  std::atomic<int> bgwrites;
+
+	/**
+   * Number of pages read ahead by BufMgr::prefetchPages() (included in diskreads)
+	 */
+  std::atomic<int> prefetches;
+
+	/**
+   * Number of misses read back from the compressed victim cache instead of
+	 * from disk (not included in diskreads)
+	 */
+  std::atomic<int> victimHits;
+
+	/**
+   * Number of BufMgr::readOptimistic() calls that read the page without
+	 * pinning it, and of those that gave up and left the caller to pin it
+	 */
+  std::atomic<int> optimisticReads;
+  std::atomic<int> optimisticFallbacks;
+
+	/**
+   * Time taken by the reads of pages readPage() missed, and by every page write
+	 */
+  LatencyHistogram readLatency;
+  LatencyHistogram writeLatency;
 
 	/**
    * Clear all values 
 	 */
   void clear()
   {
-		accesses = diskreads = diskwrites = 0;
+		accesses = diskreads = diskwrites = bgwrites = prefetches = victimHits = 0;
+		hits = misses = pinWaits = cleanEvictions = dirtyEvictions = 0;
+		optimisticReads = optimisticFallbacks = 0;
+		readLatency.clear();
+		writeLatency.clear();
   }
       
 	/**
@@ -156,139 +326,1264 @@ struct BufStats
 
 
 /**
-* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+* @brief A pinned page in the buffer pool.
+*
+* Returned by BufMgr::fetchPage() and BufMgr::newPage(). The handle remembers
+* the frame the page is in, so dropping the pin, when the handle is released
+* or destroyed, does not have to look the page up again. Handles can be moved
+* but not copied; each one holds exactly one pin.
 */
-class BufMgr 
+class PageHandle
 {
- private:
+	friend class BufMgr;
+
+ public:
 	/**
-   * Current position of clockhand in our buffer pool
+   * Constructs a handle that holds no page
 	 */
-  FrameId clockHand;
+  PageHandle()
+		: bufMgr(NULL), frameNo(0), pageNum(Page::INVALID_NUMBER), page(NULL), dirty(false)
+  {
+  }
+
+  PageHandle(PageHandle&& other)
+		: bufMgr(other.bufMgr), frameNo(other.frameNo), pageNum(other.pageNum), page(other.page), dirty(other.dirty)
+  {
+		other.bufMgr = NULL;
+		other.page = NULL;
+  }
+
+  PageHandle& operator=(PageHandle&& other)
+  {
+		if (this != &other)
+		{
+			release();
+			bufMgr = other.bufMgr;
+			frameNo = other.frameNo;
+			pageNum = other.pageNum;
+			page = other.page;
+			dirty = other.dirty;
+			other.bufMgr = NULL;
+			other.page = NULL;
+		}
+		return *this;
+  }
+
+  PageHandle(const PageHandle&) = delete;
+  PageHandle& operator=(const PageHandle&) = delete;
 
 	/**
-   * Number of frames in the buffer pool
+   * Unpins the page, if the handle still holds one
 	 */
-  std::uint32_t numBufs;
-	
+  ~PageHandle()
+  {
+		release();
+  }
+
 	/**
-   * Hash table mapping (File, page) to frame
+   * Returns the pinned page, NULL if the handle holds none
 	 */
-  BufHashTbl *hashTable;
+  Page* get() const
+  {
+		return page;
+  }
+
+  Page* operator->() const
+  {
+		return page;
+  }
 
 	/**
-   * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
+   * True if the handle holds a page
 	 */
-  BufDesc *bufDescTable;
+  explicit operator bool() const
+  {
+		return page != NULL;
+  }
 
 	/**
-   * Maintains Buffer pool usage statistics 
+   * Returns the number of the page held
 	 */
-  BufStats bufStats;
+  PageId pageNo() const
+  {
+		return pageNum;
+  }
 
 	/**
-   * Advance clock to next frame in the buffer pool
+   * Have the page written back before its frame is reused
 	 */
-  void advanceClock()
+  void markDirty()
   {
-		clockHand = (clockHand + 1) % numBufs;
+		dirty = true;
   }
 
 	/**
-	 * Allocate a free frame.  
-	 *
-	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
-	 * @throws BufferExceededException If no such buffer is found which can be allocated
+   * Unpin the page now, leaving the handle empty
 	 */
-  void allocBuf(FrameId & frame);
+  void release();
+
+ private:
+  PageHandle(BufMgr* mgr, const FrameId frame, const PageId pageNo, Page* pagePtr)
+		: bufMgr(mgr), frameNo(frame), pageNum(pageNo), page(pagePtr), dirty(false)
+  {
+  }
 
- public:
 	/**
-   * Actual buffer pool from which frames are allocated
+   * Buffer manager the page is pinned in, NULL if the handle holds no page
 	 */
-  Page* bufPool;
+  BufMgr* bufMgr;
 
 	/**
-   * Constructor of BufMgr class
+   * Frame holding the page
 	 */
-  BufMgr(std::uint32_t bufs);
-	
+  FrameId frameNo;
+
 	/**
-   * Destructor of BufMgr class
+   * Page number of the page in its file
 	 */
-  ~BufMgr();
+  PageId pageNum;
 
 	/**
-	 * Reads the given page from the file into a frame and returns the pointer to page.
-	 * If the requested page is already present in the buffer pool pointer to that frame is returned
-	 * otherwise a new frame is allocated from the buffer pool for reading the page.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number in the file to be read
-	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+   * The page itself
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  Page* page;
 
 	/**
-	 * Unpin a page from memory since it is no longer required for it to remain in memory.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number
-	 * @param dirty		True if the page to be unpinned needs to be marked dirty	
-   * @throws  PageNotPinnedException If the page is not already pinned
+   * True if the page is to be unpinned dirty
 	 */
-  void unPinPage(File* file, const PageId PageNo, const bool dirty);
+  bool dirty;
+};
+
+
+/**
+* @brief A unit of work admitted to a buffer pool, such as a query, holding a
+* reservation of frames.
+*
+* Creating a client reserves frames for it, blocking while the reservations
+* of the clients already admitted leave too few frames in the pool, so work
+* that would run the pool out of frames waits its turn at admission instead
+* of failing with BufferExceededException halfway through. Frames pinned
+* outside any reservation (prefetches, the background writer, threads without
+* a client) are not handed out either. While it lives, the client counts the
+* pins taken and dropped by the thread that created it through readPage(),
+* fetchPage(), allocPage(), newPage(), unPinPage() and PageHandle. A client
+* still within its reservation that finds every frame pinned waits for one,
+* up to its timeout; pins beyond the reservation are counted, not refused,
+* and fail as they would without a client. Clients of one thread nest, the
+* newest one counting.
+*/
+class BufClient
+{
+	friend class BufMgr;
+	friend class PageHandle;
 
+ public:
 	/**
-	 * Allocates a new, empty page in the file and returns the Page object.
-	 * The newly allocated page is also assigned a frame in the buffer pool.
+   * Admits a client, waiting until frames can be reserved for it.
 	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
-	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 * @param bufMgr   	Buffer pool to reserve frames in
+	 * @param frames   	Number of frames to reserve
+	 * @param timeout  	Longest time to wait, at admission and for a frame later on; the default waits for as long as it takes
+   * @throws  BufferExceededException If the pool has fewer than frames frames, or the timeout passed
 	 */
-  void allocPage(File* file, PageId &PageNo, Page*& page); 
+  BufClient(BufMgr* bufMgr, const std::uint32_t frames,
+            const std::chrono::milliseconds timeout = std::chrono::milliseconds::max());
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
-	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
-	 * Otherwise Error returned.
-	 *
-	 * @param file   	File object
-   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
-   * @throws BadBufferException If any frame allocated to the file is found to be invalid
+   * Releases the reservation. Pins still counted stay with the pages.
 	 */
-  void flushFile(const File* file);
+  ~BufClient();
 
 	/**
-	 * Delete page from file and also from buffer pool if present.
-	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number
+   * Number of frames reserved
 	 */
-  void disposePage(File* file, const PageId PageNo);
+  std::uint32_t reservedFrames() const
+  {
+    return frames;
+  }
 
 	/**
-   * Print member variable values. 
+   * Number of pins the client holds now, and the most it held at once
 	 */
-  void  printSelf();
+  int pins() const
+  {
+    return pinCount;
+  }
+  int peakPins() const
+  {
+    return peak;
+  }
+
+ private:
+  BufClient(const BufClient&);
+  BufClient& operator=(const BufClient&);
 
 	/**
-   * Get buffer pool usage statistics
+   * Count a pin taken or dropped
 	 */
-  BufStats & getBufStats()
+  void countPin(const int delta);
+
+	/**
+   * The calling thread's newest client of the given pool, NULL if none
+	 */
+  static BufClient* current(const BufMgr* bufMgr);
+
+  BufMgr* bufMgr;
+  const std::uint32_t frames;
+
+	/**
+   * Longest time to wait for admission, and for a frame while within the
+	 * reservation
+	 */
+  const std::chrono::milliseconds timeout;
+
+  std::atomic<int> pinCount;
+  std::atomic<int> peak;
+
+	/**
+   * Client of the thread that was current before this one
+	 */
+  BufClient* previous;
+
+	/**
+   * Newest client of the calling thread
+	 */
+  static thread_local BufClient* newest;
+};
+
+/**
+* Continuation of BufMgr::readPageAsync(). Gets the pinned page, which it may
+* move out of the handle to keep, or an empty handle and the error the read
+* failed with.
+*/
+typedef std::function<void(PageHandle& page, std::exception_ptr error)> PageCallback;
+
+
+/**
+* @brief Settings of the background writer, see BufMgr::startBgWriter()
+*/
+struct BgWriterConfig
+{
+	/**
+   * Time the writer sleeps between two rounds
+	 */
+  std::chrono::milliseconds interval;
+
+	/**
+   * Most pages written in one round
+	 */
+  std::uint32_t maxPagesPerRound;
+
+	/**
+   * Number of frames, in the order the replacement policy will evict them,
+	 * that every round makes sure are clean
+	 */
+  std::uint32_t lookahead;
+
+	/**
+   * Fractions of the pool. When more than highWatermark of the frames are
+	 * dirty, a round keeps writing past the lookahead until no more than
+	 * lowWatermark are.
+	 */
+  double highWatermark;
+  double lowWatermark;
+
+	/**
+   * If not empty, the writer also saves the resident set (see
+	 * BufMgr::saveResidentSet()) to this file every residentSetInterval, and
+	 * once more when it is stopped
+	 */
+  std::string residentSetPath;
+  std::chrono::milliseconds residentSetInterval;
+
+	/**
+   * Constructor of BgWriterConfig class, with the default settings
+	 */
+  BgWriterConfig()
+		: interval(100), maxPagesPerRound(64), lookahead(32), highWatermark(0.5), lowWatermark(0.25),
+		  residentSetInterval(60000)
   {
-		return bufStats;
   }
+};
+
+
+/**
+* @brief A small private set of frames a sequential scan cycles through, so
+* that reading a large file does not push every other page out of the pool.
+*
+* On a miss, readPage() reuses the frame the ring filled longest ago if it is
+* unpinned and still holds the page the ring put there; otherwise it allocates
+* a frame as usual and adds it to the ring.  Pages already in the pool are
+* pinned as usual and do not join the ring.  A ring must only be used by one
+* thread at a time.
+*/
+class BufferRing
+{
+	friend class BufMgr;
+
+ public:
+	/**
+   * Number of frames in a ring unless asked otherwise
+	 */
+  static const std::uint32_t DEFAULT_SIZE = 16;
 
 	/**
-   * Clear buffer pool usage statistics
+   * Constructor of BufferRing class
+	 *
+	 * @param size   	Number of frames the ring cycles through
 	 */
-  void clearBufStats() 
+  BufferRing(std::uint32_t size = DEFAULT_SIZE)
+		: slots(size > 0 ? size : 1), next(0)
   {
-		bufStats.clear();
+		for (std::size_t i = 0; i < slots.size(); i++)
+			slots[i].used = false;
   }
+
+ private:
+	/**
+   * Frame the ring filled and the page it put there
+	 */
+  struct ringSlot
+	{
+		bool used;
+		FrameId frameNo;
+		const File* file;
+		PageId pageNo;
+	};
+
+  std::vector<ringSlot> slots;
+
+	/**
+   * Slot to be refilled next, the one filled longest ago
+	 */
+  std::uint32_t next;
+};
+
+
+/**
+* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* All public methods may be called concurrently.  A page hit only takes the
+* latch of the hash table partition the page lives in; a miss additionally
+* claims the frame the replacement policy picks, skipping frames whose latch
+* is held by another thread instead of waiting for it.
+*/
+class BufMgr 
+{
+	friend class PageHandle;
+	friend class BufClient;
+
+ private:
+	/**
+   * Number of frames in the buffer pool. Only changes in resize(), which holds
+	 * every hash table partition latch while it does.
+	 */
+  std::atomic<std::uint32_t> numBufs;
+
+	/**
+   * Serializes calls to resize()
+	 */
+  std::mutex resizeLatch;
+
+	/**
+   * Incremented when resize() starts and when it ends, so it is odd while one runs
+	 */
+  std::atomic<std::uint32_t> resizes;
+
+	/**
+   * Number of frames with a pin count above zero, kept in step by pinFrame(),
+	 * dropFramePin() and clearFrame(). A miss finding every frame pinned fails at
+	 * once instead of sweeping the pool for a victim.
+	 */
+  std::atomic<std::uint32_t> pinnedFrames;
+
+	/**
+   * Frames reserved by the BufClients admitted, guarded by admissionLatch.
+	 * admissionOpen is signalled when a client leaves, the pool grows, or, while
+	 * frameWaiters is above zero, a frame is unpinned.
+	 */
+  std::uint32_t reservedFrames;
+  std::mutex admissionLatch;
+  std::condition_variable admissionOpen;
+  std::atomic<int> frameWaiters;
+
+	/**
+   * Pins BufClients hold within their reservations. Pinned frames beyond these
+	 * are taken from the frames nobody reserved.
+	 */
+  std::atomic<std::uint32_t> reservedPinned;
+	
+	/**
+   * Hash table mapping (File, page) to frame
+	 */
+  BufHashTbl *hashTable;
+
+	/**
+   * Frames holding the pages of each file, by page number, guarded by
+	 * residentLatch. Kept in step with the hash table so that flushing a file
+	 * visits only its own pages, in page order.
+	 */
+  std::map<const File*, std::map<PageId, FrameId> > residentFrames;
+  std::mutex residentLatch;
+
+	/**
+   * Decides which frame to reuse when a page has to be brought in
+	 */
+  ReplacementPolicy *policy;
+
+	/**
+   * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool).
+	 * It never shrinks, so a thread holding the number of a frame dropped by resize() can still latch it and see that it is gone.
+	 */
+  FrameArray<BufDesc> bufDescTable;
+
+	/**
+   * Maintains Buffer pool usage statistics 
+	 */
+  BufStats bufStats;
+
+	/**
+   * Clean pages evicted from the pool, compressed, see setVictimCacheSize()
+	 */
+  CompressedVictimCache victimCache;
+
+	/**
+   * Latch and condition variable used to wait for reads into frames
+	 */
+  std::mutex ioLatch;
+  std::condition_variable ioDone;
+
+	/**
+   * Continuation of a readPageAsync() that found its page still being read by
+	 * another request
+	 */
+  struct ioWaiter
+	{
+		File* file;
+		PageId pageNo;
+		AsyncExecutor* executor;
+		PageCallback done;
+		AccessHint hint;
+	};
+
+	/**
+   * Continuations waiting for the read into a frame, guarded by ioLatch and
+	 * handed to their executors by finishIo()
+	 */
+  std::map<FrameId, std::vector<ioWaiter> > ioWaiters;
+
+	/**
+   * Background writer thread, its settings and what it waits on between rounds
+	 */
+  std::thread bgWriter;
+  BgWriterConfig bgConfig;
+  std::mutex bgLatch;
+  std::condition_variable bgWake;
+  bool bgStop;
+
+	/**
+   * Read of a prefetched page waiting for an I/O thread. A read issued by
+	 * readPageAsync() also names the executor to hand the page to and the
+	 * continuation to run there; a prefetch leaves executor NULL.
+	 */
+  struct prefetchRequest
+	{
+		File* file;
+		PageId pageNo;
+		FrameId frameNo;
+		AsyncExecutor* executor;
+		PageCallback done;
+	};
+
+	/**
+   * Number of I/O threads prefetchPages() starts
+	 */
+  static const int NUM_IO_THREADS = 2;
+
+	/**
+   * Most reads an I/O thread takes from the queue at once, and most pages
+	 * written back in one batch
+	 */
+  static const std::size_t IO_BATCH = 32;
+
+	/**
+   * Engine running batched reads and writes, set up by the first batch, see
+	 * setIoEngine()
+	 */
+  IoEngine* ioEngine;
+  IoEngineType ioEngineType;
+  std::mutex ioEngineLatch;
+
+	/**
+   * I/O threads, their queue, and the number of queued or running reads per
+	 * file, all guarded by prefetchLatch
+	 */
+  std::vector<std::thread> ioThreads;
+  std::deque<prefetchRequest> prefetchQueue;
+  std::uint32_t prefetchesInFlight;
+  std::map<const File*, int> pendingPrefetches;
+  std::mutex prefetchLatch;
+
+	/**
+   * Statistics of every file that has had pages in the pool, by file name,
+	 * guarded by statsLatch. Hits are only added here when a page leaves its
+	 * frame, see BufDesc::hits.
+	 */
+  std::map<std::string, FileStats> fileStats;
+  std::mutex statsLatch;
+  std::condition_variable prefetchQueued;
+  std::condition_variable prefetchDone;
+  bool ioStop;
+
+	/**
+	 * Record that the page now lives in the frame. Called with the page's
+	 * hash table partition latch held, right after inserting it there.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number
+	 * @param frame   Frame holding the page
+	 */
+  void addResident(const File* file, const PageId pageNo, const FrameId frame);
+
+	/**
+	 * Forget the frame of the page. Called with the page's hash table
+	 * partition latch held, right after removing it there.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number
+	 */
+  void removeResident(const File* file, const PageId pageNo);
+
+	/**
+	 * Snapshot of the pages of a file in the buffer pool.
+	 *
+	 * @param file   	File object
+	 * @param pages   (page number, frame) pairs in ascending page order returned via this vector
+	 */
+  void residentPages(const File* file, std::vector<std::pair<PageId, FrameId> > & pages);
+
+	/**
+	 * Remove all pages of the file from the buffer pool, in ascending page
+	 * order, writing dirty ones first if asked to.
+	 *
+	 * @param file   	    File object
+	 * @param writeDirty  Write dirty pages back before dropping them
+   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
+	 */
+  void dropFilePages(const File* file, const bool writeDirty);
+
+	/**
+	 * Add to one of the statistics of a file.
+	 *
+	 * @param file   	File object
+	 * @param counter Counter to add to
+	 * @param n       Amount to add
+	 */
+  void countFileStat(const File* file, std::uint64_t FileStats::*counter, const std::uint64_t n = 1);
+
+	/**
+	 * Add the hits on the page in a frame to its file's statistics, before the
+	 * page leaves the frame. Called with the frame latch held.
+	 *
+	 * @param tmpbuf 	Descriptor of the frame
+	 */
+  void retireHits(BufDesc* tmpbuf);
+
+	/**
+	 * Write the page in a frame back to its file, counting and timing the write.
+	 * The caller keeps the frame from changing hands.
+	 *
+	 * @param tmpbuf 	Descriptor of the frame
+	 */
+  void writeFrame(BufDesc* tmpbuf);
+
+	/**
+	 * Write back the dirty, unpinned pages in the given frames, leaving them in
+	 * the pool. The pages are written IO_BATCH at a time, one batch per file,
+	 * with the frame latches held; frames are latched in ascending order.
+	 *
+	 * @param frames  	Frames to write back
+	 * @param wait    	Wait for frame latches held elsewhere, rather than skip those frames
+	 * @param files   	If not NULL, the files written to are added to this vector
+	 * @return  			Number of pages written
+	 * @throws  The first error of a write if wait is true; pages that failed stay dirty
+	 */
+  std::uint32_t writeFrames(std::vector<FrameId> frames, const bool wait,
+                            std::vector<File*>* files = NULL);
+
+	/**
+	 * The I/O engine, set up on first use.
+	 */
+  IoEngine& engine();
+
+	/**
+	 * Read the pages of a batch of queued requests into their frames, one
+	 * batch through the I/O engine per file, and complete the requests.
+	 *
+	 * @param batch  	Requests taken off the queue
+	 */
+  void readBatch(const std::vector<prefetchRequest> & batch);
+
+	/**
+	 * Body of the I/O threads.
+	 */
+  void ioThreadLoop();
+
+	/**
+	 * Hand a read to the I/O threads, starting them if needed.
+	 */
+  void queueRead(const prefetchRequest & request);
+
+	/**
+	 * Wait until no prefetched page of the file is waiting for or being read.
+	 *
+	 * @param file   	File object
+	 */
+  void waitForPrefetches(const File* file);
+
+	/**
+	 * Drop a pin taken by this class on behalf of no caller.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param frame   	Frame holding the page
+	 */
+  void dropPin(const File* file, const PageId pageNo, const FrameId frame);
+
+	/**
+	 * Make a frame just filled for a ring the ring's newest frame.
+	 *
+	 * @param ring   	Ring the frame was allocated for
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param frame   	Frame holding the page
+	 */
+  void addToRing(BufferRing & ring, const File* file, const PageId pageNo, const FrameId frame);
+
+	/**
+	 * Body of the background writer thread.
+	 */
+  void bgWriterLoop();
+
+	/**
+	 * Save the resident set to the path the background writer was configured with,
+	 * ignoring errors.
+	 */
+  void saveResidentSetQuietly();
+
+	/**
+	 * One round of the background writer, see BgWriterConfig.
+	 *
+	 * @return  			Number of pages written
+	 */
+  std::uint32_t bgWriterRound();
+
+	/**
+	 * Allocate a free frame.  The frame is returned invalid and with a pin count
+	 * of one, so no other thread can claim it until the caller either installs a
+	 * page in it or hands it back with releaseBuf().
+	 *
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param wait   		True to wait for a frame, rather than fail, if the calling
+	 * 								thread's BufClient is still within its reservation
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  void allocBuf(FrameId & frame, const bool wait = false);
+
+	/**
+	 * Allocate the next frame of a ring, see BufferRing.
+	 *
+	 * @param ring   	Ring of the scan
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @return  			False if the ring has no frame that can be reused right now
+	 */
+  bool allocRingBuf(BufferRing & ring, FrameId & frame);
+
+	/**
+	 * Pin the page, reading it into a frame first if it is not in the pool.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param ring  	If not NULL, a miss reuses the frames of this ring
+	 * @param hint  	How the page is expected to be used, passed to the policy
+	 * @return  			Frame holding the page
+	 */
+  FrameId fetchFrame(File* file, const PageId pageNo, BufferRing* ring, const AccessHint hint);
+
+	/**
+	 * Allocate a new page in the file and pin it in a frame.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number of the new page returned via this variable
+	 * @return  			Frame holding the page
+	 */
+  FrameId allocFrame(File* file, PageId & pageNo);
+
+	/**
+	 * Pin a frame, or drop a pin, counting frames going from unpinned to pinned
+	 * and back in pinnedFrames
+	 */
+  void pinFrame(BufDesc* tmpbuf)
+  {
+		if (tmpbuf->pinCnt++ == 0)
+			pinnedFrames++;
+  }
+  void dropFramePin(BufDesc* tmpbuf)
+  {
+		if (--tmpbuf->pinCnt == 0)
+			frameUnpinned();
+  }
+
+	/**
+	 * BufDesc::Clear(), leaving pinnedFrames in step if the frame was pinned
+	 */
+  void clearFrame(BufDesc* tmpbuf)
+  {
+		if (tmpbuf->pinCnt > 0)
+			frameUnpinned();
+		tmpbuf->Clear();
+  }
+
+	/**
+	 * Count a frame that is no longer pinned, waking threads waiting for one.
+	 */
+  void frameUnpinned()
+  {
+		pinnedFrames--;
+		if (frameWaiters > 0)
+		{
+			std::lock_guard<std::mutex> admissionGuard(admissionLatch);
+			admissionOpen.notify_all();
+		}
+  }
+
+	/**
+	 * Wait until some frame is not pinned, for a client still within its
+	 * reservation that found the pool full.
+	 *
+	 * @param deadline   	Time to give up at
+	 * @return  False if the deadline passed first
+	 */
+  bool waitForUnpin(const std::chrono::steady_clock::time_point deadline);
+
+	/**
+	 * Reserve frames for a BufClient, waiting until the pool has them: frames
+	 * neither reserved nor pinned outside a reservation.
+	 *
+   * @throws  BufferExceededException If the pool has fewer than frames frames, or the timeout passed
+	 */
+  void reserveFrames(const std::uint32_t frames, const std::chrono::milliseconds timeout);
+
+	/**
+	 * Give back frames reserved by reserveFrames().
+	 */
+  void releaseFrames(const std::uint32_t frames);
+
+	/**
+	 * Drop a pin taken through a PageHandle. Needs no latch, see BufDesc.
+	 *
+	 * @param frame   	Frame holding the page
+	 * @param dirty		True if the page needs to be marked dirty
+	 */
+  void unPinFrame(const FrameId frame, const bool dirty)
+  {
+		if (dirty)
+		{
+			bufDescTable[frame].dirty = true;
+			bufDescTable[frame].version++;
+		}
+		dropFramePin(&bufDescTable[frame]);
+  }
+
+	/**
+	 * Body of resize(), called with resizeLatch held.
+	 *
+	 * @param newFrames  New number of frames
+	 */
+  void resizeFrames(const std::uint32_t newFrames);
+
+	/**
+	 * Try to take a frame picked by the replacement policy for a new page. Writes the
+	 * old page back if it is dirty and removes it from the hash table.
+	 *
+	 * @param frame   	Frame to claim
+	 * @param ringFile	If not NULL, only claim the frame if it is free or holds
+	 *                (ringFile, ringPageNo), and do not let the policy remember
+	 *                the page as evicted
+	 * @param ringPageNo	Page the ring put in the frame
+	 * @return  			True if the frame was claimed
+	 */
+  bool claimBuf(const FrameId frame, const File* ringFile = NULL, const PageId ringPageNo = 0);
+
+	/**
+	 * Hand back a frame obtained from allocBuf() without installing a page in it.
+	 *
+	 * @param frame   	Frame to release
+	 */
+  void releaseBuf(const FrameId frame);
+
+	/**
+	 * Install (file, pageNo) in a frame obtained from allocBuf(), pin it and
+	 * mark it as being read; the caller reads the page and then calls
+	 * finishIo() or abortIo(). If another thread installed the same page in the
+	 * meantime, the frame is released and that thread's frame is pinned instead.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param frame   	Frame for the page, replaced by the frame actually used
+	 * @param hint  	How the page is expected to be used, passed to the policy
+	 * @return  			True if the page was installed in the caller's frame
+	 */
+  bool installPage(File* file, const PageId pageNo, FrameId & frame, const AccessHint hint);
+
+	/**
+	 * Mark the read into a frame installed by installPage() as done, wake up
+	 * the threads waiting for it and hand the readPageAsync() continuations
+	 * waiting for it to their executors.
+	 *
+	 * @param frame   	Frame the page was read into
+	 */
+  void finishIo(const FrameId frame);
+
+	/**
+	 * Undo installPage() after the read into the frame failed.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param frame   	Frame the page was to be read into
+	 */
+  void abortIo(File* file, const PageId pageNo, const FrameId frame);
+
+	/**
+	 * Wait until a pinned frame is no longer being read into.
+	 *
+	 * @param frame   	Pinned frame
+	 * @return  			True if the frame holds the page, false if the read failed
+	 *                and the pin has been dropped
+	 */
+  bool waitForIo(const FrameId frame);
+
+	/**
+	 * Complete a readPageAsync() whose pinned frame is no longer being read
+	 * into: hand the page to done, or read it again if the read failed.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param frame   	Pinned frame
+	 * @param executor	Executor the continuation runs on
+	 * @param done  	Continuation, gets the pinned page or the error
+	 * @param hint  	How the page is expected to be used, passed to the policy
+	 */
+  void completeRead(File* file, const PageId pageNo, const FrameId frame, AsyncExecutor & executor,
+                    PageCallback done, const AccessHint hint);
+
+	/**
+   * Number of times readOptimistic() tries to read a page before giving up
+	 */
+  static const int OPTIMISTIC_ATTEMPTS = 3;
+
+	/**
+   * Every this many optimistic reads by the threads of a reader slot, the
+	 * page read is reported to the replacement policy, so pages only ever read
+	 * optimistically are not taken for cold ones
+	 */
+  static const int TOUCH_INTERVAL = 64;
+
+	/**
+   * Optimistic readers running and reads done by the threads assigned to a
+	 * slot. Each slot fills a cache line of its own, so readers on different
+	 * threads write to different lines. resize() waits for every slot to have
+	 * no reader running before it frees the memory of frames.
+	 */
+  struct ReaderSlot
+  {
+    std::atomic<int> active;
+    std::atomic<int> reads;
+    char padding[64 - 2 * sizeof(std::atomic<int>)];
+  };
+  static const int NUM_READER_SLOTS = 64;
+  ReaderSlot readerSlots[NUM_READER_SLOTS];
+
+	/**
+   * An optimistic read in progress: the frame read, its version when the
+	 * read started and the reader slot of the thread
+	 */
+  struct OptimisticRead
+  {
+    FrameId frame;
+    std::uint64_t version;
+    std::uint32_t slot;
+  };
+
+	/**
+   * Start an optimistic read of a page, in the frame read.frame if it still
+	 * holds it, otherwise in the frame the hash table names. On success the
+	 * reader is counted as active in its slot until endOptimistic().
+	 *
+	 * @return  			The page, or NULL if it is not resident or its frame is pinned
+	 *                or being read into
+	 */
+  const Page* beginOptimistic(File* file, const PageId pageNo, OptimisticRead & read);
+
+	/**
+   * Check that the frame was neither pinned nor changed since beginOptimistic(),
+	 * and end the read.
+	 *
+	 * @return  			True if what was read is a consistent copy of the page
+	 */
+  bool endOptimistic(File* file, const PageId pageNo, const OptimisticRead & read, const AccessHint hint);
+
+	/**
+   * Take the version of a frame and check that it holds the page, unpinned
+	 * and readable. The fields are read without a latch; the version taken
+	 * first tells endOptimistic() whether they changed.
+	 */
+  bool frameHolds(OptimisticRead & read, const File* file, const PageId pageNo);
+
+	/**
+   * Report an access to a resident page to the replacement policy, pinning
+	 * it for the duration like a hit does.
+	 */
+  void touchPage(File* file, const PageId pageNo, const AccessHint hint);
+
+ public:
+	/**
+   * Actual buffer pool from which frames are allocated
+	 */
+  FrameArray<Page> bufPool;
+
+	/**
+   * Constructor of BufMgr class
+	 *
+	 * @param bufs   	Number of frames in the buffer pool
+	 * @param policyType	Page replacement policy to use
+	 */
+  BufMgr(std::uint32_t bufs, ReplacementPolicyType policyType = CLOCK);
+	
+	/**
+   * Destructor of BufMgr class
+	 */
+  ~BufMgr();
+
+	/**
+	 * Reads the given page from the file into a frame and returns the pointer to page.
+	 * If the requested page is already present in the buffer pool pointer to that frame is returned
+	 * otherwise a new frame is allocated from the buffer pool for reading the page.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param ring  	If not NULL, a miss reuses the frames of this ring rather than evicting other pages
+	 * @param hint  	How the page is expected to be used: HOT_INDEX_INTERNAL pages are kept
+	 *                longer and SCAN_ONCE pages are evicted sooner by the replacement policy
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, BufferRing* ring = NULL, const AccessHint hint = NORMAL);
+
+	/**
+	 * Same as readPage(), but returns a handle that unpins the page when it is
+	 * released or goes out of scope.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param ring  	If not NULL, a miss reuses the frames of this ring rather than evicting other pages
+	 * @param hint  	How the page is expected to be used, see readPage()
+	 * @return  			Handle holding the pinned page
+	 */
+  PageHandle fetchPage(File* file, const PageId PageNo, BufferRing* ring = NULL, const AccessHint hint = NORMAL);
+
+	/**
+	 * Runs reader on a resident page without pinning it. The page may change
+	 * while reader looks at it; afterwards the frame's version tells whether
+	 * it did, in which case the read is retried. reader must therefore cope
+	 * with a torn page (never index past its arrays, never loop on what it
+	 * reads) and must only keep what it computed once readOptimistic() returns
+	 * true. An exception thrown by reader is passed on only if the page was
+	 * intact.
+	 *
+	 * Only pages nobody has pinned are read this way, since a thread holding a
+	 * pin may be writing to the page without having said so yet. Pages not in
+	 * the pool are not read in.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file to be read
+	 * @param frameHint	Frame the page was found in last time, tried before the
+	 *                hash table; updated to the frame it was found in
+	 * @param reader  Called as reader(const Page&), possibly several times
+	 * @param hint  	How the page is used, passed to the replacement policy
+	 * @return  			False if the page could not be read this way and should be
+	 *                read through readPage() or fetchPage() instead
+	 */
+  template <class Reader>
+  bool readOptimistic(File* file, const PageId pageNo, FrameId & frameHint, Reader reader, const AccessHint hint = NORMAL)
+  {
+    for (int attempt = 0; attempt < OPTIMISTIC_ATTEMPTS; attempt++)
+    {
+      OptimisticRead read;
+      read.frame = frameHint;
+      const Page* page = beginOptimistic(file, pageNo, read);
+      if (page == NULL)
+        break;
+      frameHint = read.frame;
+      try
+      {
+        reader(*page);
+      }
+      catch(...)
+      {
+        // a torn page may well make the reader fail
+        if (endOptimistic(file, pageNo, read, hint))
+          throw;
+        continue;
+      }
+      if (endOptimistic(file, pageNo, read, hint))
+        return true;
+    }
+    bufStats.optimisticFallbacks++;
+    return false;
+  }
+
+	/**
+	 * Unpin a page from memory since it is no longer required for it to remain in memory.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 * @param dirty		True if the page to be unpinned needs to be marked dirty	
+   * @throws  PageNotPinnedException If the page is not already pinned
+   * @throws  HashNotFoundException If the page is not in the buffer pool
+	 */
+  void unPinPage(File* file, const PageId PageNo, const bool dirty);
+
+	/**
+	 * Starts reading pages that will be needed soon into the buffer pool, on
+	 * background I/O threads. The pages are left unpinned; a readPage() of one
+	 * that is still being read waits for that read instead of issuing its own.
+	 * Pages already in the pool are skipped. This is only a hint: once a
+	 * quarter of the pool is pinned by prefetches still being read, or no frame
+	 * can be had, the remaining pages are not prefetched, and read errors are
+	 * left for the readPage() that needs the page to report.
+	 *
+	 * @param file   	File object
+	 * @param pageNos Page numbers in the file to be read
+	 * @param ring  	If not NULL, frames are taken from this ring as in readPage()
+	 */
+  void prefetchPages(File* file, const std::vector<PageId> & pageNos, BufferRing* ring = NULL);
+
+	/**
+	 * Reads a page without waiting for it: the page is pinned and handed to
+	 * done, which runs on the thread driving executor once the page is in the
+	 * pool. A hit completes at once; a miss takes a frame on the calling thread
+	 * (writing back its old page if dirty) and leaves the read to the I/O
+	 * threads, so a single thread can have many reads in flight. done gets an
+	 * empty handle and the error if the read fails. A page another request is
+	 * still reading completes when that read does, without blocking the
+	 * executor.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file to be read
+	 * @param executor	Executor the continuation runs on
+	 * @param done  	Continuation, gets the pinned page or the error
+	 * @param ring  	If not NULL, a miss reuses the frames of this ring, see readPage()
+	 * @param hint  	How the page is expected to be used, see readPage()
+	 */
+  void readPageAsync(File* file, const PageId pageNo, AsyncExecutor & executor, PageCallback done,
+                     BufferRing* ring = NULL, const AccessHint hint = NORMAL);
+
+	/**
+	 * Allocates a new, empty page in the file and returns the Page object.
+	 * The newly allocated page is also assigned a frame in the buffer pool.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 */
+  void allocPage(File* file, PageId &PageNo, Page*& page); 
+
+	/**
+	 * Same as allocPage(), but returns a handle that unpins the page when it is
+	 * released or goes out of scope.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @return  			Handle holding the pinned page
+	 */
+  PageHandle newPage(File* file, PageId &PageNo);
+
+	/**
+	 * Writes out all dirty pages of the file to disk, in ascending page order, and removes the file's pages from the buffer pool.
+	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
+	 * Otherwise Error returned. Only the file's own pages are visited. The file is then
+	 * flushed to disk with File::flush().
+	 *
+	 * @param file   	File object
+   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
+	 */
+  void flushFile(const File* file);
+
+	/**
+	 * Writes out all dirty, unpinned pages in the buffer pool, file by file in ascending page order,
+	 * and flushes every file written to disk. The pages stay in the buffer pool.
+	 */
+  void flushAll();
+
+	/**
+	 * Removes all pages of the file from the buffer pool without writing them back,
+	 * for a file whose contents are no longer needed (e.g. one about to be deleted).
+	 *
+	 * @param file   	File object
+   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
+	 */
+  void evictFile(const File* file);
+
+	/**
+	 * Delete page from file and also from buffer pool if present.
+	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
+	 * The page does not have to be in the buffer pool.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 * @throws  PagePinnedException If the page is in the buffer pool and pinned
+	 */
+  void disposePage(File* file, const PageId PageNo);
+
+	/**
+	 * Changes the number of frames in the buffer pool while it is in use. Growing
+	 * adds free frames. Shrinking drops the frames numbered newFrames and up,
+	 * writing back their dirty pages; it fails if one of them is pinned.
+	 * Pinned pages never move, and the hash table is resized to match.
+	 *
+	 * @param newFrames  New number of frames, at least 1
+   * @throws  PagePinnedException If a frame that would be dropped is pinned. The pool keeps its old size.
+   * @throws  BufferExceededException If newFrames is fewer than the frames reserved by BufClients
+   * @throws  std::length_error If newFrames is larger than FrameArray<Page>::MAX_SIZE
+	 */
+  void resize(const std::uint32_t newFrames);
+
+	/**
+	 * Sets the size of the compressed victim cache, which keeps clean pages
+	 * evicted from the pool so that a later miss on them decompresses the page
+	 * instead of reading it from disk. Pages evicted from buffer rings are not
+	 * kept. 0, the default, disables the cache.
+	 *
+	 * @param bytes  Memory the cache may use
+	 */
+  void setVictimCacheSize(const std::size_t bytes);
+
+	/**
+	 * Chooses the engine prefetch reads, background writes and flushes are
+	 * batched through. The default, IO_ENGINE_AUTO, uses io_uring where the
+	 * kernel has it and a pool of threads otherwise. Call before the pool is
+	 * used, or while no I/O is going on.
+	 *
+	 * @param type   	Engine to use
+	 */
+  void setIoEngine(const IoEngineType type);
+
+	/**
+	 * Returns the name of the engine in use, see IoEngine::name(), or "none"
+	 * if no batched read or write has set one up yet.
+	 */
+  const char* ioEngineName();
+
+	/**
+	 * Returns the number of pages in the victim cache and the memory they take.
+	 */
+  void getVictimCacheUsage(std::size_t& pages, std::size_t& bytes)
+  {
+		victimCache.usage(pages, bytes);
+  }
+
+	/**
+	 * Saves the (file name, page number, hotness) of every page in the buffer pool
+	 * to a text file, so a restarted process can load them again with
+	 * loadResidentSet(). Hotness is the page's rank in the order the replacement
+	 * policy would evict it, 0 being the next victim. The file is replaced atomically.
+	 *
+	 * @param path   	File to save to
+   * @throws  FileNotFoundException If the file cannot be created
+	 */
+  void saveResidentSet(const std::string& path);
+
+	/**
+	 * Reads the pages listed by saveResidentSet() back into the buffer pool, the
+	 * hottest ones if they do not all fit. Each file's pages are read in page order,
+	 * in batches handed to the prefetch threads. The pages are then touched from
+	 * coldest to hottest, so the replacement policy ranks them as before.
+	 * Pages of files that are not given, or that no longer exist, are skipped.
+	 *
+	 * @param path   	File to load from
+	 * @param files   Open files whose pages may be loaded, matched by name
+	 * @return  			Number of pages in the buffer pool afterwards
+   * @throws  FileNotFoundException If the file cannot be opened
+	 */
+  std::uint32_t loadResidentSet(const std::string& path, const std::vector<File*>& files);
+
+	/**
+	 * Start a thread that writes dirty pages back ahead of the replacement
+	 * policy, so that evictions rarely have to write a page first. Restarts the
+	 * writer with the new settings if it is already running.
+	 *
+	 * @param config   	Settings of the writer
+	 */
+  void startBgWriter(const BgWriterConfig & config = BgWriterConfig());
+
+	/**
+	 * Stop the background writer, if running, and wait for it to finish its round.
+	 */
+  void stopBgWriter();
+
+	/**
+   * Print member variable values. 
+	 */
+  void  printSelf();
+
+	/**
+   * Statistics of every file that has had pages in the buffer pool.
+	 *
+	 * @param stats   Statistics by file name returned via this map, cleared first
+	 */
+  void getFileStats(std::map<std::string, FileStats> & stats);
+
+	/**
+   * Snapshot of all buffer pool statistics, including those of each file and
+	 * the latency histograms, as text or as a JSON object.
+	 *
+	 * @param json   	Format the snapshot as JSON instead of text
+	 * @return  			The snapshot
+	 */
+  std::string statsSnapshot(const bool json = false);
+
+	/**
+   * Returns the number of frames nobody has pinned, which a miss can evict.
+	 * Read without a latch, so only a snapshot.
+	 */
+  std::uint32_t freeFrames() const
+  {
+		const std::uint32_t frames = numBufs;
+		const std::uint32_t pinned = pinnedFrames;
+		return pinned < frames ? frames - pinned : 0;
+  }
+
+	/**
+   * Returns the number of frames reserved by the BufClients admitted.
+	 */
+  std::uint32_t getReservedFrames();
+
+	/**
+   * Get buffer pool usage statistics
+	 */
+  BufStats & getBufStats()
+  {
+		int reads = 0;
+		for (int i = 0; i < NUM_READER_SLOTS; i++)
+			reads += readerSlots[i].reads;
+		bufStats.optimisticReads = reads;
+		return bufStats;
+  }
+
+	/**
+   * Clear buffer pool usage statistics, including those of each file
+	 */
+  void clearBufStats();
 };
 
 }
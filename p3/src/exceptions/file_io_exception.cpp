@@ -0,0 +1,22 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "file_io_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+FileIOException::FileIOException(const std::string& nameIn, const std::string& reasonIn)
+    : BadgerDbException(""), name(nameIn) {
+  std::stringstream ss;
+  ss << "I/O on file " << name << " failed: " << reasonIn;
+  message_.assign(ss.str());
+}
+
+}
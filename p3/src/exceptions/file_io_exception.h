@@ -0,0 +1,37 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when reading, writing or syncing a file
+ * fails.
+ */
+class FileIOException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a file I/O exception for the given file.
+   *
+   * @param nameIn    Name of the file.
+   * @param reasonIn  What went wrong.
+   */
+  explicit FileIOException(const std::string& nameIn, const std::string& reasonIn);
+
+ protected:
+  /**
+   * Name of the file.
+   */
+  const std::string name;
+};
+
+}
@@ -0,0 +1,37 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a shared memory segment cannot be
+ * created, attached to or used.
+ */
+class SharedMemoryException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a shared memory exception for the given segment.
+   *
+   * @param nameIn    Name of the segment.
+   * @param reasonIn  What went wrong.
+   */
+  explicit SharedMemoryException(const std::string& nameIn, const std::string& reasonIn);
+
+ protected:
+  /**
+   * Name of the segment.
+   */
+  const std::string name;
+};
+
+}
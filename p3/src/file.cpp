@@ -11,10 +11,18 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
@@ -24,7 +32,17 @@
 namespace badgerdb {
 
 File::StreamMap File::open_streams_;
+File::LatchMap File::open_latches_;
 File::CountMap File::open_counts_;
+std::mutex File::registry_latch_;
+
+File::Descriptor::~Descriptor() {
+  // Errors cannot be reported from here; flush() first to see them.
+  if (header_dirty && pwrite(fd, &header, sizeof(FileHeader), 0) != sizeof(FileHeader)) {
+    std::cerr << "could not write back the file header" << std::endl;
+  }
+  ::close(fd);
+}
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -40,6 +58,7 @@ bool File::isOpen(const std::string& filename) {
   if (!exists(filename)) {
     return false;
   }
+  std::lock_guard<std::mutex> registry_guard(registry_latch_);
   return open_counts_.find(filename) != open_counts_.end();
 }
 
@@ -59,6 +78,19 @@ File::~File() {
 }
 
 
+void File::flush() const {
+  {
+    std::lock_guard<std::recursive_mutex> guard(*latch_);
+    if (stream_->header_dirty) {
+      writeAt(&stream_->header, sizeof(FileHeader), 0 /* offset */);
+      stream_->header_dirty = false;
+    }
+  }
+  if (fdatasync(stream_->fd) != 0) {
+    throw FileIOException(filename_, strerror(errno));
+  }
+}
+
 PageId File::getFirstPageNo() {
   const FileHeader& header = readHeader();
   return header.first_used_page;
@@ -69,19 +101,23 @@ File::File(const std::string& name, const bool create_new) : filename_(name) {
 
   if (create_new) {
     // File starts with 1 page (the header).
-    FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+    FileHeader header = {FILE_MAGIC, FILE_VERSION,
+                         1 /* num_pages */, 0 /* first_used_page */,
+                         0 /* num_free_pages */, 0 /* first_free_page */,
+                         0 /* last_used_page */, 0 /* first_map_page */,
+                         1 /* reserved_pages */};
     writeHeader(header);
   }
 }
 
 void File::openIfNeeded(const bool create_new) {
+  std::lock_guard<std::mutex> registry_guard(registry_latch_);
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
     stream_ = open_streams_[filename_];
+    latch_ = open_latches_[filename_];
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
+    int flags = O_RDWR;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
@@ -89,49 +125,173 @@ void File::openIfNeeded(const bool create_new) {
         throw FileExistsException(filename_);
       }
       // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
+      flags = flags | O_CREAT | O_TRUNC;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
+      upgradeIfNeeded(filename_);
+    }
+    const int fd = ::open(filename_.c_str(), flags, 0666);
+    if (fd < 0) {
+      throw FileIOException(filename_, strerror(errno));
     }
-    stream_.reset(new std::fstream(filename_, mode));
+    stream_.reset(new Descriptor(fd));
+    readAt(&stream_->header, sizeof(FileHeader), 0 /* offset */);
+    stream_->num_pages.store(stream_->header.num_pages, std::memory_order_release);
+    latch_.reset(new std::recursive_mutex());
     open_streams_[filename_] = stream_;
+    open_latches_[filename_] = latch_;
     open_counts_[filename_] = 1;
   }
 }
 
+void File::upgradeIfNeeded(const std::string& filename) {
+  const int in = ::open(filename.c_str(), O_RDONLY);
+  if (in < 0) {
+    throw FileIOException(filename, strerror(errno));
+  }
+  std::uint32_t magic[2] = {0, 0};
+  FileHeader header;
+  memset(&header, 0, sizeof(FileHeader));
+  off_t header_size = 0;
+  if (pread(in, magic, sizeof(magic), 0) == sizeof(magic) && magic[0] == FILE_MAGIC) {
+    // Version 2 had the current header up to reserved_pages.
+    header_size = offsetof(FileHeader, reserved_pages);
+    if (magic[1] >= FILE_VERSION ||
+        pread(in, &header, header_size, 0) != header_size) {
+      header_size = 0;
+    }
+  } else {
+    LegacyFileHeader legacy;
+    if (pread(in, &legacy, sizeof(legacy), 0) == sizeof(legacy)) {
+      header_size = sizeof(LegacyFileHeader);
+      header.num_pages = legacy.num_pages;
+      header.first_used_page = legacy.first_used_page;
+      header.num_free_pages = legacy.num_free_pages;
+      header.first_free_page = legacy.first_free_page;
+      header.last_used_page = Page::INVALID_NUMBER;
+      header.first_map_page = Page::INVALID_NUMBER;
+    }
+  }
+  if (header_size == 0) {
+    // In the current format, or too short to be a file in any.
+    ::close(in);
+    return;
+  }
+  header.magic = FILE_MAGIC;
+  header.version = FILE_VERSION;
+  header.reserved_pages = header.num_pages;
+
+  const std::string upgraded = filename + ".upgrade";
+  const int out = ::open(upgraded.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (out < 0) {
+    const int error = errno;
+    ::close(in);
+    throw FileIOException(upgraded, strerror(error));
+  }
+
+  bool ok = pwrite(out, &header, sizeof(header), 0) == sizeof(header);
+  std::vector<char> page(Page::SIZE);
+  for (PageId page_number = 1; ok && page_number < header.num_pages; page_number++) {
+    const off_t from = header_size + (off_t)(page_number - 1) * Page::SIZE;
+    const ssize_t got = pread(in, &page[0], Page::SIZE, from);
+    if (got < 0) {
+      ok = false;
+      break;
+    }
+    // Pages past the end of an old file read as zeroes, as they did.
+    memset(&page[got], 0, Page::SIZE - got);
+    ok = pwrite(out, &page[0], Page::SIZE, pagePosition(page_number)) == (ssize_t)Page::SIZE;
+  }
+  const int error = errno;
+  ok = ok && fsync(out) == 0;
+  ::close(in);
+  ::close(out);
+  if (!ok || rename(upgraded.c_str(), filename.c_str()) != 0) {
+    std::remove(upgraded.c_str());
+    throw FileIOException(filename, std::string("upgrade failed: ") + strerror(error));
+  }
+}
+
 void File::close() {
+  std::lock_guard<std::mutex> registry_guard(registry_latch_);
 	if(open_counts_[filename_] > 0)
   	--open_counts_[filename_];
 
   stream_.reset();
+  latch_.reset();
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
     open_streams_.erase(filename_);
+    open_latches_.erase(filename_);
     open_counts_.erase(filename_);
   }
 }
 
 FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
-  return header;
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  return stream_->header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  stream_->header = header;
+  stream_->header_dirty = true;
+  stream_->num_pages.store(header.num_pages, std::memory_order_release);
+}
+
+void File::readAt(void* buffer, const std::size_t size, const off_t offset) const {
+  char* to = static_cast<char*>(buffer);
+  std::size_t done = 0;
+  while (done < size) {
+    const ssize_t got = pread(stream_->fd, to + done, size - done, offset + done);
+    if (got < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, strerror(errno));
+    }
+    if (got == 0) {
+      // Past the end of the file.
+      memset(to + done, 0, size - done);
+      return;
+    }
+    done += got;
+  }
+}
+
+void File::writeAt(const void* buffer, const std::size_t size, const off_t offset) const {
+  const char* from = static_cast<const char*>(buffer);
+  std::size_t done = 0;
+  while (done < size) {
+    const ssize_t put = pwrite(stream_->fd, from + done, size - done, offset + done);
+    if (put < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, strerror(errno));
+    }
+    done += put;
+  }
 }
 
 
 
 
 
+void File::runBatch(std::vector<IoRequest>& requests, const std::vector<PageIo*>& pages,
+                    IoEngine& engine) const {
+  engine.run(requests.data(), requests.size());
+  for (std::size_t i = 0; i < requests.size(); i++) {
+    if (requests[i].error != 0) {
+      pages[i]->error = std::make_exception_ptr(FileIOException(filename_, strerror(requests[i].error)));
+    }
+  }
+}
+
 PageFile PageFile::create(const std::string& filename) {
   return PageFile(filename, true /* create_new */);
 }
@@ -143,6 +303,7 @@ PageFile PageFile::open(const std::string& filename) {
 PageFile::PageFile(const std::string& name, const bool create_new)
 : File(name, create_new)
 {
+  buildMapIfNeeded();
 }
 
 PageFile::~PageFile() {
@@ -151,6 +312,7 @@ PageFile::~PageFile() {
 PageFile::PageFile(const PageFile& other)
 : File(other.filename_, false /* create_new */)
 {
+  buildMapIfNeeded();
 }
 
 PageFile& PageFile::operator=(const PageFile& rhs) {
@@ -159,42 +321,41 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
   openIfNeeded(false /* create_new */);
+  buildMapIfNeeded();
   return *this;
 }
 
 Page PageFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
   Page new_page;
+  allocatePage(new_page_number, new_page);
+  return new_page;
+}
+
+void PageFile::allocatePage(PageId &new_page_number, Page& new_page) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FileHeader header = readHeader();
+  // Page whose next page number changes to point to the new page, if any.
   Page existing_page;
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
+    readPage(header.first_free_page, new_page, true /* allow_free */);
     new_page.set_page_number(header.first_free_page);
 		new_page_number = new_page.page_number();
     header.first_free_page = new_page.next_page_number();
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
+    // Link the page in after the closest used page before it, or at the head
+    // of the used list if there is none.
+    const PageId previous_page_number = previousUsed(header, new_page_number);
+    if (previous_page_number == Page::INVALID_NUMBER) {
+      new_page.set_next_page_number(header.first_used_page);
+      header.first_used_page = new_page_number;
     } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
+      readPage(previous_page_number, existing_page, true /* allow_free */);
+      new_page.set_next_page_number(existing_page.next_page_number());
+      existing_page.set_next_page_number(new_page_number);
+    }
+    if (new_page.next_page_number() == Page::INVALID_NUMBER) {
+      header.last_used_page = new_page_number;
     }
 
     assert((header.num_free_pages == 0) ==
@@ -202,28 +363,28 @@ Page PageFile::allocatePage(PageId &new_page_number) {
   }
 	else
 	{
-    new_page.set_page_number(header.num_pages);
+    // The first page of a range of the map comes before the pages it covers.
+    if (mapPosition(header, header.num_pages) < 0) {
+      addMapPages(header, header.num_pages / MAP_BITS);
+    }
+    new_page.initialize();
+    new_page.set_page_number(appendPage(header));
 		new_page_number = new_page.page_number();
 
-    if (header.first_used_page == Page::INVALID_NUMBER)
+    if (header.last_used_page == Page::INVALID_NUMBER)
 		{
       header.first_used_page = new_page.page_number();
     }
 		else
 		{
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
+      // Append the new page to the tail of the used list.
+      readPage(header.last_used_page, existing_page, true /* allow_free */);
       assert(existing_page.isUsed());
       existing_page.set_next_page_number(new_page.page_number());
     }
-    ++header.num_pages;
+    header.last_used_page = new_page_number;
   }
+  markUsed(header, new_page_number, true /* used */);
   writePage(new_page_number, new_page.header_, new_page);
   if (existing_page.page_number() != Page::INVALID_NUMBER) {
     // If we updated an existing page by inserting the new page into the
@@ -231,33 +392,30 @@ Page PageFile::allocatePage(PageId &new_page_number) {
     writePage(existing_page.page_number(), existing_page.header_, existing_page);
   }
   writeHeader(header);
-
-  return new_page;
 }
 
 Page PageFile::readPage(const PageId page_number) const {
-  FileHeader header = readHeader();
+  Page page;
+  readPage(page_number, page);
+  return page;
+}
 
-	if (page_number >= header.num_pages)
-	{
-		throw InvalidPageException(page_number, filename_);
-	}
-	return readPage(page_number, false /* allow_free */);
+void PageFile::readPage(const PageId page_number, Page& page) const {
+  // Not checked against numPages(): another process may have allocated the
+  // page since this one read the header.  Past the end of the file the page
+  // reads as zeroes, which is not a used page either.
+  readPage(page_number, page, false /* allow_free */);
 }
 
-Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
-  Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(&page.data_[0], Page::DATA_SIZE);
+void PageFile::readPage(const PageId page_number, Page& page, const bool allow_free) const {
+  readAt(&page, Page::SIZE, pagePosition(page_number));
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
 	PageHeader header = readPageHeader(new_page_number);
 	if (header.current_page_number == Page::INVALID_NUMBER)
 	{
@@ -274,29 +432,33 @@ void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
 }
 
 void PageFile::deletePage(const PageId page_number) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   FileHeader header = readHeader();
 
   Page existing_page = readPage(page_number);
+  if (!markedUsed(header, page_number)) {
+    // A page of the free-space map.
+    throw InvalidPageException(page_number, filename_);
+  }
   Page previous_page;
   // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
+  // the next page in line; otherwise update the used page before it.
+  const PageId previous_page_number = previousUsed(header, page_number);
+  if (previous_page_number == Page::INVALID_NUMBER) {
     header.first_used_page = existing_page.next_page_number();
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    readPage(previous_page_number, previous_page, true /* allow_free */);
+    previous_page.set_next_page_number(existing_page.next_page_number());
+  }
+  if (header.last_used_page == page_number) {
+    header.last_used_page = previous_page_number;
   }
   // Clear the page and add it to the head of the free list.
   existing_page.initialize();
   existing_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
   ++header.num_free_pages;
+  markUsed(header, page_number, false /* used */);
   if (previous_page.isUsed()) {
     writePage(previous_page.page_number(), previous_page.header_, previous_page);
   }
@@ -304,6 +466,225 @@ void PageFile::deletePage(const PageId page_number) {
   writeHeader(header);
 }
 
+PageId PageFile::appendPage(FileHeader& header) {
+  if (header.num_pages >= header.reserved_pages) {
+    // Set aside the rest of the extent the page is in.
+    const PageId extent_end = ((header.num_pages - 1) / EXTENT_PAGES + 1) * EXTENT_PAGES + 1;
+    const off_t position = pagePosition(header.num_pages);
+    const int error = posix_fallocate(stream_->fd, position, pagePosition(extent_end) - position);
+    if (error != 0 && error != EOPNOTSUPP) {
+      throw FileIOException(filename_, strerror(error));
+    }
+    header.reserved_pages = extent_end;
+  }
+  return header.num_pages++;
+}
+
+PageId PageFile::readExtent(const PageId page_number, std::vector<Page>& pages) const {
+  const PageId num_pages = numPages();
+  if (page_number == Page::INVALID_NUMBER || page_number >= num_pages) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  static_assert(sizeof(Page) == Page::SIZE, "pages are read as they are laid out on disk");
+  const PageId first = (page_number - 1) / EXTENT_PAGES * EXTENT_PAGES + 1;
+  pages.resize(std::min(first + EXTENT_PAGES, num_pages) - first);
+  readAt(&pages[0], pages.size() * Page::SIZE, pagePosition(first));
+  return first;
+}
+
+std::vector<PageId> PageFile::mapPages(const FileHeader& header, const PageId count) const {
+  std::vector<PageId> map_pages;
+  PageId map_page = header.first_map_page;
+  while (map_page != Page::INVALID_NUMBER && map_pages.size() < count) {
+    map_pages.push_back(map_page);
+    map_page = readPageHeader(map_page).next_page_number;
+  }
+  return map_pages;
+}
+
+PageId PageFile::addMapPages(FileHeader& header, const PageId index) {
+  std::vector<PageId> map_pages = mapPages(header, index + 1);
+  while (map_pages.size() <= index) {
+    Page map_page;
+    map_page.set_page_number(appendPage(header));
+    // No room for records.
+    map_page.header_.free_space_upper_bound = map_page.header_.free_space_lower_bound;
+    writePage(map_page.page_number(), map_page.header_, map_page);
+
+    if (map_pages.empty()) {
+      header.first_map_page = map_page.page_number();
+    } else {
+      PageHeader previous = readPageHeader(map_pages.back());
+      previous.next_page_number = map_page.page_number();
+      writeAt(&previous, sizeof(PageHeader), pagePosition(map_pages.back()));
+    }
+    map_pages.push_back(map_page.page_number());
+  }
+  return map_pages[index];
+}
+
+off_t PageFile::mapPosition(const FileHeader& header, const PageId page_number) const {
+  const PageId index = page_number / MAP_BITS;
+  const std::vector<PageId> map_pages = mapPages(header, index + 1);
+  if (map_pages.size() <= index) {
+    return -1;
+  }
+  return pagePosition(map_pages[index]) + sizeof(PageHeader) + (page_number % MAP_BITS) / 8;
+}
+
+bool PageFile::markedUsed(const FileHeader& header, const PageId page_number) const {
+  const off_t position = mapPosition(header, page_number);
+  if (position < 0) {
+    return false;
+  }
+  unsigned char bits;
+  readAt(&bits, 1, position);
+  return bits & (1 << (page_number % 8));
+}
+
+void PageFile::markUsed(FileHeader& header, const PageId page_number, const bool used) {
+  off_t position = mapPosition(header, page_number);
+  if (position < 0) {
+    if (!used) {
+      return;
+    }
+    addMapPages(header, page_number / MAP_BITS);
+    position = mapPosition(header, page_number);
+  }
+  unsigned char bits;
+  readAt(&bits, 1, position);
+  if (used) {
+    bits |= 1 << (page_number % 8);
+  } else {
+    bits &= ~(1 << (page_number % 8));
+  }
+  writeAt(&bits, 1, position);
+}
+
+PageId PageFile::previousUsed(const FileHeader& header, const PageId page_number) const {
+  if (page_number <= 1) {
+    return Page::INVALID_NUMBER;
+  }
+  const PageId last = page_number - 1;
+  const std::vector<PageId> map_pages = mapPages(header, last / MAP_BITS + 1);
+  std::vector<unsigned char> bits(Page::DATA_SIZE);
+  for (PageId index = std::min<PageId>(last / MAP_BITS + 1, map_pages.size()); index-- > 0; ) {
+    readAt(&bits[0], Page::DATA_SIZE, pagePosition(map_pages[index]) + sizeof(PageHeader));
+    PageId bit = index == last / MAP_BITS ? last % MAP_BITS : MAP_BITS - 1;
+    // Bit by bit to a byte boundary, then skip empty bytes.
+    while (true) {
+      if (bits[bit / 8] == 0) {
+        bit = bit - bit % 8;
+      } else if (bits[bit / 8] & (1 << (bit % 8))) {
+        return index * MAP_BITS + bit;
+      }
+      if (bit == 0) {
+        break;
+      }
+      --bit;
+    }
+  }
+  return Page::INVALID_NUMBER;
+}
+
+void PageFile::buildMapIfNeeded() {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FileHeader header = readHeader();
+  if (header.first_map_page != Page::INVALID_NUMBER ||
+      header.first_used_page == Page::INVALID_NUMBER) {
+    return;
+  }
+
+  const PageId num_maps = (header.num_pages - 1) / MAP_BITS + 1;
+  std::vector<std::vector<unsigned char> > bits(num_maps, std::vector<unsigned char>(Page::DATA_SIZE));
+  for (PageId page_number = header.first_used_page; page_number != Page::INVALID_NUMBER;
+       page_number = readPageHeader(page_number).next_page_number) {
+    bits[page_number / MAP_BITS][(page_number % MAP_BITS) / 8] |= 1 << (page_number % 8);
+    header.last_used_page = page_number;
+  }
+  for (PageId index = 0; index < num_maps; index++) {
+    const PageId map_page = addMapPages(header, index);
+    writeAt(&bits[index][0], Page::DATA_SIZE, pagePosition(map_page) + sizeof(PageHeader));
+  }
+  writeHeader(header);
+}
+
+void PageFile::readPages(PageIo* pages, const std::size_t count, IoEngine& engine) const {
+  // Runs of consecutive pages are read with one request.  As in readPage(),
+  // pages past numPages() are read too, since another process may have
+  // allocated them.
+  std::vector<IoRequest> requests;
+  std::vector<std::vector<PageIo*> > runs;
+  requests.reserve(count);
+  runs.reserve(count);
+  for (std::size_t i = 0; i < count; i++) {
+    if (!runs.empty() && runs.back().back()->page_number + 1 == pages[i].page_number &&
+        requests.back().numParts < IoRequest::MAX_PARTS) {
+      requests.back().append(pages[i].page, Page::SIZE);
+      runs.back().push_back(&pages[i]);
+      continue;
+    }
+    IoRequest request;
+    request.set(stream_->fd, false /* write */, pagePosition(pages[i].page_number), pages[i].page, Page::SIZE);
+    requests.push_back(request);
+    runs.push_back(std::vector<PageIo*>(1, &pages[i]));
+  }
+
+  engine.run(requests.data(), requests.size());
+  for (std::size_t r = 0; r < runs.size(); r++) {
+    for (std::size_t i = 0; i < runs[r].size(); i++) {
+      PageIo* page = runs[r][i];
+      if (requests[r].error != 0) {
+        page->error = std::make_exception_ptr(FileIOException(filename_, strerror(requests[r].error)));
+      } else if (!page->page->isUsed()) {
+        page->error = std::make_exception_ptr(InvalidPageException(page->page_number, filename_));
+      }
+    }
+  }
+}
+
+void PageFile::writePages(PageIo* pages, const std::size_t count, IoEngine& engine) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+
+  // The next page numbers on disk are kept, as in writePage(), so read all
+  // the page headers first.
+  std::vector<PageHeader> headers(count);
+  std::vector<IoRequest> requests(count);
+  std::vector<PageIo*> batch(count);
+  for (std::size_t i = 0; i < count; i++) {
+    requests[i].set(stream_->fd, false /* write */, pagePosition(pages[i].page_number),
+                    &headers[i], sizeof(PageHeader));
+    batch[i] = &pages[i];
+  }
+  runBatch(requests, batch, engine);
+
+  std::vector<IoRequest> writes;
+  batch.clear();
+  writes.reserve(count);
+  for (std::size_t i = 0; i < count; i++) {
+    if (pages[i].error) {
+      continue;
+    }
+    if (headers[i].current_page_number == Page::INVALID_NUMBER) {
+      // Page has been deleted since it was read.
+      pages[i].error = std::make_exception_ptr(InvalidPageException(pages[i].page_number, filename_));
+      continue;
+    }
+    const PageId next_page_number = headers[i].next_page_number;
+    headers[i] = pages[i].page->header_;
+    headers[i].next_page_number = next_page_number;
+
+    IoRequest request;
+    request.set(stream_->fd, true /* write */, pagePosition(pages[i].page_number),
+                &headers[i], sizeof(PageHeader));
+    request.append(&pages[i].page->data_[0], Page::DATA_SIZE);
+    writes.push_back(request);
+    batch.push_back(&pages[i]);
+  }
+
+  runBatch(writes, batch, engine);
+}
+
 FileIterator PageFile::begin() {
   const FileHeader& header = readHeader();
   return FileIterator(this, header.first_used_page);
@@ -315,16 +696,14 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(&new_page.data_[0], Page::DATA_SIZE);
-  stream_->flush();
+  const off_t position = pagePosition(page_number);
+  writeAt(&header, sizeof(PageHeader), position);
+  writeAt(&new_page.data_[0], Page::DATA_SIZE, position + sizeof(PageHeader));
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  readAt(&header, sizeof(PageHeader), pagePosition(page_number));
   return header;
 }
 
@@ -361,8 +740,15 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
 }
 
 Page BlobFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
 	Page new_page;
+	allocatePage(new_page_number, new_page);
+	return new_page;
+}
+
+void BlobFile::allocatePage(PageId &new_page_number, Page& new_page) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FileHeader header = readHeader();
+	new_page.initialize();
 
 	new_page_number = header.num_pages;
 
@@ -374,21 +760,42 @@ Page BlobFile::allocatePage(PageId &new_page_number) {
 
 	writePage(new_page_number, new_page);
 	writeHeader(header);
-
-	return new_page;
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	readPage(page_number, page);
 	return page;
 }
 
+void BlobFile::readPage(const PageId page_number, Page& page) const {
+	readAt(&page, Page::SIZE, pagePosition(page_number));
+}
+
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	writeAt(&new_page, Page::SIZE, pagePosition(new_page_number));
+}
+
+void BlobFile::readPages(PageIo* pages, const std::size_t count, IoEngine& engine) const {
+  std::vector<IoRequest> requests(count);
+  std::vector<PageIo*> batch(count);
+  for (std::size_t i = 0; i < count; i++) {
+    requests[i].set(stream_->fd, false /* write */, pagePosition(pages[i].page_number),
+                    pages[i].page, Page::SIZE);
+    batch[i] = &pages[i];
+  }
+  runBatch(requests, batch, engine);
+}
+
+void BlobFile::writePages(PageIo* pages, const std::size_t count, IoEngine& engine) {
+  std::vector<IoRequest> requests(count);
+  std::vector<PageIo*> batch(count);
+  for (std::size_t i = 0; i < count; i++) {
+    requests[i].set(stream_->fd, true /* write */, pagePosition(pages[i].page_number),
+                    pages[i].page, Page::SIZE);
+    batch[i] = &pages[i];
+  }
+  runBatch(requests, batch, engine);
 }
 
 //delePage should not be called for a blob_file, not supported
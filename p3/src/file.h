@@ -7,21 +7,63 @@
 
 #pragma once
 
-#include <fstream>
+#include <exception>
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <sys/types.h>
 
+#include "ioEngine.h"
 #include "page.h"
 
 namespace badgerdb {
 
 class FileIterator;
 
+/**
+ * @brief One page of a batch read or written with File::readPages() or
+ *        File::writePages().
+ */
+struct PageIo {
+  /**
+   * Number of the page.
+   */
+  PageId page_number;
+
+  /**
+   * Page to read into or write from.
+   */
+  Page* page;
+
+  /**
+   * Set if reading or writing this page failed, to what readPage() or
+   * writePage() would have thrown.
+   */
+  std::exception_ptr error;
+};
+
 /**
  * @brief Header metadata for files on disk which contain pages.
+ *
+ * Files written before the header had a magic number start with
+ * num_pages to first_free_page only, and version 2 files lack
+ * reserved_pages; File upgrades both when they are opened, see
+ * File::upgradeIfNeeded().
  */
 struct FileHeader {
+  /**
+   * FILE_MAGIC, marks the current format.
+   */
+  std::uint32_t magic;
+
+  /**
+   * Version of the format, FILE_VERSION.
+   */
+  std::uint32_t version;
+
   /**
    * Number of pages allocated in the file.
    */
@@ -42,6 +84,23 @@ struct FileHeader {
    */
   PageId first_free_page;
 
+  /**
+   * Page number of the last used page in the file, the tail of the used
+   * list.  Only kept by PageFile.
+   */
+  PageId last_used_page;
+
+  /**
+   * Page number of the first page of the free-space map, see PageFile.
+   */
+  PageId first_map_page;
+
+  /**
+   * Pages numbered below this have space set aside in the file, a whole
+   * extent at a time.  Only kept by PageFile.
+   */
+  PageId reserved_pages;
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,23 +111,57 @@ struct FileHeader {
     return num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
-        first_free_page == rhs.first_free_page;
+        first_free_page == rhs.first_free_page &&
+        last_used_page == rhs.last_used_page &&
+        first_map_page == rhs.first_map_page &&
+        reserved_pages == rhs.reserved_pages;
   }
 };
 
+/**
+ * @brief Header of files written before FileHeader had a magic number.
+ */
+struct LegacyFileHeader {
+  PageId num_pages;
+  PageId first_used_page;
+  PageId num_free_pages;
+  PageId first_free_page;
+};
+
+/**
+ * Magic number and version of the current file format.  Version 2 added the
+ * used list tail and the free-space map, version 3 extents.
+ */
+static const std::uint32_t FILE_MAGIC = 0xBAD6E4DB;
+static const std::uint32_t FILE_VERSION = 3;
+
 /**
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
- * fixed-sized pages, and they never deallocate space (though they do reuse
- * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * The File class wraps a descriptor of an underlying file on disk.  Files
+ * contain fixed-sized pages, and they never deallocate space (though they do
+ * reuse deleted pages if possible).  If multiple File objects refer to the same
+ * underlying file, they will share the descriptor.
  * If a file that has already been opened (possibly by another query), then the File class
  * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again. 
+ * the already opened descriptor for the file without actually opening the UNIX file again. 
+ *
+ * Pages are read and written with positional I/O (pread and pwrite), which
+ * has no shared file position, so page reads from several threads run at
+ * the same time, also on the same file.  Operations that change the file
+ * header or the page lists (allocating, deleting and writing PageFile pages)
+ * hold the file's latch, which is shared between all File objects for the
+ * same underlying file just like the descriptor itself.
  *
- * @warning This class is not threadsafe.
+ * The file header is read once, when the file is first opened, and kept
+ * with the descriptor.  Changes to the header are not written at once but by
+ * flush() or when the file is closed for the last time.  Pages are written
+ * to the operating system at once but are not forced to disk; call flush()
+ * for that.  The header is kept per process, so a file must not have pages
+ * allocated or deleted by two processes at a time; pages another process
+ * allocated can still be read and written, as their page headers on disk
+ * say whether they are in use.
  */
 
 
@@ -124,6 +217,15 @@ class File {
    */
   virtual Page allocatePage(PageId &new_page_number) = 0;
 
+  /**
+   * Allocates a new page in the file, building it in place in the given page
+   * (e.g. a buffer pool frame) instead of returning a copy.
+   *
+   * @param new_page_number   Number of the new page returned via this variable.
+   * @param new_page          Overwritten with the new page.
+   */
+  virtual void allocatePage(PageId &new_page_number, Page& new_page) = 0;
+
   /**
    * Reads an existing page from the file.
    *
@@ -134,6 +236,17 @@ class File {
    */
   virtual Page readPage(const PageId page_number) const = 0;
 
+  /**
+   * Reads an existing page from the file straight into the given page
+   * (e.g. a buffer pool frame), without a temporary page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Overwritten with the page read.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  virtual void readPage(const PageId page_number, Page& page) const = 0;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -150,6 +263,34 @@ class File {
    */
   virtual void deletePage(const PageId page_number) = 0;
 
+  /**
+   * Reads several pages at once through the given engine, with the checks
+   * of readPage().  Errors are reported per page.
+   *
+   * @param pages   Pages to read.
+   * @param count   Number of pages.
+   * @param engine  Engine to run the reads.
+   */
+  virtual void readPages(PageIo* pages, const std::size_t count, IoEngine& engine) const = 0;
+
+  /**
+   * Writes several pages at once through the given engine, as writePage()
+   * would.  Errors are reported per page.
+   *
+   * @param pages   Pages to write.
+   * @param count   Number of pages.
+   * @param engine  Engine to run the writes.
+   */
+  virtual void writePages(PageIo* pages, const std::size_t count, IoEngine& engine) = 0;
+
+  /**
+   * Writes the header back if it changed and forces the pages and header
+   * written so far to disk.
+   *
+   * @throws  FileIOException  If the file cannot be synced.
+   */
+  void flush() const;
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -172,10 +313,42 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  static off_t pagePosition(const PageId page_number) {
+    return sizeof(FileHeader) + ((off_t)(page_number - 1) * Page::SIZE);
   }
 
+  /**
+   * Reads size bytes at the given offset, retrying short reads.  Bytes past
+   * the end of the file are returned as zeroes.
+   *
+   * @param buffer  Where to read to.
+   * @param size    Number of bytes to read.
+   * @param offset  Position in the file.
+   * @throws  FileIOException  If the read fails.
+   */
+  void readAt(void* buffer, const std::size_t size, const off_t offset) const;
+
+  /**
+   * Writes size bytes at the given offset, retrying short writes.
+   *
+   * @param buffer  What to write.
+   * @param size    Number of bytes to write.
+   * @param offset  Position in the file.
+   * @throws  FileIOException  If the write fails.
+   */
+  void writeAt(const void* buffer, const std::size_t size, const off_t offset) const;
+
+  /**
+   * Runs a batch of requests on the engine and records a FileIOException
+   * for every page whose request failed.
+   *
+   * @param requests  One request per page.
+   * @param pages     Pages of the requests.
+   * @param engine    Engine to run them.
+   */
+  void runBatch(std::vector<IoRequest>& requests, const std::vector<PageIo*>& pages,
+                IoEngine& engine) const;
+
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
@@ -190,55 +363,146 @@ class File {
   void openIfNeeded(const bool create_new);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Rewrites a file in the legacy format (see LegacyFileHeader) or an older
+   * version in the current one: the header gains its new fields and every
+   * page moves to its new position.  The file is rewritten into a temporary file which
+   * then replaces it, so an interrupted upgrade leaves the old file intact.
+   * Files in the current format are left alone.  The used list tail and the
+   * free-space map of legacy files are left unset; PageFile builds them when
+   * it is opened.  Upgraded files have no pages reserved past their end.
+   *
+   * @param filename  Name of the file, which must not be open.
+   * @throws  FileIOException  If the file cannot be read or rewritten.
+   */
+  static void upgradeIfNeeded(const std::string& filename);
+
+  /**
+   * Closes the underlying file descriptor in <stream_>.
    * This method only closes the file if no other File objects exist that access
    * the same file.
    */
   void close();
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file, as kept in memory while it is open.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Replaces the header for this file.  It is written to disk by flush(), or
+   * when the last File object of the file closes it.
    *
    * @param header  File header to write.
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
+  /**
+   * Returns the number of pages in the file, without taking the latch.
+   */
+  PageId numPages() const {
+    return stream_->num_pages.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Descriptor of an open file, closed when the last File object using it
+   * lets go of it.  It also holds the header of the file, read once when the
+   * file is opened; changes to it are written back at the latest when the
+   * descriptor is closed.
+   */
+  struct Descriptor {
+    explicit Descriptor(const int fdIn) : fd(fdIn), header_dirty(false), num_pages(0) {}
+    ~Descriptor();
+    const int fd;
+
+    /**
+     * Header of the file, guarded by the file latch.
+     */
+    FileHeader header;
+
+    /**
+     * True if header has changed since it was last written.
+     */
+    bool header_dirty;
+
+    /**
+     * header.num_pages, for reads that do not take the latch.
+     */
+    std::atomic<PageId> num_pages;
+  };
+
+  typedef std::map<std::string, std::shared_ptr<Descriptor> > StreamMap;
+  typedef std::map<std::string, std::shared_ptr<std::recursive_mutex> > LatchMap;
   typedef std::map<std::string, int> CountMap;
 
   /**
-   * Streams for opened files.
+   * Descriptors of opened files.
    */
   static StreamMap open_streams_;
 
+  /**
+   * Latches for opened files.  Serializes changes to the header and page
+   * lists of the file shared by all File objects of the same file.
+   */
+  static LatchMap open_latches_;
+
   /**
    * Counts for opened files.
    */
   static CountMap open_counts_;
 
+  /**
+   * Protects open_streams_, open_latches_ and open_counts_.
+   */
+  static std::mutex registry_latch_;
+
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Descriptor of the underlying filesystem object.
+   */
+  std::shared_ptr<Descriptor> stream_;
+
+  /**
+   * Latch for the underlying filesystem object, shared with stream_.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<std::recursive_mutex> latch_;
 
   friend class FileIterator;
 };
 
+/**
+ * @brief File of slotted pages, kept in a list of used pages in ascending
+ *        page order and a list of free (deleted) pages.
+ *
+ * Besides the head of the used list the file header keeps its tail, so new
+ * pages are appended without walking the list.  A free-space map records
+ * which pages are on the used list, one bit per page; it is kept in map
+ * pages chained from FileHeader::first_map_page, each covering MAP_BITS
+ * page numbers.  A reused or deleted page is linked in or out after the
+ * closest used page before it, which the map finds without reading any
+ * page of the list, so allocating and deleting pages take a constant number
+ * of page reads and writes.  Map pages are not on either list.
+ *
+ * The file grows by extents of EXTENT_PAGES pages, set aside on disk as one
+ * run when the first of them is allocated, so the pages of a file stay
+ * together on disk even while other files grow at the same time.  Since the
+ * used list is in ascending page order, a scan of the file goes through its
+ * extents in order; FileIterator reads each extent with a single read, and
+ * readPages() reads runs of consecutive pages with one request.
+ */
 class PageFile : public File {
  public:
 
+  /**
+   * Number of pages the file grows by at a time.
+   */
+  static const PageId EXTENT_PAGES = 64;
+
   /**
    * Creates a new file.
    *
@@ -300,6 +564,14 @@ class PageFile : public File {
    */
   Page allocatePage(PageId &new_page_number) override;
 
+  /**
+   * Allocates a new page in the file, building it in place in the given page.
+   *
+   * @param new_page_number   Number of the new page returned via this variable.
+   * @param new_page          Overwritten with the new page.
+   */
+  void allocatePage(PageId &new_page_number, Page& new_page) override;
+
   /**
    * Reads an existing page from the file.
    *
@@ -310,6 +582,16 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file straight into the given page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Overwritten with the page read.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPage(const PageId page_number, Page& page) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -326,6 +608,17 @@ class PageFile : public File {
    */
   void deletePage(const PageId page_number) override;
 
+  /**
+   * Reads several pages at once, see File::readPages().
+   */
+  void readPages(PageIo* pages, const std::size_t count, IoEngine& engine) const override;
+
+  /**
+   * Writes several pages at once, keeping the next page numbers on disk like
+   * writePage().  The page headers are read in one batch first.
+   */
+  void writePages(PageIo* pages, const std::size_t count, IoEngine& engine) override;
+
   /**
    * Returns an iterator at the first page in the file.
    *
@@ -347,16 +640,16 @@ class PageFile : public File {
    * Reads a page from the file.  If <allow_free> is not set, an exception
    * will be thrown if the page read from disk is not currently in use.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; a page past the end of the file reads
+   * as zeroes, which is a free page.
    *
    * @param page_number   Number of page to read.
+   * @param page          Overwritten with the page read.
    * @param allow_free    Whether to allow reading a free (unused) page.
-   * @return  The page.
    * @throws  InvalidPageException  If the page is free (unused) and
    *                                allow_free is false.
    */
-  Page readPage(const PageId page_number, const bool allow_free) const;
+  void readPage(const PageId page_number, Page& page, const bool allow_free) const;
 
   /**
    * Writes a page into the file at the given page number with the given header.
@@ -379,6 +672,93 @@ class PageFile : public File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Appends a page to the file, reserving the next extent on disk if the
+   * page starts it.  The caller writes the page and the header.
+   *
+   * @param header  File header, updated.
+   * @return  Number of the new page.
+   * @throws  FileIOException  If the extent cannot be reserved.
+   */
+  PageId appendPage(FileHeader& header);
+
+  /**
+   * Reads the pages of the extent holding the given page with one read, up
+   * to the end of the file.  Free pages are read as they are.
+   *
+   * @param page_number   Number of a page of the extent.
+   * @param pages         Gets the pages read.
+   * @return  Number of the first page read.
+   * @throws  InvalidPageException  If the page is not in the file.
+   */
+  PageId readExtent(const PageId page_number, std::vector<Page>& pages) const;
+
+  /**
+   * Number of pages whose state one page of the free-space map holds.
+   */
+  static const PageId MAP_BITS = Page::DATA_SIZE * 8;
+
+  /**
+   * Returns the numbers of the first count pages of the free-space map, fewer
+   * if the map has fewer pages.
+   *
+   * @param header  File header.
+   * @param count   Number of map pages wanted.
+   */
+  std::vector<PageId> mapPages(const FileHeader& header, const PageId count) const;
+
+  /**
+   * Appends map pages to the file until the map has a page of the given
+   * index.  The caller writes the header back.
+   *
+   * @param header  File header, updated.
+   * @param index   Index of the map page needed.
+   * @return  Page number of that map page.
+   */
+  PageId addMapPages(FileHeader& header, const PageId index);
+
+  /**
+   * Position in the file of the byte of the free-space map holding the bit
+   * of a page, or -1 if the map has no page for it.
+   *
+   * @param header        File header.
+   * @param page_number   Number of page.
+   */
+  off_t mapPosition(const FileHeader& header, const PageId page_number) const;
+
+  /**
+   * Returns true if the free-space map has the page on the used list.
+   *
+   * @param header        File header.
+   * @param page_number   Number of page.
+   */
+  bool markedUsed(const FileHeader& header, const PageId page_number) const;
+
+  /**
+   * Records in the free-space map whether the page is on the used list.
+   *
+   * @param header        File header, updated if map pages are added.
+   * @param page_number   Number of page.
+   * @param used          Whether the page is used.
+   */
+  void markUsed(FileHeader& header, const PageId page_number, const bool used);
+
+  /**
+   * Returns the closest page before the given one that is on the used list,
+   * or Page::INVALID_NUMBER if there is none.
+   *
+   * @param header        File header.
+   * @param page_number   Number of page.
+   */
+  PageId previousUsed(const FileHeader& header, const PageId page_number) const;
+
+  /**
+   * Sets up the used list tail and the free-space map of a file upgraded by
+   * File::upgradeIfNeeded(), walking the used list once.  Does nothing if
+   * the file has them.
+   */
+  void buildMapIfNeeded();
+
   friend class FileIterator;
 };
 
@@ -448,6 +828,14 @@ class BlobFile : public File {
    */
   Page allocatePage(PageId &new_page_number) override;
 
+  /**
+   * Allocates a new page in the file, building it in place in the given page.
+   *
+   * @param new_page_number   Number of the new page returned via this variable.
+   * @param new_page          Overwritten with the new page.
+   */
+  void allocatePage(PageId &new_page_number, Page& new_page) override;
+
   /**
    * Reads an existing page from the file.
    *
@@ -458,6 +846,16 @@ class BlobFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file straight into the given page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Overwritten with the page read.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPage(const PageId page_number, Page& page) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -473,6 +871,16 @@ class BlobFile : public File {
    * @param page_number   Number of page to delete.
    */
   void deletePage(const PageId page_number) override;
+
+  /**
+   * Reads several pages at once, see File::readPages().
+   */
+  void readPages(PageIo* pages, const std::size_t count, IoEngine& engine) const override;
+
+  /**
+   * Writes several pages at once, see File::writePages().
+   */
+  void writePages(PageIo* pages, const std::size_t count, IoEngine& engine) override;
 };
 
 }
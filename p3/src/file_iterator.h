@@ -18,7 +18,9 @@ namespace badgerdb {
  * @brief Iterator for iterating over the pages in a file.
  *
  * This class provides a forward-only iterator for iterating over all of the
- * pages in a file.
+ * pages in a file.  Every dereference reads the page from the file, so it
+ * sees pages written since the iterator was created; use
+ * PageFile::readExtent() to read many pages at once.
  */
 class FileIterator {
  public:
@@ -103,6 +105,15 @@ class FileIterator {
 	inline Page operator*() const
   { return file_->readPage(current_page_number_); }
 
+  /**
+   * Returns the number of the page the iterator is currently at, without
+   * reading the page.
+   *
+   * @return  Page number of current page.
+   */
+	inline PageId page_number() const
+  { return current_page_number_; }
+
  private:
   /**
    * File we're iterating over.
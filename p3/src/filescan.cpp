@@ -11,50 +11,56 @@
 namespace badgerdb { 
 
 FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
+  : ring(2 * PREFETCH_DEPTH)
 {
   file = new PageFile(name, false);	//dont create new file
 	bufMgr = bufferMgr;
-	curDirtyFlag = false;
-  curPage = NULL;
 	filePageIter = file->begin();
 }
 
 FileScan::~FileScan()
 {
   // generally must unpin last page of the scan
-  if (curPage != NULL)
-  {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-		curDirtyFlag = false;
-    filePageIter = file->begin();
-  }
+  curPage.release();
   bufMgr->flushFile(file);
   delete file;
 }
 
 void FileScan::scanNext(RecordId& outRid)
+{
+  if (!tryScanNext(outRid))
+  {
+    throw EndOfFileException();
+  }
+}
+
+bool FileScan::tryScanNext(RecordId& outRid)
 {
   std::string rec;
 
   if (filePageIter == file->end())
 	{
-		throw EndOfFileException();
+		return false;
 	}
 
   // special case of the first record of the first page of the file
-  if (curPage == NULL)
+  if (!curPage)
   {
     // need to get the first page of the file
 		filePageIter = file->begin();
     if(filePageIter == file->end())
 		{
-			throw EndOfFileException();
+			return false;
 		}
 	 
+		// start reading the pages after it in the background
+    prefetchIter = filePageIter;
+    prefetchIter++;
+    pagesAhead.clear();
+    prefetchAhead();
+
 		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
-		curDirtyFlag = false;
+    curPage = bufMgr->fetchPage(file, filePageIter.page_number(), &ring, SCAN_ONCE);
 
 		// get the first record off the page
     pageRecordIter = curPage->begin(); 
@@ -65,7 +71,7 @@ void FileScan::scanNext(RecordId& outRid)
 		  rec = *pageRecordIter;
 
 			outRid = pageRecordIter.getCurrentRecord();
-			return;
+			return true;
 		}
   }
 
@@ -76,19 +82,21 @@ void FileScan::scanNext(RecordId& outRid)
   while (pageRecordIter == curPage->end())
   {
     // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-    curDirtyFlag = false;
+    curPage.release();
 
-    filePageIter++;
-    if (filePageIter == file->end())
+    // the next page is the first one prefetched, so the used list is only
+    // walked once; with none left the prefetch walk has reached the end
+    if (pagesAhead.empty())
     {
-      curPage = NULL;
-			throw EndOfFileException();
+      filePageIter = file->end();
+			return false;
     }
+    filePageIter = FileIterator(file, pagesAhead.front());
+    pagesAhead.pop_front();
 
-    // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    // keep the prefetch window full, then read the next page of the file
+    prefetchAhead();
+    curPage = bufMgr->fetchPage(file, filePageIter.page_number(), &ring, SCAN_ONCE);
 
     // get the first record off the page
     pageRecordIter = curPage->begin(); 
@@ -101,7 +109,81 @@ void FileScan::scanNext(RecordId& outRid)
 
 	// return rid of the record
 	outRid = pageRecordIter.getCurrentRecord();
-	return;
+	return true;
+}
+
+void FileScan::prefetchAhead()
+{
+  if (pagesAhead.size() > PREFETCH_DEPTH / 2)
+    return;
+
+  std::vector<PageId> pageNos;
+  while (pagesAhead.size() < PREFETCH_DEPTH && prefetchIter != file->end())
+  {
+    pageNos.push_back(prefetchIter.page_number());
+    pagesAhead.push_back(prefetchIter.page_number());
+    prefetchIter++;
+  }
+  if (!pageNos.empty())
+    bufMgr->prefetchPages(file, pageNos, &ring);
+}
+
+void FileScan::scanAsync(AsyncExecutor& executor, RecordCallback onRecord, ScanDoneCallback done)
+{
+  std::shared_ptr<AsyncScan> scan = std::make_shared<AsyncScan>();
+  scan->next = file->begin();
+  scan->inFlight = 0;
+  scan->finished = false;
+  scan->onRecord = onRecord;
+  scan->done = done;
+  for (int i = 0; i < PREFETCH_DEPTH; i++)
+    readNextAsync(executor, scan);
+}
+
+void FileScan::readNextAsync(AsyncExecutor& executor, std::shared_ptr<AsyncScan> scan)
+{
+  if (!scan->error && scan->next != file->end())
+  {
+    const PageId pageNo = scan->next.page_number();
+    try
+    {
+      scan->next++;
+    }
+    catch(...)
+    {
+      scan->error = std::current_exception();
+    }
+
+    scan->inFlight++;
+    bufMgr->readPageAsync(file, pageNo, executor, [this, &executor, scan](PageHandle& page, std::exception_ptr error) {
+      scan->inFlight--;
+      if (error && !scan->error)
+        scan->error = error;
+      if (!scan->error)
+      {
+        try
+        {
+          for (PageIterator it = page->begin(); it != page->end(); ++it)
+            scan->onRecord(it.getCurrentRecord(), *it);
+        }
+        catch(...)
+        {
+          scan->error = std::current_exception();
+        }
+      }
+      page.release();
+      readNextAsync(executor, scan);
+    }, &ring, SCAN_ONCE);
+    return;
+  }
+
+  // the end of the scan is reported through the executor like everything else
+  if (scan->inFlight == 0 && !scan->finished)
+  {
+    scan->finished = true;
+    executor.startRequest();
+    executor.completeRequest([scan]() { scan->done(scan->error); });
+  }
 }
 
 // returns pointer to the current record.  page is left pinned
@@ -114,7 +196,7 @@ std::string FileScan::getRecord()
 // mark current page of scan dirty
 void FileScan::markDirty()
 {
-  curDirtyFlag = true;
+  curPage.markDirty();
 }
 
 }
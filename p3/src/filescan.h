@@ -8,6 +8,10 @@
 
 #pragma once
 
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
 #include <string>
 #include "types.h"
 #include "page.h"
@@ -17,8 +21,21 @@
 
 namespace badgerdb {
 
+/**
+ * @brief Continuations of FileScan::scanAsync(): one gets each record, the
+ * other the end of the scan and the error it failed with, if any.
+ */
+typedef std::function<void(const RecordId& rid, const std::string& record)> RecordCallback;
+typedef std::function<void(std::exception_ptr error)> ScanDoneCallback;
+
 /**
  * @brief This class is used to sequentially scan records in a relation.
+ *
+ * Pages the scan has to read from disk go through a BufferRing, so a scan of
+ * a relation larger than the buffer pool does not evict the rest of the pool.
+ * The scan keeps up to PREFETCH_DEPTH pages ahead of it being read in the
+ * background, topping the window up only once it is half empty so that the
+ * pages are asked for in runs, which the file reads with one request each.
  */
 class FileScan
 {
@@ -29,15 +46,68 @@ class FileScan
   ~FileScan();
 
   //return RecordId of next record that satisfies the scan 
+  //throws EndOfFileException when there are no more records
   void scanNext(RecordId& outRid);
 
+  //same as scanNext, but returns false instead of throwing at end of file
+  bool tryScanNext(RecordId& outRid);
+
   //read current record, returning pointer and length
   std::string getRecord();
 
   //marks current page of scan dirty
   void markDirty();
 
+  /**
+   * Scans the whole relation without waiting for page reads: PREFETCH_DEPTH
+   * pages are read at a time, and the records of each page are handed to
+   * onRecord as soon as it arrives, so pages are visited in the order their
+   * reads complete rather than in file order. Both continuations run on the
+   * thread driving executor, which must also be the thread calling this; done
+   * runs once when the scan is over. An exception thrown by onRecord ends the
+   * scan and is passed to done. Independent of scanNext(); the scan must not
+   * be destroyed before done has run.
+   *
+   * @param executor  Executor the scan runs on, see AsyncExecutor::run()
+   * @param onRecord  Gets the record id and contents of every record
+   * @param done      Gets the error the scan ended with, or none
+   */
+  void scanAsync(AsyncExecutor& executor, RecordCallback onRecord, ScanDoneCallback done);
+
  private:
+  /**
+   * Number of pages past the current one the scan prefetches, a quarter of
+   * an extent. The ring has twice as many frames, so it does not reuse pages
+   * before the scan gets to them.
+   */
+  static const int PREFETCH_DEPTH = PageFile::EXTENT_PAGES / 4;
+
+  /**
+   * Once half of the window has been scanned, prefetch pages until
+   * PREFETCH_DEPTH pages past the current one have been.
+   */
+  void prefetchAhead();
+
+  /**
+   * State of a scan started by scanAsync(): next page to read, reads in
+   * flight, and the first error met
+   */
+  struct AsyncScan
+  {
+    FileIterator next;
+    int inFlight;
+    bool finished;
+    std::exception_ptr error;
+    RecordCallback onRecord;
+    ScanDoneCallback done;
+  };
+
+  /**
+   * Read the next page of an asynchronous scan, or end the scan once there
+   * is none and no read is in flight.
+   */
+  void readNextAsync(AsyncExecutor& executor, std::shared_ptr<AsyncScan> scan);
+
   /**
    * File which is being scanned.
    */
@@ -49,17 +119,24 @@ class FileScan
 	BufMgr				*bufMgr;
 
   /**
-   * Current page being scanned.
+   * Current page being scanned, pinned while the scan is on it.
+   */
+  PageHandle    curPage;
+
+  /**
+   * Frames the scan reuses for pages that were not in the buffer pool.
    */
-  Page*         curPage;
+  BufferRing    ring;
 
   FileIterator  filePageIter;
   PageIterator  pageRecordIter;
 
   /**
-   * True if page has been updated
+   * Next page to prefetch, and the pages prefetched past the current one,
+   * which the scan reads next.
    */
-  bool  	      curDirtyFlag;
+  FileIterator  prefetchIter;
+  std::deque<PageId> pagesAhead;
 };
 
 }
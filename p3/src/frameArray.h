@@ -0,0 +1,95 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+* @brief Array of per-frame objects (pages, their descriptors, or the state
+* a replacement policy keeps for them) that can grow and shrink without moving
+* the objects it keeps, so pages stay where their pins expect them while
+* BufMgr::resize() runs.
+*
+* Objects live in chunks of CHUNK_SIZE, found through a directory allocated
+* once for the largest supported pool.
+*/
+template <class T>
+class FrameArray
+{
+ public:
+	/**
+   * Number of objects per chunk, and log2 of it
+	 */
+  static const std::uint32_t CHUNK_SHIFT = 6;
+  static const std::uint32_t CHUNK_SIZE = 1 << CHUNK_SHIFT;
+
+	/**
+   * Largest number of objects the array can hold
+	 */
+  static const std::uint32_t MAX_SIZE = CHUNK_SIZE << 16;
+
+  FrameArray()
+    : chunks(new T*[MAX_SIZE / CHUNK_SIZE]()), numChunks(0)
+  {
+  }
+
+  ~FrameArray()
+  {
+    resize(0);
+    delete [] chunks;
+  }
+
+  T& operator[](const FrameId frame) const
+  {
+    return chunks[frame >> CHUNK_SHIFT][frame & (CHUNK_SIZE - 1)];
+  }
+
+	/**
+	 * Number of objects allocated, a multiple of CHUNK_SIZE
+	 */
+  std::uint32_t capacity() const
+  {
+    return numChunks * CHUNK_SIZE;
+  }
+
+	/**
+	 * Allocates or frees chunks so the array holds at least size objects, in as
+	 * few chunks as possible. Objects that are kept do not move; new ones are
+	 * default constructed.
+	 *
+	 * @param size   	Number of objects
+   * @throws std::length_error If size is larger than MAX_SIZE
+	 */
+  void resize(const std::uint32_t size)
+  {
+    if (size > MAX_SIZE)
+      throw std::length_error("FrameArray::resize");
+    const std::uint32_t wanted = (size + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    for (; numChunks < wanted; numChunks++)
+      chunks[numChunks] = new T[CHUNK_SIZE];
+    for (; numChunks > wanted; numChunks--)
+    {
+      delete [] chunks[numChunks - 1];
+      chunks[numChunks - 1] = NULL;
+    }
+  }
+
+ private:
+  FrameArray(const FrameArray&);
+  FrameArray& operator=(const FrameArray&);
+
+  T** chunks;
+  std::uint32_t numChunks;
+};
+
+}
@@ -0,0 +1,364 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "ioEngine.h"
+
+namespace badgerdb {
+
+/**
+ * Threads of the fallback engine at most
+ */
+static const unsigned MAX_IO_THREADS = 16;
+
+bool IoRequest::advance(std::size_t bytes)
+{
+  if (bytes == 0)
+  {
+    // a read past the end of the file, or a write that got nowhere
+    if (write)
+    {
+      error = EIO;
+      return true;
+    }
+    for (int i = 0; i < numParts; i++)
+      memset(parts[i].iov_base, 0, parts[i].iov_len);
+    return true;
+  }
+
+  offset += bytes;
+  int done = 0;
+  while (done < numParts && bytes >= parts[done].iov_len)
+  {
+    bytes -= parts[done].iov_len;
+    done++;
+  }
+  if (done == numParts)
+    return true;
+  parts[done].iov_base = static_cast<char*>(parts[done].iov_base) + bytes;
+  parts[done].iov_len -= bytes;
+
+  // keep the remaining parts at the front
+  for (int i = done; i < numParts; i++)
+    parts[i - done] = parts[i];
+  numParts -= done;
+  return false;
+}
+
+IoEngine* IoEngine::create(const IoEngineType type, const unsigned depth)
+{
+  if (type != IO_THREAD_POOL)
+  {
+    try
+    {
+      return new UringIoEngine(depth);
+    }
+    catch(const std::system_error &)
+    {
+      // no io_uring in this kernel, or not allowed to use it
+    }
+  }
+  return new ThreadPoolIoEngine(std::min(depth, MAX_IO_THREADS));
+}
+
+// -----------------------------------------------------------------------------
+// UringIoEngine
+// -----------------------------------------------------------------------------
+
+/**
+ * A ring and where its parts are mapped
+ */
+struct UringIoEngine::Ring
+{
+  int fd;
+  unsigned entries;
+
+  void* sqMap;
+  std::size_t sqMapSize;
+  void* cqMap;
+  std::size_t cqMapSize;
+  io_uring_sqe* sqes;
+  std::size_t sqesSize;
+
+  unsigned* sqHead;
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  io_uring_cqe* cqes;
+};
+
+UringIoEngine::UringIoEngine(const unsigned depthIn)
+  : depth(std::max(depthIn, 1u))
+{
+  // fail now rather than in the first batch
+  idle.push_back(openRing());
+}
+
+UringIoEngine::~UringIoEngine()
+{
+  for (std::size_t i = 0; i < idle.size(); i++)
+    closeRing(idle[i]);
+}
+
+UringIoEngine::Ring* UringIoEngine::openRing()
+{
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  const int fd = syscall(__NR_io_uring_setup, depth, &params);
+  if (fd < 0)
+    throw std::system_error(errno, std::system_category(), "io_uring_setup");
+
+  Ring* ring = new Ring();
+  ring->fd = fd;
+  ring->entries = params.sq_entries;
+  ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+  const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single)
+    ring->sqMapSize = ring->cqMapSize = std::max(ring->sqMapSize, ring->cqMapSize);
+
+  ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      fd, IORING_OFF_SQ_RING);
+  ring->cqMap = single ? ring->sqMap : mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  void* sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      fd, IORING_OFF_SQES);
+  if (ring->sqMap == MAP_FAILED || ring->cqMap == MAP_FAILED || sqes == MAP_FAILED)
+  {
+    const int error = errno;
+    if (ring->sqMap != MAP_FAILED)
+      munmap(ring->sqMap, ring->sqMapSize);
+    if (!single && ring->cqMap != MAP_FAILED)
+      munmap(ring->cqMap, ring->cqMapSize);
+    if (sqes != MAP_FAILED)
+      munmap(sqes, ring->sqesSize);
+    close(fd);
+    delete ring;
+    throw std::system_error(error, std::system_category(), "io_uring mmap");
+  }
+
+  char* sq = static_cast<char*>(ring->sqMap);
+  char* cq = static_cast<char*>(ring->cqMap);
+  ring->sqes = static_cast<io_uring_sqe*>(sqes);
+  ring->sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  ring->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  ring->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  return ring;
+}
+
+void UringIoEngine::closeRing(Ring* ring)
+{
+  munmap(ring->sqes, ring->sqesSize);
+  if (ring->cqMap != ring->sqMap)
+    munmap(ring->cqMap, ring->cqMapSize);
+  munmap(ring->sqMap, ring->sqMapSize);
+  close(ring->fd);
+  delete ring;
+}
+
+void UringIoEngine::run(IoRequest* requests, const std::size_t count)
+{
+  if (count == 0)
+    return;
+
+  Ring* ring = NULL;
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    if (!idle.empty())
+    {
+      ring = idle.back();
+      idle.pop_back();
+    }
+  }
+  if (ring == NULL)
+    ring = openRing();
+
+  try
+  {
+    runOn(ring, requests, count);
+  }
+  catch(...)
+  {
+    // requests may still be in flight on it
+    closeRing(ring);
+    throw;
+  }
+
+  std::lock_guard<std::mutex> guard(latch);
+  idle.push_back(ring);
+}
+
+void UringIoEngine::runOn(Ring* ring, IoRequest* requests, const std::size_t count)
+{
+  // requests that completed short and have to go round again
+  std::vector<IoRequest*> retries;
+  std::size_t next = 0;
+  unsigned inFlight = 0;
+  unsigned unsubmitted = 0;
+
+  while (next < count || !retries.empty() || inFlight > 0)
+  {
+    // queue as many requests as the ring takes
+    unsigned tail = *ring->sqTail;
+    const unsigned mask = *ring->sqMask;
+    while (inFlight < ring->entries && (!retries.empty() || next < count))
+    {
+      IoRequest* request;
+      if (!retries.empty())
+      {
+        request = retries.back();
+        retries.pop_back();
+      }
+      else
+      {
+        request = &requests[next++];
+      }
+
+      const unsigned index = tail & mask;
+      io_uring_sqe* sqe = &ring->sqes[index];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = request->write ? IORING_OP_WRITEV : IORING_OP_READV;
+      sqe->fd = request->fd;
+      sqe->addr = reinterpret_cast<unsigned long>(request->parts);
+      sqe->len = request->numParts;
+      sqe->off = request->offset;
+      sqe->user_data = reinterpret_cast<unsigned long>(request);
+      ring->sqArray[index] = index;
+      tail++;
+      inFlight++;
+      unsubmitted++;
+    }
+    __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+
+    const int submitted = syscall(__NR_io_uring_enter, ring->fd, unsubmitted, 1,
+        IORING_ENTER_GETEVENTS, NULL, 0);
+    if (submitted < 0)
+    {
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        throw std::system_error(errno, std::system_category(), "io_uring_enter");
+    }
+    else
+    {
+      unsubmitted -= submitted;
+    }
+
+    // reap whatever completed
+    unsigned head = *ring->cqHead;
+    const unsigned cqTail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    while (head != cqTail)
+    {
+      const io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+      IoRequest* request = reinterpret_cast<IoRequest*>(cqe->user_data);
+      const int result = cqe->res;
+      head++;
+      inFlight--;
+
+      if (result == -EINTR || result == -EAGAIN)
+        retries.push_back(request);
+      else if (result < 0)
+        request->error = -result;
+      else if (!request->advance(result))
+        retries.push_back(request);
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// ThreadPoolIoEngine
+// -----------------------------------------------------------------------------
+
+ThreadPoolIoEngine::ThreadPoolIoEngine(const unsigned threads)
+  : stop(false)
+{
+  for (unsigned t = 0; t < std::max(threads, 1u); t++)
+    workers.push_back(std::thread(&ThreadPoolIoEngine::workerLoop, this));
+}
+
+ThreadPoolIoEngine::~ThreadPoolIoEngine()
+{
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    stop = true;
+  }
+  queued.notify_all();
+  for (std::size_t t = 0; t < workers.size(); t++)
+    workers[t].join();
+}
+
+void ThreadPoolIoEngine::run(IoRequest* requests, const std::size_t count)
+{
+  if (count == 0)
+    return;
+
+  Batch batch = {count};
+  std::unique_lock<std::mutex> guard(latch);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    Task task = {&requests[i], &batch};
+    tasks.push_back(task);
+  }
+  queued.notify_all();
+  completed.wait(guard, [&batch]() { return batch.remaining == 0; });
+}
+
+void ThreadPoolIoEngine::workerLoop()
+{
+  std::unique_lock<std::mutex> guard(latch);
+  while (true)
+  {
+    queued.wait(guard, [this]() { return stop || !tasks.empty(); });
+    if (tasks.empty())
+      return;
+    Task task = tasks.front();
+    tasks.pop_front();
+    guard.unlock();
+
+    IoRequest* request = task.request;
+    bool done = false;
+    while (!done)
+    {
+      const ssize_t result = request->write
+          ? pwritev(request->fd, request->parts, request->numParts, request->offset)
+          : preadv(request->fd, request->parts, request->numParts, request->offset);
+      if (result < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        request->error = errno;
+        done = true;
+      }
+      else
+      {
+        done = request->advance(result);
+      }
+    }
+
+    guard.lock();
+    if (--task.batch->remaining == 0)
+      completed.notify_all();
+  }
+}
+
+}
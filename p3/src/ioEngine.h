@@ -0,0 +1,228 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+namespace badgerdb {
+
+/**
+ * @brief Engines that can run batches of I/O requests.
+ */
+enum IoEngineType
+{
+	IO_ENGINE_AUTO = 0,
+	IO_URING = 1,
+	IO_THREAD_POOL = 2
+};
+
+/**
+* @brief One positional read or write of a batch, into or from up to
+* MAX_PARTS buffers (a page header and the rest of the page, or a run of
+* consecutive pages, say).
+*
+* The engine works on the request in place: parts and offset are advanced as
+* bytes are transferred. Bytes read past the end of the file are returned as
+* zeroes.
+*/
+struct IoRequest
+{
+	/**
+   * Buffers one request transfers at most
+	 */
+  static const int MAX_PARTS = 64;
+
+  int fd;
+  bool write;
+  off_t offset;
+  struct iovec parts[MAX_PARTS];
+  int numParts;
+
+	/**
+   * errno of a failed transfer, 0 once it succeeded
+	 */
+  int error;
+
+	/**
+   * Sets up a read or write of one buffer.
+	 */
+  void set(const int fdIn, const bool writeIn, const off_t offsetIn, void* buffer, const std::size_t size)
+  {
+    fd = fdIn;
+    write = writeIn;
+    offset = offsetIn;
+    parts[0].iov_base = buffer;
+    parts[0].iov_len = size;
+    numParts = 1;
+    error = 0;
+  }
+
+	/**
+   * Adds a buffer, transferred right after the ones added before.
+	 */
+  void append(void* buffer, const std::size_t size)
+  {
+    parts[numParts].iov_base = buffer;
+    parts[numParts].iov_len = size;
+    numParts++;
+  }
+
+	/**
+   * Accounts for bytes transferred, or the end of the file for a read of
+	 * none.
+	 *
+	 * @return  True once the request is complete
+	 */
+  bool advance(std::size_t bytes);
+};
+
+/**
+* @brief Runs batches of positional reads and writes, keeping all requests
+* of a batch in flight at once so the device sees a queue of them rather
+* than one synchronous request at a time.
+*
+* create() picks io_uring, set up with plain system calls, and falls back to
+* a pool of threads doing preadv and pwritev where the kernel does not offer
+* it. Several threads may run batches at the same time.
+*/
+class IoEngine
+{
+ public:
+	/**
+   * Creates an engine.
+	 *
+	 * @param type   	IO_ENGINE_AUTO for io_uring if available, else threads
+	 * @param depth  	Number of requests kept in flight
+	 * @return  			The engine, IO_THREAD_POOL if io_uring was asked for but is unavailable
+	 */
+  static IoEngine* create(const IoEngineType type = IO_ENGINE_AUTO, const unsigned depth = 64);
+
+  virtual ~IoEngine() {}
+
+	/**
+   * Runs a batch of requests and returns once all of them completed. Each
+	 * request reports its own error.
+	 *
+	 * @param requests	Requests
+	 * @param count   	Number of requests
+	 */
+  virtual void run(IoRequest* requests, const std::size_t count) = 0;
+
+	/**
+   * Returns the type of the engine, IO_URING or IO_THREAD_POOL.
+	 */
+  virtual IoEngineType type() const = 0;
+
+	/**
+   * Returns "io_uring" or "threads".
+	 */
+  const char* name() const
+  {
+    return type() == IO_URING ? "io_uring" : "threads";
+  }
+};
+
+/**
+* @brief io_uring engine. Each running batch has a ring of its own; rings are
+* set up as needed and kept for later batches.
+*/
+class UringIoEngine : public IoEngine
+{
+ public:
+	/**
+   * @throws  std::system_error If the kernel has no io_uring
+	 */
+  UringIoEngine(const unsigned depth);
+  ~UringIoEngine();
+
+  void run(IoRequest* requests, const std::size_t count);
+
+  IoEngineType type() const
+  {
+    return IO_URING;
+  }
+
+ private:
+  UringIoEngine(const UringIoEngine&);
+  UringIoEngine& operator=(const UringIoEngine&);
+
+  struct Ring;
+
+	/**
+   * Set up a ring, throwing std::system_error on failure.
+	 */
+  Ring* openRing();
+  static void closeRing(Ring* ring);
+
+	/**
+   * Run a batch on a ring owned by the caller.
+	 */
+  void runOn(Ring* ring, IoRequest* requests, const std::size_t count);
+
+  const unsigned depth;
+
+	/**
+   * Rings not in use by a batch
+	 */
+  std::vector<Ring*> idle;
+  std::mutex latch;
+};
+
+/**
+* @brief Fallback engine: a pool of threads, each doing one preadv or pwritev
+* at a time, so a batch has as many requests in flight as there are threads.
+*/
+class ThreadPoolIoEngine : public IoEngine
+{
+ public:
+  ThreadPoolIoEngine(const unsigned threads);
+  ~ThreadPoolIoEngine();
+
+  void run(IoRequest* requests, const std::size_t count);
+
+  IoEngineType type() const
+  {
+    return IO_THREAD_POOL;
+  }
+
+ private:
+  ThreadPoolIoEngine(const ThreadPoolIoEngine&);
+  ThreadPoolIoEngine& operator=(const ThreadPoolIoEngine&);
+
+	/**
+   * Requests of one run() not yet completed
+	 */
+  struct Batch
+  {
+    std::size_t remaining;
+  };
+
+  struct Task
+  {
+    IoRequest* request;
+    Batch* batch;
+  };
+
+  void workerLoop();
+
+  std::vector<std::thread> workers;
+  std::deque<Task> tasks;
+  bool stop;
+  std::mutex latch;
+  std::condition_variable queued;
+  std::condition_variable completed;
+};
+
+}
@@ -70,6 +70,8 @@ void createRelationRandom();
 void createRelationRandomEmpty(int size);
 void intTests();
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int intLookupAsync(BTreeIndex *index, int lowVal, int highVal);
+int scanAsync();
 void indexTests();
 void test1();
 void test2();
@@ -556,7 +558,74 @@ void intTests()
 	checkPassFail(intScan(&index,relationSize-10,GTE,relationSize+100,LT), 10)
 	checkPassFail(intScan(&index, -3000,GT,0,LTE), 1)
 	checkPassFail(intScan(&index, -3000,GT,5,LTE), 6)
-	
+
+	// the same index and relation read through the asynchronous interfaces
+	checkPassFail(intLookupAsync(&index, -3, 10), 10)
+	checkPassFail(intLookupAsync(&index, relationSize-10, relationSize+10), 10)
+	checkPassFail(intLookupAsync(&index, 0, relationSize), relationSize)
+	checkPassFail(scanAsync(), relationSize)
+}
+
+// -----------------------------------------------------------------------------
+// intLookupAsync
+// Looks up every key in [lowVal, highVal) at once from this thread, checks
+// that each entry found points at a record with its key, and returns the
+// number of keys found.
+// -----------------------------------------------------------------------------
+
+int intLookupAsync(BTreeIndex * index, int lowVal, int highVal)
+{
+  std::cout << "Async lookup of [" << lowVal << "," << highVal << ")" << std::endl;
+
+  AsyncExecutor executor;
+  int numFound = 0;
+  int numWrong = 0;
+  for (int key = lowVal; key < highVal; key++)
+  {
+    index->lookupAsync(&key, executor, [&, key](bool found, const RecordId& rid, std::exception_ptr error) {
+      if (error)
+        std::rethrow_exception(error);
+      if (!found)
+        return;
+      Page *curPage;
+      bufMgr->readPage(file1, rid.page_number, curPage);
+      RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(rid).data()));
+      bufMgr->unPinPage(file1, rid.page_number, false);
+      if (myRec.i == key)
+        numFound++;
+      else
+        numWrong++;
+    });
+  }
+  executor.run();
+
+  std::cout << "Number of keys found: " << numFound << std::endl;
+  return numWrong == 0 ? numFound : -numWrong;
+}
+
+// -----------------------------------------------------------------------------
+// scanAsync
+// Scans the relation with FileScan::scanAsync() and returns the number of
+// records seen.
+// -----------------------------------------------------------------------------
+
+int scanAsync()
+{
+  FileScan fscan(relationName, bufMgr);
+  AsyncExecutor executor;
+  int numRecords = 0;
+  bool done = false;
+  fscan.scanAsync(executor,
+    [&](const RecordId& scanRid, const std::string& record) { numRecords++; },
+    [&](std::exception_ptr error) {
+      if (error)
+        std::rethrow_exception(error);
+      done = true;
+    });
+  executor.run();
+
+  std::cout << "Async scan read " << numRecords << " records" << std::endl;
+  return done ? numRecords : -1;
 }
 
 int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operator highOp)
@@ -582,29 +651,20 @@ int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operato
 		return 0;
 	}
 
-	while(1)
+	while(index->tryScanNext(scanRid))
 	{
-		try
-		{
-			index->scanNext(scanRid);
-
-			bufMgr->readPage(file1, scanRid.page_number, curPage);
-			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRid).data()));
-			bufMgr->unPinPage(file1, scanRid.page_number, false);
+		bufMgr->readPage(file1, scanRid.page_number, curPage);
+		RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRid).data()));
+		bufMgr->unPinPage(file1, scanRid.page_number, false);
 
-			if( numResults < 5 )
-			{
-				std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
-				std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s <<std::endl;
-			}
-			else if( numResults == 5 )
-			{
-				std::cout << "..." << std::endl;
-			}
+		if( numResults < 5 )
+		{
+			std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
+			std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s <<std::endl;
 		}
-		catch(const IndexScanCompletedException &e)
+		else if( numResults == 5 )
 		{
-			break;
+			std::cout << "..." << std::endl;
 		}
 
 		numResults++;
@@ -755,6 +815,24 @@ void errorTests()
 			std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
 		}
 
+		std::cout << "Call scanNext after the scan completed" << std::endl;
+		try
+		{
+			RecordId foo;
+			int found = 0;
+			index.startScan(&int2, GTE, &int5, LTE);
+			while (index.tryScanNext(foo))
+				found++;
+			checkPassFail(found, 4)
+			index.scanNext(foo);
+			std::cout << "IndexScanCompletedException Test 1 Failed." << std::endl;
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+			std::cout << "IndexScanCompletedException Test 1 Passed." << std::endl;
+		}
+		index.endScan();
+
 		deleteRelation();
 	}
 
@@ -0,0 +1,684 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include "replacer.h"
+
+namespace badgerdb {
+
+ReplacementPolicy* ReplacementPolicy::create(const ReplacementPolicyType type, const std::uint32_t numBufs)
+{
+  switch (type)
+  {
+    case LRU_K:
+      return new LruKPolicy(numBufs);
+    case TWO_Q:
+      return new TwoQPolicy(numBufs);
+    case ARC:
+      return new ArcPolicy(numBufs);
+    case CLOCK:
+    default:
+      return new ClockPolicy(numBufs);
+  }
+}
+
+/**
+ * Returns the first frame of the sequence the filter accepts.
+ */
+template <class Iter>
+static bool firstEvictable(Iter begin, Iter end, FrameId& frame, const VictimFilter& evictable)
+{
+  for (Iter it = begin; it != end; ++it)
+  {
+    if (evictable(*it))
+    {
+      frame = *it;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Appends frames of a list, in order, until there are count of them.
+ */
+static void appendFrames(const std::list<FrameId>& list, std::vector<FrameId>& frames, const std::uint32_t count)
+{
+  for (std::list<FrameId>::const_iterator it = list.begin(); it != list.end() && frames.size() < count; ++it)
+    frames.push_back(*it);
+}
+
+//----------------------------------------
+// Clock
+//----------------------------------------
+
+ClockPolicy::ClockPolicy(const std::uint32_t bufs)
+  : numBufs(bufs)
+{
+  frames.resize(bufs);
+  clockHand = bufs - 1;
+}
+
+void ClockPolicy::pageLoaded(const FrameId frame, const File* file, const PageId pageNo, const AccessHint hint)
+{
+  ClockFrame& state = frames[frame];
+  state.valid = true;
+  state.refbit = hint != SCAN_ONCE;
+  state.retention = hint == HOT_INDEX_INTERNAL ? HOT_SWEEPS : 0;
+}
+
+void ClockPolicy::pageAccessed(const FrameId frame, const AccessHint hint)
+{
+  if (hint == SCAN_ONCE)
+    return;
+  ClockFrame& state = frames[frame];
+  state.refbit = true;
+  if (hint == HOT_INDEX_INTERNAL)
+    state.retention = HOT_SWEEPS;
+}
+
+void ClockPolicy::pageEvicted(const FrameId frame)
+{
+  ClockFrame& state = frames[frame];
+  state.valid = false;
+  state.refbit = false;
+  state.retention = 0;
+}
+
+void ClockPolicy::pageRemoved(const FrameId frame)
+{
+  pageEvicted(frame);
+}
+
+bool ClockPolicy::pickVictim(FrameId& frame, const VictimFilter& evictable)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  //Need to scan twice, and once more for every sweep a hot page is kept
+  for (std::uint32_t numScanned = 0; numScanned < (2 + HOT_SWEEPS) * numBufs; numScanned++)
+  {
+    // advance the clock
+    FrameId hand = (clockHand.fetch_add(1) + 1) % numBufs;
+    ClockFrame& state = frames[hand];
+
+    // has been referenced, clear the bit
+    if (state.valid && state.refbit.exchange(false))
+      continue;
+
+    // a hot page not referenced since the last sweep uses up one of its sweeps
+    if (state.valid && state.retention > 0)
+    {
+      state.retention--;
+      continue;
+    }
+
+    if (evictable(hand))
+    {
+      frame = hand;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ClockPolicy::upcomingVictims(std::vector<FrameId>& victims, const std::uint32_t count)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  victims.clear();
+  const FrameId hand = clockHand;
+
+  // the sweep takes unreferenced frames that are not kept on its first pass,
+  // the others on later ones
+  for (int kept = 0; kept < 2; kept++)
+  {
+    for (std::uint32_t i = 1; i <= numBufs && victims.size() < count; i++)
+    {
+      FrameId frame = (hand + i) % numBufs;
+      const ClockFrame& state = frames[frame];
+      if (state.valid && (state.refbit || state.retention > 0) == (kept == 1))
+        victims.push_back(frame);
+    }
+  }
+}
+
+void ClockPolicy::resize(const std::uint32_t bufs)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  // chunks are only ever added, so the state a concurrent pageLoaded() or
+  // pageAccessed() writes to never moves or goes away
+  if (bufs > frames.capacity())
+    frames.resize(bufs);
+  for (FrameId i = numBufs; i < bufs; i++)
+    pageEvicted(i);
+  numBufs = bufs;
+}
+
+//----------------------------------------
+// Deferred accesses
+//----------------------------------------
+
+DeferredAccesses::DeferredAccesses(const std::uint32_t numBufs)
+  : pending(0)
+{
+  flags.resize(numBufs);
+}
+
+void DeferredAccesses::add(const FrameId frame, const AccessHint hint)
+{
+  const std::uint8_t wanted = 1 + (hint == HOT_INDEX_INTERNAL ? HOT_INDEX_INTERNAL : NORMAL);
+  std::uint8_t seen = flags[frame].access.load();
+  while (seen < wanted && !flags[frame].access.compare_exchange_weak(seen, wanted))
+  {
+  }
+  if (seen == 0)
+    pending++;
+}
+
+void DeferredAccesses::clear(const FrameId frame)
+{
+  if (flags[frame].access.exchange(0) != 0)
+    pending--;
+}
+
+void DeferredAccesses::drain(const std::uint32_t numBufs, const std::function<void(FrameId, AccessHint)>& record)
+{
+  for (FrameId i = 0; i < numBufs && pending > 0; i++)
+  {
+    if (flags[i].access.load(std::memory_order_relaxed) == 0)
+      continue;
+    const std::uint8_t access = flags[i].access.exchange(0);
+    if (access != 0)
+    {
+      pending--;
+      record(i, (AccessHint)(access - 1));
+    }
+  }
+}
+
+void DeferredAccesses::resize(const std::uint32_t numBufs)
+{
+  // flags are only ever added, add() may be writing to one
+  if (numBufs > flags.capacity())
+    flags.resize(numBufs);
+}
+
+//----------------------------------------
+// LRU-K
+//----------------------------------------
+
+LruKPolicy::LruKPolicy(const std::uint32_t numBufs, const int kIn)
+  : k(kIn), now(0), history(numBufs), deferred(numBufs)
+{
+  for (FrameId i = 0; i < numBufs; i++)
+    freeFrames.insert(i);
+}
+
+void LruKPolicy::forget(const FrameId frame)
+{
+  const std::vector<std::uint64_t>& times = history[frame];
+  if (times.empty())
+    return;
+  std::uint64_t kth = (int)times.size() >= k ? times[k - 1] : 0;
+  order.erase(std::make_tuple(kth, times[0], frame));
+}
+
+void LruKPolicy::recordAccess(const FrameId frame, const int count)
+{
+  forget(frame);
+  std::vector<std::uint64_t>& times = history[frame];
+  times.insert(times.begin(), count, ++now);
+  if ((int)times.size() > k)
+    times.resize(k);
+  std::uint64_t kth = (int)times.size() >= k ? times[k - 1] : 0;
+  order.insert(std::make_tuple(kth, times[0], frame));
+}
+
+void LruKPolicy::pageLoaded(const FrameId frame, const File* file, const PageId pageNo, const AccessHint hint)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  freeFrames.erase(frame);
+  forget(frame);
+  history[frame].clear();
+  deferred.clear(frame);
+  if (hint == SCAN_ONCE)
+  {
+    // as if last used before anything else, so it is the next victim
+    history[frame].push_back(0);
+    order.insert(std::make_tuple((std::uint64_t)0, (std::uint64_t)0, frame));
+  }
+  else
+  {
+    recordAccess(frame, hint == HOT_INDEX_INTERNAL ? k : 1);
+  }
+}
+
+void LruKPolicy::accessed(const FrameId frame, const AccessHint hint)
+{
+  if (freeFrames.count(frame) == 0)
+    recordAccess(frame, hint == HOT_INDEX_INTERNAL ? k : 1);
+}
+
+void LruKPolicy::foldDeferred()
+{
+  deferred.drain(history.size(), [this](FrameId frame, AccessHint hint) { accessed(frame, hint); });
+}
+
+void LruKPolicy::pageAccessed(const FrameId frame, const AccessHint hint)
+{
+  if (hint == SCAN_ONCE)
+    return;
+  std::unique_lock<std::mutex> guard(latch, std::try_to_lock);
+  if (!guard.owns_lock())
+  {
+    deferred.add(frame, hint);
+    return;
+  }
+  accessed(frame, hint);
+}
+
+void LruKPolicy::pageEvicted(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  forget(frame);
+  history[frame].clear();
+  deferred.clear(frame);
+  freeFrames.insert(frame);
+}
+
+void LruKPolicy::pageRemoved(const FrameId frame)
+{
+  pageEvicted(frame);
+}
+
+bool LruKPolicy::pickVictim(FrameId& frame, const VictimFilter& evictable)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  foldDeferred();
+  if (firstEvictable(freeFrames.begin(), freeFrames.end(), frame, evictable))
+    return true;
+
+  for (Order::const_iterator it = order.begin(); it != order.end(); ++it)
+  {
+    if (evictable(std::get<2>(*it)))
+    {
+      frame = std::get<2>(*it);
+      return true;
+    }
+  }
+  return false;
+}
+
+void LruKPolicy::upcomingVictims(std::vector<FrameId>& frames, const std::uint32_t count)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  foldDeferred();
+  frames.clear();
+  for (Order::const_iterator it = order.begin(); it != order.end() && frames.size() < count; ++it)
+    frames.push_back(std::get<2>(*it));
+}
+
+void LruKPolicy::resize(const std::uint32_t numBufs)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  for (FrameId i = history.size(); i < numBufs; i++)
+    freeFrames.insert(i);
+  freeFrames.erase(freeFrames.lower_bound(numBufs), freeFrames.end());
+  history.resize(numBufs);
+  deferred.resize(numBufs);
+}
+
+//----------------------------------------
+// 2Q
+//----------------------------------------
+
+TwoQPolicy::TwoQPolicy(const std::uint32_t numBufs)
+  : kin(std::max<std::size_t>(1, numBufs / 4)), kout(std::max<std::size_t>(1, numBufs / 2)),
+    queueOf(numBufs, NONE), position(numBufs), pageOf(numBufs), scanOnly(numBufs, false), deferred(numBufs)
+{
+  for (FrameId i = 0; i < numBufs; i++)
+    freeFrames.insert(i);
+}
+
+void TwoQPolicy::unlink(const FrameId frame)
+{
+  if (queueOf[frame] == A1IN)
+    a1in.erase(position[frame]);
+  else if (queueOf[frame] == AM)
+    am.erase(position[frame]);
+  queueOf[frame] = NONE;
+}
+
+void TwoQPolicy::pageLoaded(const FrameId frame, const File* file, const PageId pageNo, const AccessHint hint)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  freeFrames.erase(frame);
+  unlink(frame);
+  deferred.clear(frame);
+  pageOf[frame] = PageKey(file, pageNo);
+  scanOnly[frame] = hint == SCAN_ONCE;
+
+  std::map<PageKey, std::list<PageKey>::iterator>::iterator ghost = a1outIndex.find(pageOf[frame]);
+  if (hint == SCAN_ONCE)
+  {
+    // next to go, and the ghost (if any) is left for a real reuse
+    queueOf[frame] = A1IN;
+    position[frame] = a1in.insert(a1in.begin(), frame);
+  }
+  else if (hint == HOT_INDEX_INTERNAL)
+  {
+    if (ghost != a1outIndex.end())
+    {
+      a1out.erase(ghost->second);
+      a1outIndex.erase(ghost);
+    }
+    queueOf[frame] = AM;
+    position[frame] = am.insert(am.end(), frame);
+  }
+  else if (ghost != a1outIndex.end())
+  {
+    // came back soon after leaving A1in, it is hot
+    a1out.erase(ghost->second);
+    a1outIndex.erase(ghost);
+    queueOf[frame] = AM;
+    position[frame] = am.insert(am.end(), frame);
+  }
+  else
+  {
+    queueOf[frame] = A1IN;
+    position[frame] = a1in.insert(a1in.end(), frame);
+  }
+}
+
+void TwoQPolicy::pageAccessed(const FrameId frame, const AccessHint hint)
+{
+  if (hint == SCAN_ONCE)
+    return;
+  std::unique_lock<std::mutex> guard(latch, std::try_to_lock);
+  if (!guard.owns_lock())
+  {
+    deferred.add(frame, hint);
+    return;
+  }
+  accessed(frame, hint);
+}
+
+void TwoQPolicy::foldDeferred()
+{
+  deferred.drain(queueOf.size(), [this](FrameId frame, AccessHint hint) { accessed(frame, hint); });
+}
+
+void TwoQPolicy::accessed(const FrameId frame, const AccessHint hint)
+{
+  scanOnly[frame] = false;
+
+  // A1in is a FIFO, only Am is kept in recency order
+  if (queueOf[frame] == AM)
+  {
+    am.splice(am.end(), am, position[frame]);
+  }
+  else if (queueOf[frame] == A1IN && hint == HOT_INDEX_INTERNAL)
+  {
+    unlink(frame);
+    queueOf[frame] = AM;
+    position[frame] = am.insert(am.end(), frame);
+  }
+}
+
+void TwoQPolicy::pageEvicted(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (queueOf[frame] == A1IN && !scanOnly[frame])
+  {
+    a1outIndex[pageOf[frame]] = a1out.insert(a1out.end(), pageOf[frame]);
+    if (a1out.size() > kout)
+    {
+      a1outIndex.erase(a1out.front());
+      a1out.pop_front();
+    }
+  }
+  unlink(frame);
+  deferred.clear(frame);
+  freeFrames.insert(frame);
+}
+
+void TwoQPolicy::pageRemoved(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  unlink(frame);
+  deferred.clear(frame);
+  freeFrames.insert(frame);
+}
+
+bool TwoQPolicy::pickVictim(FrameId& frame, const VictimFilter& evictable)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  foldDeferred();
+  if (firstEvictable(freeFrames.begin(), freeFrames.end(), frame, evictable))
+    return true;
+
+  if (a1in.size() > kin || am.empty())
+  {
+    return firstEvictable(a1in.begin(), a1in.end(), frame, evictable)
+        || firstEvictable(am.begin(), am.end(), frame, evictable);
+  }
+  return firstEvictable(am.begin(), am.end(), frame, evictable)
+      || firstEvictable(a1in.begin(), a1in.end(), frame, evictable);
+}
+
+void TwoQPolicy::upcomingVictims(std::vector<FrameId>& frames, const std::uint32_t count)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  foldDeferred();
+  frames.clear();
+  const bool a1inFirst = a1in.size() > kin || am.empty();
+  appendFrames(a1inFirst ? a1in : am, frames, count);
+  appendFrames(a1inFirst ? am : a1in, frames, count);
+}
+
+void TwoQPolicy::resize(const std::uint32_t numBufs)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  for (FrameId i = queueOf.size(); i < numBufs; i++)
+    freeFrames.insert(i);
+  freeFrames.erase(freeFrames.lower_bound(numBufs), freeFrames.end());
+  queueOf.resize(numBufs, NONE);
+  position.resize(numBufs);
+  pageOf.resize(numBufs);
+  scanOnly.resize(numBufs, false);
+  deferred.resize(numBufs);
+
+  kin = std::max<std::size_t>(1, numBufs / 4);
+  kout = std::max<std::size_t>(1, numBufs / 2);
+  while (a1out.size() > kout)
+  {
+    a1outIndex.erase(a1out.front());
+    a1out.pop_front();
+  }
+}
+
+//----------------------------------------
+// ARC
+//----------------------------------------
+
+ArcPolicy::ArcPolicy(const std::uint32_t numBufs)
+  : c(numBufs), p(0), listOf(numBufs, NONE), position(numBufs), pageOf(numBufs), scanOnly(numBufs, false),
+    deferred(numBufs)
+{
+  for (FrameId i = 0; i < numBufs; i++)
+    freeFrames.insert(i);
+}
+
+void ArcPolicy::unlink(const FrameId frame)
+{
+  if (listOf[frame] == T1)
+    t1.erase(position[frame]);
+  else if (listOf[frame] == T2)
+    t2.erase(position[frame]);
+  listOf[frame] = NONE;
+}
+
+void ArcPolicy::popGhost(GhostList& ghosts, GhostIndex& index)
+{
+  index.erase(ghosts.front());
+  ghosts.pop_front();
+}
+
+void ArcPolicy::trimGhosts()
+{
+  while (!b1.empty() && t1.size() + b1.size() > c)
+    popGhost(b1, b1Index);
+  while (t1.size() + t2.size() + b1.size() + b2.size() > 2 * c)
+  {
+    if (!b2.empty())
+      popGhost(b2, b2Index);
+    else if (!b1.empty())
+      popGhost(b1, b1Index);
+    else
+      break;
+  }
+}
+
+void ArcPolicy::pageLoaded(const FrameId frame, const File* file, const PageId pageNo, const AccessHint hint)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  freeFrames.erase(frame);
+  unlink(frame);
+  deferred.clear(frame);
+  pageOf[frame] = PageKey(file, pageNo);
+  scanOnly[frame] = hint == SCAN_ONCE;
+
+  GhostIndex::iterator ghost;
+  if (hint == SCAN_ONCE)
+  {
+    // next to go from T1, and a scan is no reason to adapt the target
+    listOf[frame] = T1;
+    position[frame] = t1.insert(t1.begin(), frame);
+  }
+  else if ((ghost = b1Index.find(pageOf[frame])) != b1Index.end())
+  {
+    // T1 was too small to keep this page, grow its target
+    p = std::min(c, p + std::max<std::size_t>(1, b2.size() / b1.size()));
+    b1.erase(ghost->second);
+    b1Index.erase(ghost);
+    listOf[frame] = T2;
+    position[frame] = t2.insert(t2.end(), frame);
+  }
+  else if ((ghost = b2Index.find(pageOf[frame])) != b2Index.end())
+  {
+    // T2 was too small to keep this page, shrink the target of T1
+    std::size_t delta = std::max<std::size_t>(1, b1.size() / b2.size());
+    p = p > delta ? p - delta : 0;
+    b2.erase(ghost->second);
+    b2Index.erase(ghost);
+    listOf[frame] = T2;
+    position[frame] = t2.insert(t2.end(), frame);
+  }
+  else if (hint == HOT_INDEX_INTERNAL)
+  {
+    listOf[frame] = T2;
+    position[frame] = t2.insert(t2.end(), frame);
+  }
+  else
+  {
+    listOf[frame] = T1;
+    position[frame] = t1.insert(t1.end(), frame);
+  }
+  trimGhosts();
+}
+
+void ArcPolicy::pageAccessed(const FrameId frame, const AccessHint hint)
+{
+  if (hint == SCAN_ONCE)
+    return;
+  std::unique_lock<std::mutex> guard(latch, std::try_to_lock);
+  if (!guard.owns_lock())
+  {
+    deferred.add(frame, hint);
+    return;
+  }
+  accessed(frame, hint);
+}
+
+void ArcPolicy::foldDeferred()
+{
+  deferred.drain(listOf.size(), [this](FrameId frame, AccessHint hint) { accessed(frame, hint); });
+}
+
+void ArcPolicy::accessed(const FrameId frame, const AccessHint hint)
+{
+  if (listOf[frame] == NONE)
+    return;
+  scanOnly[frame] = false;
+  unlink(frame);
+  listOf[frame] = T2;
+  position[frame] = t2.insert(t2.end(), frame);
+}
+
+void ArcPolicy::pageEvicted(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (listOf[frame] == T1 && !scanOnly[frame])
+    b1Index[pageOf[frame]] = b1.insert(b1.end(), pageOf[frame]);
+  else if (listOf[frame] == T2)
+    b2Index[pageOf[frame]] = b2.insert(b2.end(), pageOf[frame]);
+  unlink(frame);
+  deferred.clear(frame);
+  freeFrames.insert(frame);
+  trimGhosts();
+}
+
+void ArcPolicy::pageRemoved(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  unlink(frame);
+  deferred.clear(frame);
+  freeFrames.insert(frame);
+}
+
+bool ArcPolicy::pickVictim(FrameId& frame, const VictimFilter& evictable)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  foldDeferred();
+  if (firstEvictable(freeFrames.begin(), freeFrames.end(), frame, evictable))
+    return true;
+
+  if (!t1.empty() && (t1.size() >= p || t2.empty()))
+  {
+    return firstEvictable(t1.begin(), t1.end(), frame, evictable)
+        || firstEvictable(t2.begin(), t2.end(), frame, evictable);
+  }
+  return firstEvictable(t2.begin(), t2.end(), frame, evictable)
+      || firstEvictable(t1.begin(), t1.end(), frame, evictable);
+}
+
+void ArcPolicy::upcomingVictims(std::vector<FrameId>& frames, const std::uint32_t count)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  foldDeferred();
+  frames.clear();
+  const bool t1First = !t1.empty() && (t1.size() >= p || t2.empty());
+  appendFrames(t1First ? t1 : t2, frames, count);
+  appendFrames(t1First ? t2 : t1, frames, count);
+}
+
+void ArcPolicy::resize(const std::uint32_t numBufs)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  for (FrameId i = listOf.size(); i < numBufs; i++)
+    freeFrames.insert(i);
+  freeFrames.erase(freeFrames.lower_bound(numBufs), freeFrames.end());
+  listOf.resize(numBufs, NONE);
+  position.resize(numBufs);
+  pageOf.resize(numBufs);
+  scanOnly.resize(numBufs, false);
+  deferred.resize(numBufs);
+
+  c = numBufs;
+  p = std::min(p, c);
+  trimGhosts();
+}
+
+}
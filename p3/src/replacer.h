@@ -0,0 +1,552 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "file.h"
+#include "frameArray.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Page replacement policies a BufMgr can be constructed with.
+ */
+enum ReplacementPolicyType
+{
+	CLOCK = 0,
+	LRU_K = 1,
+	TWO_Q = 2,
+	ARC = 3
+};
+
+/**
+ * @brief How a page is expected to be used, passed with every access so that
+ * the replacement policy can keep or drop it accordingly.
+ */
+enum AccessHint
+{
+	/**
+	 * No expectation, the policy decides from the access pattern alone
+	 */
+	NORMAL = 0,
+
+	/**
+	 * An inner page of an index, passed on every lookup: keep it over pages
+	 * seen as often that are not marked
+	 */
+	HOT_INDEX_INTERNAL = 1,
+
+	/**
+	 * Read once by a scan and not needed again: evict it early and do not let
+	 * the access count as a reuse
+	 */
+	SCAN_ONCE = 2
+};
+
+/**
+ * @brief Identifies a page independently of the frame it is (or was) held in.
+ */
+typedef std::pair<const File*, PageId> PageKey;
+
+/**
+ * @brief Tells a policy whether a frame can be evicted right now (it is not
+ * pinned and the buffer manager has not already failed to claim it).
+ */
+typedef std::function<bool(FrameId)> VictimFilter;
+
+/**
+ * @brief Interface of the page replacement policy used by BufMgr.
+ *
+ * The buffer manager reports every page it installs in, finds in, or drops
+ * from a frame, and asks the policy for a victim frame when it needs one.
+ * Frames that do not hold a page are free, and a policy should hand those out
+ * before evicting anything.  pickVictim() only proposes a frame: the buffer
+ * manager may fail to claim it (another thread pinned it in the meantime), in
+ * which case it asks again with a filter that excludes that frame.  Once a
+ * victim is claimed, pageEvicted() is called for it.
+ *
+ * Implementations must be safe to call from several threads and must not call
+ * back into BufMgr.  pageLoaded() and pageAccessed() are called once the
+ * partition latch of the page has been released, with the frame pinned; the
+ * other calls are made with partition latches held.
+ */
+class ReplacementPolicy
+{
+ public:
+  /**
+   * Creates a policy of the given type for a pool of numBufs frames.
+   *
+   * @param type      Policy to create
+   * @param numBufs   Number of frames in the buffer pool
+   * @return  The new policy, owned by the caller.
+   */
+  static ReplacementPolicy* create(const ReplacementPolicyType type, const std::uint32_t numBufs);
+
+  virtual ~ReplacementPolicy() {}
+
+  /**
+   * A page was read into or allocated in a free frame.
+   *
+   * @param frame   Frame now holding the page
+   * @param file    File of the page
+   * @param pageNo  Page number in the file
+   * @param hint    How the page is expected to be used
+   */
+  virtual void pageLoaded(const FrameId frame, const File* file, const PageId pageNo, const AccessHint hint) = 0;
+
+  /**
+   * The page held in the frame was pinned again.
+   *
+   * @param frame   Frame holding the page
+   * @param hint    How the page is expected to be used
+   */
+  virtual void pageAccessed(const FrameId frame, const AccessHint hint) = 0;
+
+  /**
+   * The page in a frame returned by pickVictim() was evicted to make room.
+   *
+   * @param frame   Frame that is now free
+   */
+  virtual void pageEvicted(const FrameId frame) = 0;
+
+  /**
+   * The page in the frame was dropped for another reason (its file was
+   * flushed or the page disposed). It is not remembered as evicted.
+   *
+   * @param frame   Frame that is now free
+   */
+  virtual void pageRemoved(const FrameId frame) = 0;
+
+  /**
+   * Proposes the frame to reuse next.
+   *
+   * @param frame       Proposed frame returned via this variable
+   * @param evictable   Frames this returns false for must not be proposed
+   * @return  False if no frame can be proposed.
+   */
+  virtual bool pickVictim(FrameId& frame, const VictimFilter& evictable) = 0;
+
+  /**
+   * Lists frames holding pages in the order the policy would evict them,
+   * without changing its state. Used to write pages back before they are
+   * evicted.
+   *
+   * @param frames  Frames returned via this vector, cleared first
+   * @param count   Maximum number of frames to list
+   */
+  virtual void upcomingVictims(std::vector<FrameId>& frames, const std::uint32_t count) = 0;
+
+  /**
+   * The buffer pool now has numBufs frames. New frames are free; frames
+   * dropped by a shrink hold no page (pageRemoved() was called for them).
+   * Called with every hash table partition latch held, so only pickVictim(),
+   * upcomingVictims(), and pageLoaded() and pageAccessed() for pinned frames,
+   * which the resize keeps, can run at the same time. State those two touch
+   * must therefore stay where it is.
+   *
+   * @param numBufs   New number of frames
+   */
+  virtual void resize(const std::uint32_t numBufs) = 0;
+
+  /**
+   * Returns the name of the policy.
+   */
+  virtual const char* name() const = 0;
+};
+
+/**
+ * @brief The clock (second chance) policy BufMgr always used: a hand sweeps
+ * the frames, clearing reference bits and taking the first unreferenced one.
+ *
+ * Accesses only set a bit, so the hit path takes no latch. The per-frame state
+ * is kept in a FrameArray that resize() only ever grows, so an access racing
+ * with a resize never writes to freed memory. The sweep takes a latch so that
+ * resize() can change numBufs under it. Pages accessed as
+ * HOT_INDEX_INTERNAL survive HOT_SWEEPS more sweeps without being referenced;
+ * SCAN_ONCE pages are loaded without their reference bit.
+ */
+class ClockPolicy : public ReplacementPolicy
+{
+ public:
+  ClockPolicy(const std::uint32_t numBufs);
+
+  void pageLoaded(const FrameId frame, const File* file, const PageId pageNo, const AccessHint hint) override;
+  void pageAccessed(const FrameId frame, const AccessHint hint) override;
+  void pageEvicted(const FrameId frame) override;
+  void pageRemoved(const FrameId frame) override;
+  bool pickVictim(FrameId& frame, const VictimFilter& evictable) override;
+  void upcomingVictims(std::vector<FrameId>& frames, const std::uint32_t count) override;
+  void resize(const std::uint32_t numBufs) override;
+  const char* name() const override { return "clock"; }
+
+ private:
+  /**
+   * Number of frames in the buffer pool
+   */
+  std::uint32_t numBufs;
+
+  /**
+   * Current position of clockhand in our buffer pool. Only ever incremented,
+   * the frame it points at is clockHand % numBufs.
+   */
+  std::atomic<FrameId> clockHand;
+
+  /**
+   * Sweeps an unreferenced HOT_INDEX_INTERNAL page is passed over before it
+   * is evicted
+   */
+  static const std::uint8_t HOT_SWEEPS = 3;
+
+  /**
+   * What the clock knows about a frame
+   */
+  struct ClockFrame
+  {
+    ClockFrame() : valid(false), refbit(false), retention(0) {}
+
+    /**
+     * True if the frame holds a page
+     */
+    std::atomic<bool> valid;
+
+    /**
+     * Has this buffer frame been reference recently
+     */
+    std::atomic<bool> refbit;
+
+    /**
+     * Sweeps the frame has left before it can be evicted, once its reference
+     * bit is clear
+     */
+    std::atomic<std::uint8_t> retention;
+  };
+
+  /**
+   * State of every frame, never shrunk
+   */
+  FrameArray<ClockFrame> frames;
+
+  /**
+   * Guards numBufs against resize() during a sweep
+   */
+  std::mutex latch;
+};
+
+/**
+ * @brief Hits a policy that orders its frames under one latch did not wait
+ * for. When the latch is busy, pageAccessed() flags the frame here and
+ * returns; the policy folds the flagged frames in, as accessed at that moment,
+ * before it next picks or lists victims. Hits on a busy policy therefore only
+ * write a flag, at the cost of the order among them.
+ *
+ * The flags are kept in a FrameArray that is only grown, as accesses run
+ * concurrently with resize().
+ */
+class DeferredAccesses
+{
+ public:
+  DeferredAccesses(const std::uint32_t numBufs);
+
+  /**
+   * Flags an access to the page in the frame. A HOT_INDEX_INTERNAL access is
+   * kept over a NORMAL one; SCAN_ONCE accesses are not to be flagged.
+   *
+   * @param frame   Frame holding the page, pinned by the caller
+   * @param hint    How the page is expected to be used
+   */
+  void add(const FrameId frame, const AccessHint hint);
+
+  /**
+   * Drops the flag of a frame whose page is gone. Called under the policy
+   * latch.
+   *
+   * @param frame   Frame that no longer holds the page
+   */
+  void clear(const FrameId frame);
+
+  /**
+   * Hands every flagged frame below numBufs, with the hint it was flagged
+   * with, to record and drops its flag. Called under the policy latch.
+   *
+   * @param numBufs   Number of frames the policy knows
+   * @param record    Records the access as if it happened now
+   */
+  void drain(const std::uint32_t numBufs, const std::function<void(FrameId, AccessHint)>& record);
+
+  /**
+   * Makes room for flags of numBufs frames. Called under the policy latch.
+   *
+   * @param numBufs   New number of frames
+   */
+  void resize(const std::uint32_t numBufs);
+
+ private:
+  /**
+   * Flag of one frame: 0, or 1 + the hint of the access
+   */
+  struct Flag
+  {
+    Flag() : access(0) {}
+    std::atomic<std::uint8_t> access;
+  };
+
+  FrameArray<Flag> flags;
+
+  /**
+   * Number of frames flagged, so that draining without any skips the scan.
+   * Can dip below zero while add() and drain() race.
+   */
+  std::atomic<int> pending;
+};
+
+/**
+ * @brief LRU-K (O'Neil et al.): evicts the page whose K-th most recent access
+ * lies furthest in the past. Pages accessed fewer than K times are evicted
+ * first, least recently used first, so one-off scans do not push out pages
+ * that are used repeatedly.
+ *
+ * A HOT_INDEX_INTERNAL access counts as K accesses at once. A SCAN_ONCE load
+ * is recorded as an access at time 0, so the page goes first. Hits that find
+ * the latch busy are deferred (see DeferredAccesses).
+ */
+class LruKPolicy : public ReplacementPolicy
+{
+ public:
+  LruKPolicy(const std::uint32_t numBufs, const int k = 2);
+
+  void pageLoaded(const FrameId frame, const File* file, const PageId pageNo, const AccessHint hint) override;
+  void pageAccessed(const FrameId frame, const AccessHint hint) override;
+  void pageEvicted(const FrameId frame) override;
+  void pageRemoved(const FrameId frame) override;
+  bool pickVictim(FrameId& frame, const VictimFilter& evictable) override;
+  void upcomingVictims(std::vector<FrameId>& frames, const std::uint32_t count) override;
+  void resize(const std::uint32_t numBufs) override;
+  const char* name() const override { return "lru-k"; }
+
+ private:
+  /**
+   * Eviction order: (K-th most recent access, most recent access, frame).
+   * The K-th access time is 0 for pages with fewer than K accesses.
+   */
+  typedef std::set<std::tuple<std::uint64_t, std::uint64_t, FrameId> > Order;
+
+  /**
+   * Adds count accesses at the current time to the frame's history and
+   * reorders it.
+   */
+  void recordAccess(const FrameId frame, const int count = 1);
+
+  /**
+   * Drops the frame from the eviction order.
+   */
+  void forget(const FrameId frame);
+
+  /**
+   * Records a hit on the page in the frame. Called under the latch.
+   */
+  void accessed(const FrameId frame, const AccessHint hint);
+
+  /**
+   * Records the hits deferred since the last call. Called under the latch.
+   */
+  void foldDeferred();
+
+  std::mutex latch;
+  const int k;
+  std::uint64_t now;
+
+  /**
+   * Last k access times of every frame, most recent first
+   */
+  std::vector<std::vector<std::uint64_t> > history;
+
+  /**
+   * Frames not holding a page, handed out before any page is evicted
+   */
+  std::set<FrameId> freeFrames;
+
+  Order order;
+  DeferredAccesses deferred;
+};
+
+/**
+ * @brief 2Q (Johnson and Shasha), full version. New pages enter a FIFO (A1in);
+ * pages evicted from it are remembered in a ghost FIFO (A1out), and only pages
+ * that come back while remembered there enter the LRU list of hot pages (Am).
+ *
+ * HOT_INDEX_INTERNAL pages go to Am straight away. SCAN_ONCE pages go to the
+ * head of A1in and are not remembered in A1out once evicted. Hits that find
+ * the latch busy are deferred (see DeferredAccesses).
+ */
+class TwoQPolicy : public ReplacementPolicy
+{
+ public:
+  TwoQPolicy(const std::uint32_t numBufs);
+
+  void pageLoaded(const FrameId frame, const File* file, const PageId pageNo, const AccessHint hint) override;
+  void pageAccessed(const FrameId frame, const AccessHint hint) override;
+  void pageEvicted(const FrameId frame) override;
+  void pageRemoved(const FrameId frame) override;
+  bool pickVictim(FrameId& frame, const VictimFilter& evictable) override;
+  void upcomingVictims(std::vector<FrameId>& frames, const std::uint32_t count) override;
+  void resize(const std::uint32_t numBufs) override;
+  const char* name() const override { return "2q"; }
+
+ private:
+  enum Queue { NONE, A1IN, AM };
+
+  /**
+   * Drops the frame from the queue it is in.
+   */
+  void unlink(const FrameId frame);
+
+  /**
+   * Records a hit on the page in the frame. Called under the latch.
+   */
+  void accessed(const FrameId frame, const AccessHint hint);
+
+  /**
+   * Records the hits deferred since the last call. Called under the latch.
+   */
+  void foldDeferred();
+
+  std::mutex latch;
+
+  /**
+   * Target size of A1in and capacity of A1out
+   */
+  std::size_t kin, kout;
+
+  /**
+   * Resident queues, oldest/least recently used first
+   */
+  std::list<FrameId> a1in, am;
+
+  /**
+   * Ghost queue of evicted pages, oldest first, and its index
+   */
+  std::list<PageKey> a1out;
+  std::map<PageKey, std::list<PageKey>::iterator> a1outIndex;
+
+  /**
+   * Queue each frame is in, its position there and the page it holds
+   */
+  std::vector<Queue> queueOf;
+  std::vector<std::list<FrameId>::iterator> position;
+  std::vector<PageKey> pageOf;
+
+  /**
+   * True if the page in the frame was only read by a scan so far
+   */
+  std::vector<bool> scanOnly;
+
+  std::set<FrameId> freeFrames;
+  DeferredAccesses deferred;
+};
+
+/**
+ * @brief ARC (Megiddo and Modha): balances a list of pages seen once (T1)
+ * against a list of pages seen at least twice (T2), moving the target size of
+ * T1 according to hits in the ghost lists of pages recently evicted from
+ * either (B1, B2).
+ *
+ * ARC picks the list to evict from knowing which page is coming in; BufMgr
+ * chooses the victim before the page is known, so ties that the paper breaks
+ * on "is the new page in B2" are broken towards T1.
+ *
+ * HOT_INDEX_INTERNAL pages go to T2 straight away. SCAN_ONCE pages go to the
+ * least recently used end of T1 and are not remembered in B1 once evicted.
+ * Hits that find the latch busy are deferred (see DeferredAccesses).
+ */
+class ArcPolicy : public ReplacementPolicy
+{
+ public:
+  ArcPolicy(const std::uint32_t numBufs);
+
+  void pageLoaded(const FrameId frame, const File* file, const PageId pageNo, const AccessHint hint) override;
+  void pageAccessed(const FrameId frame, const AccessHint hint) override;
+  void pageEvicted(const FrameId frame) override;
+  void pageRemoved(const FrameId frame) override;
+  bool pickVictim(FrameId& frame, const VictimFilter& evictable) override;
+  void upcomingVictims(std::vector<FrameId>& frames, const std::uint32_t count) override;
+  void resize(const std::uint32_t numBufs) override;
+  const char* name() const override { return "arc"; }
+
+ private:
+  enum List { NONE, T1, T2 };
+
+  typedef std::list<PageKey> GhostList;
+  typedef std::map<PageKey, GhostList::iterator> GhostIndex;
+
+  /**
+   * Drops the frame from the list it is in.
+   */
+  void unlink(const FrameId frame);
+
+  /**
+   * Removes the least recently used entry of a ghost list.
+   */
+  static void popGhost(GhostList& ghosts, GhostIndex& index);
+
+  /**
+   * Keeps T1 + B1 within c entries and all four lists within 2c entries.
+   */
+  void trimGhosts();
+
+  /**
+   * Records a hit on the page in the frame. Called under the latch.
+   */
+  void accessed(const FrameId frame, const AccessHint hint);
+
+  /**
+   * Records the hits deferred since the last call. Called under the latch.
+   */
+  void foldDeferred();
+
+  std::mutex latch;
+
+  /**
+   * Number of frames, and target size of T1
+   */
+  std::size_t c, p;
+
+  /**
+   * Resident lists, least recently used first
+   */
+  std::list<FrameId> t1, t2;
+
+  /**
+   * Ghost lists, least recently used first, and their indexes
+   */
+  GhostList b1, b2;
+  GhostIndex b1Index, b2Index;
+
+  std::vector<List> listOf;
+  std::vector<std::list<FrameId>::iterator> position;
+  std::vector<PageKey> pageOf;
+
+  /**
+   * True if the page in the frame was only read by a scan so far
+   */
+  std::vector<bool> scanOnly;
+
+  std::set<FrameId> freeFrames;
+  DeferredAccesses deferred;
+};
+
+}
@@ -0,0 +1,568 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "shmBufMgr.h"
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/hash_not_found_exception.h"
+#include "exceptions/page_not_pinned_exception.h"
+#include "exceptions/page_pinned_exception.h"
+#include "exceptions/shared_memory_exception.h"
+
+namespace badgerdb {
+
+/**
+ * Written last when a segment is created, attaching processes wait for it.
+ */
+static const std::uint64_t SEGMENT_MAGIC = 0x42444253484d3031ULL;
+
+/**
+ * How long to wait for another process to finish creating a segment.
+ */
+static const int ATTACH_TIMEOUT_MS = 5000;
+
+/**
+ * Holds a process shared mutex for the enclosing scope.
+ */
+class ShmLatchGuard
+{
+ public:
+  ShmLatchGuard(pthread_mutex_t* latchIn, void (*lockFn)(pthread_mutex_t*))
+    : latch(latchIn)
+  {
+    lockFn(latch);
+  }
+
+  ~ShmLatchGuard()
+  {
+    pthread_mutex_unlock(latch);
+  }
+
+ private:
+  pthread_mutex_t* latch;
+};
+
+static std::size_t roundUp(const std::size_t bytes)
+{
+  return (bytes + 63) & ~(std::size_t)63;
+}
+
+std::size_t ShmBufMgr::segmentBytes(const std::uint32_t bufs, const std::uint32_t numBuckets)
+{
+  return roundUp(sizeof(Header)) + roundUp(bufs * sizeof(Frame))
+      + roundUp(numBuckets * sizeof(std::uint32_t)) + bufs * sizeof(Page);
+}
+
+void ShmBufMgr::lock(pthread_mutex_t* latch)
+{
+  // the owner died holding it; what it protects is only ever updated in
+  // single steps, so it is safe to carry on
+  if (pthread_mutex_lock(latch) == EOWNERDEAD)
+    pthread_mutex_consistent(latch);
+}
+
+ShmBufMgr::ShmBufMgr(const std::string& nameIn, const std::uint32_t bufs)
+	: name(nameIn), segment(NULL), segmentSize(0)
+{
+  createOrAttach(bufs);
+  header->attached++;
+}
+
+ShmBufMgr::~ShmBufMgr()
+{
+  if (--header->attached == 0)
+  {
+    try
+    {
+      flushAll();
+    }
+    catch(...)
+    {
+    }
+  }
+
+  for (std::map<std::uint32_t, File*>::iterator it = ownedFiles.begin(); it != ownedFiles.end(); ++it)
+    delete it->second;
+  munmap(segment, segmentSize);
+}
+
+void ShmBufMgr::remove(const std::string& name)
+{
+  shm_unlink(name.c_str());
+}
+
+void ShmBufMgr::mapParts(const std::uint32_t bufs, const std::uint32_t numBuckets)
+{
+  char* base = static_cast<char*>(segment);
+  header = reinterpret_cast<Header*>(base);
+  base += roundUp(sizeof(Header));
+  frames = reinterpret_cast<Frame*>(base);
+  base += roundUp(bufs * sizeof(Frame));
+  buckets = reinterpret_cast<std::uint32_t*>(base);
+  base += roundUp(numBuckets * sizeof(std::uint32_t));
+  pages = reinterpret_cast<Page*>(base);
+}
+
+void ShmBufMgr::createOrAttach(const std::uint32_t bufs)
+{
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  const bool creator = fd >= 0;
+  if (!creator)
+  {
+    if (errno != EEXIST)
+      throw SharedMemoryException(name, strerror(errno));
+    fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0)
+      throw SharedMemoryException(name, strerror(errno));
+  }
+
+  if (creator)
+  {
+    std::uint32_t numBuckets = NUM_PARTITIONS;
+    while (numBuckets < bufs)
+      numBuckets <<= 1;
+    segmentSize = segmentBytes(bufs, numBuckets);
+    if (bufs == 0 || ftruncate(fd, segmentSize) != 0)
+    {
+      close(fd);
+      shm_unlink(name.c_str());
+      throw SharedMemoryException(name, bufs == 0 ? "no frames" : strerror(errno));
+    }
+  }
+  else
+  {
+    // the creator sizes the segment before it initializes it
+    struct stat st;
+    int waited = 0;
+    while (fstat(fd, &st) == 0 && (std::size_t)st.st_size < sizeof(Header) && waited++ < ATTACH_TIMEOUT_MS)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if ((std::size_t)st.st_size < sizeof(Header))
+    {
+      close(fd);
+      throw SharedMemoryException(name, "not created in time");
+    }
+    segmentSize = st.st_size;
+  }
+
+  segment = mmap(NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED)
+    throw SharedMemoryException(name, strerror(errno));
+  header = static_cast<Header*>(segment);
+
+  if (!creator)
+  {
+    int waited = 0;
+    while (header->magic != SEGMENT_MAGIC && waited++ < ATTACH_TIMEOUT_MS)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (header->magic != SEGMENT_MAGIC || segmentBytes(header->numBufs, header->numBuckets) != segmentSize)
+    {
+      munmap(segment, segmentSize);
+      throw SharedMemoryException(name, "not a buffer pool segment");
+    }
+    mapParts(header->numBufs, header->numBuckets);
+    return;
+  }
+
+  // the segment is zero filled; construct what lives in it
+  new (header) Header();
+  std::uint32_t numBuckets = NUM_PARTITIONS;
+  while (numBuckets < bufs)
+    numBuckets <<= 1;
+  header->numBufs = bufs;
+  header->numBuckets = numBuckets;
+  header->clockHand = 0;
+  header->attached = 0;
+  mapParts(bufs, numBuckets);
+
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&header->fileLatch, &attr);
+  for (int i = 0; i < NUM_PARTITIONS; i++)
+    pthread_mutex_init(&header->partitions[i], &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  for (int i = 0; i < MAX_FILES; i++)
+    header->files[i].used = false;
+  for (std::uint32_t i = 0; i < bufs; i++)
+  {
+    Frame* frame = new (&frames[i]) Frame();
+    frame->pinCnt = 0;
+    frame->valid = false;
+    frame->dirty = false;
+    frame->refbit = false;
+    frame->ioInProgress = false;
+    frame->hashNext = NO_FRAME;
+    new (&pages[i]) Page();
+  }
+  for (std::uint32_t i = 0; i < numBuckets; i++)
+    buckets[i] = NO_FRAME;
+
+  header->magic = SEGMENT_MAGIC;
+}
+
+std::uint32_t ShmBufMgr::fileId(const File* file)
+{
+  std::lock_guard<std::mutex> localGuard(localLatch);
+  std::map<const File*, std::uint32_t>::iterator it = fileIds.find(file);
+  if (it != fileIds.end())
+    return it->second;
+
+  const std::string& fileName = file->filename();
+  if (fileName.size() >= (std::size_t)MAX_NAME)
+    throw SharedMemoryException(name, "file name too long: " + fileName);
+
+  std::uint32_t id = MAX_FILES;
+  {
+    ShmLatchGuard fileGuard(&header->fileLatch, lock);
+    for (int i = 0; i < MAX_FILES && id == (std::uint32_t)MAX_FILES; i++)
+    {
+      if (header->files[i].used && fileName == header->files[i].name)
+        id = i;
+    }
+    for (int i = 0; i < MAX_FILES && id == (std::uint32_t)MAX_FILES; i++)
+    {
+      if (!header->files[i].used)
+      {
+        header->files[i].blob = dynamic_cast<const BlobFile*>(file) != NULL;
+        strcpy(header->files[i].name, fileName.c_str());
+        header->files[i].used = true;
+        id = i;
+      }
+    }
+  }
+  if (id == (std::uint32_t)MAX_FILES)
+    throw SharedMemoryException(name, "too many files");
+
+  fileIds[file] = id;
+  return id;
+}
+
+File* ShmBufMgr::localFile(const std::uint32_t id)
+{
+  std::lock_guard<std::mutex> localGuard(localLatch);
+  std::map<std::uint32_t, File*>::iterator it = localFiles.find(id);
+  if (it != localFiles.end())
+    return it->second;
+
+  // a page another process read and dirtied, in a file this one has not used
+  const FileSlot& slot = header->files[id];
+  File* file;
+  if (slot.blob)
+    file = new BlobFile(slot.name, false);
+  else
+    file = new PageFile(slot.name, false);
+  ownedFiles[id] = file;
+  localFiles[id] = file;
+  return file;
+}
+
+std::uint32_t ShmBufMgr::bucketOf(const std::uint32_t id, const PageId pageNo) const
+{
+  std::uint64_t h = ((std::uint64_t)id << 32 | pageNo) * 0x9e3779b97f4a7c15ULL;
+  h ^= h >> 31;
+  return h & (header->numBuckets - 1);
+}
+
+pthread_mutex_t* ShmBufMgr::partitionOf(const std::uint32_t bucket) const
+{
+  return &header->partitions[bucket % NUM_PARTITIONS];
+}
+
+std::uint32_t ShmBufMgr::lookup(const std::uint32_t bucket, const std::uint32_t id, const PageId pageNo) const
+{
+  for (std::uint32_t frame = buckets[bucket]; frame != NO_FRAME; frame = frames[frame].hashNext)
+  {
+    if (frames[frame].fileId == id && frames[frame].pageNo == pageNo)
+      return frame;
+  }
+  return NO_FRAME;
+}
+
+void ShmBufMgr::unlink(const std::uint32_t bucket, const std::uint32_t frame)
+{
+  std::uint32_t* link = &buckets[bucket];
+  while (*link != NO_FRAME && *link != frame)
+    link = &frames[*link].hashNext;
+  if (*link == frame)
+    *link = frames[frame].hashNext;
+  frames[frame].hashNext = NO_FRAME;
+}
+
+bool ShmBufMgr::tryPin(const std::uint32_t frame)
+{
+  std::int32_t pins = frames[frame].pinCnt;
+  while (pins >= 0)
+  {
+    if (frames[frame].pinCnt.compare_exchange_weak(pins, pins + 1))
+    {
+      frames[frame].refbit = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ShmBufMgr::dropClaimed(const std::uint32_t frame)
+{
+  Frame& desc = frames[frame];
+  if (!desc.valid)
+    return;
+
+  // written while still in the hash table, so nobody reads a stale copy
+  // from disk meanwhile; they wait for the claim to end instead
+  if (desc.dirty)
+  {
+    try
+    {
+      localFile(desc.fileId)->writePage(desc.pageNo, pages[frame]);
+    }
+    catch(...)
+    {
+      desc.pinCnt = 0;
+      throw;
+    }
+    desc.dirty = false;
+  }
+
+  const std::uint32_t bucket = bucketOf(desc.fileId, desc.pageNo);
+  ShmLatchGuard partitionGuard(partitionOf(bucket), lock);
+  unlink(bucket, frame);
+  desc.valid = false;
+}
+
+std::uint32_t ShmBufMgr::claimFrame()
+{
+  const std::uint32_t numBufs = header->numBufs;
+  for (std::uint64_t scanned = 0; scanned < 3 * (std::uint64_t)numBufs; scanned++)
+  {
+    const std::uint32_t frame = header->clockHand.fetch_add(1) % numBufs;
+    Frame& desc = frames[frame];
+    if (desc.valid && desc.refbit.exchange(false))
+      continue;
+
+    std::int32_t unpinned = 0;
+    if (!desc.pinCnt.compare_exchange_strong(unpinned, -1))
+      continue;
+    dropClaimed(frame);
+    return frame;
+  }
+  throw BufferExceededException();
+}
+
+bool ShmBufMgr::install(const std::uint32_t frame, const std::uint32_t id, const PageId pageNo)
+{
+  const std::uint32_t bucket = bucketOf(id, pageNo);
+  ShmLatchGuard partitionGuard(partitionOf(bucket), lock);
+  if (lookup(bucket, id, pageNo) != NO_FRAME)
+  {
+    // another process got to the page first
+    frames[frame].pinCnt = 0;
+    return false;
+  }
+
+  Frame& desc = frames[frame];
+  desc.fileId = id;
+  desc.pageNo = pageNo;
+  desc.dirty = false;
+  desc.refbit = true;
+  desc.ioInProgress = true;
+  desc.valid = true;
+  desc.hashNext = buckets[bucket];
+  buckets[bucket] = frame;
+  desc.pinCnt = 1;
+  return true;
+}
+
+void ShmBufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+{
+  const std::uint32_t id = fileId(file);
+  {
+    std::lock_guard<std::mutex> localGuard(localLatch);
+    localFiles.insert(std::make_pair(id, file));
+  }
+  const std::uint32_t bucket = bucketOf(id, pageNo);
+
+  while (true)
+  {
+    std::uint32_t frame;
+    bool pinned = false;
+    {
+      ShmLatchGuard partitionGuard(partitionOf(bucket), lock);
+      frame = lookup(bucket, id, pageNo);
+      if (frame != NO_FRAME)
+        pinned = tryPin(frame);
+    }
+
+    if (frame != NO_FRAME)
+    {
+      // being written back by the process evicting it
+      if (!pinned)
+      {
+        std::this_thread::yield();
+        continue;
+      }
+
+      // being read by another process
+      while (frames[frame].ioInProgress)
+        std::this_thread::yield();
+      if (frames[frame].valid)
+      {
+        page = &pages[frame];
+        return;
+      }
+
+      // that read failed, try again
+      frames[frame].pinCnt--;
+      continue;
+    }
+
+    frame = claimFrame();
+    if (!install(frame, id, pageNo))
+      continue;
+
+    try
+    {
+      file->readPage(pageNo, pages[frame]);
+    }
+    catch(...)
+    {
+      {
+        ShmLatchGuard partitionGuard(partitionOf(bucket), lock);
+        unlink(bucket, frame);
+        frames[frame].valid = false;
+      }
+      frames[frame].ioInProgress = false;
+      frames[frame].pinCnt--;
+      throw;
+    }
+    frames[frame].ioInProgress = false;
+    page = &pages[frame];
+    return;
+  }
+}
+
+void ShmBufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
+{
+  const std::uint32_t id = fileId(file);
+  const std::uint32_t bucket = bucketOf(id, pageNo);
+  ShmLatchGuard partitionGuard(partitionOf(bucket), lock);
+  const std::uint32_t frame = lookup(bucket, id, pageNo);
+  if (frame == NO_FRAME)
+    throw HashNotFoundException(file->filename(), pageNo);
+  if (frames[frame].pinCnt <= 0)
+    throw PageNotPinnedException(file->filename(), pageNo, frame);
+
+  if (dirty)
+    frames[frame].dirty = true;
+  frames[frame].pinCnt--;
+}
+
+void ShmBufMgr::allocPage(File* file, PageId& pageNo, Page*& page)
+{
+  const std::uint32_t id = fileId(file);
+  {
+    std::lock_guard<std::mutex> localGuard(localLatch);
+    localFiles.insert(std::make_pair(id, file));
+  }
+
+  const std::uint32_t frame = claimFrame();
+  try
+  {
+    file->allocatePage(pageNo, pages[frame]);
+  }
+  catch(...)
+  {
+    frames[frame].pinCnt = 0;
+    throw;
+  }
+
+  // nobody else can know the new page number yet
+  install(frame, id, pageNo);
+  frames[frame].ioInProgress = false;
+  page = &pages[frame];
+}
+
+void ShmBufMgr::flushFile(const File* file)
+{
+  const std::uint32_t id = fileId(file);
+  for (std::uint32_t frame = 0; frame < header->numBufs; frame++)
+  {
+    Frame& desc = frames[frame];
+    if (!desc.valid || desc.fileId != id)
+      continue;
+
+    std::int32_t unpinned = 0;
+    if (!desc.pinCnt.compare_exchange_strong(unpinned, -1))
+    {
+      // -1: another process is evicting it and writes it back
+      if (unpinned > 0)
+        throw PagePinnedException(file->filename(), desc.pageNo, frame);
+      continue;
+    }
+
+    // the page may have changed before the claim
+    if (desc.valid && desc.fileId == id)
+      dropClaimed(frame);
+    desc.pinCnt = 0;
+  }
+  file->flush();
+
+  // the File object may be deleted once flushed
+  std::lock_guard<std::mutex> localGuard(localLatch);
+  fileIds.erase(file);
+  std::map<std::uint32_t, File*>::iterator it = localFiles.find(id);
+  if (it != localFiles.end() && it->second == file)
+    localFiles.erase(it);
+}
+
+void ShmBufMgr::flushAll()
+{
+  std::vector<bool> written(MAX_FILES, false);
+  for (std::uint32_t frame = 0; frame < header->numBufs; frame++)
+  {
+    Frame& desc = frames[frame];
+    if (!desc.valid || !desc.dirty)
+      continue;
+
+    std::int32_t unpinned = 0;
+    if (!desc.pinCnt.compare_exchange_strong(unpinned, -1))
+      continue;
+    if (desc.valid && desc.dirty)
+    {
+      try
+      {
+        localFile(desc.fileId)->writePage(desc.pageNo, pages[frame]);
+      }
+      catch(...)
+      {
+        desc.pinCnt = 0;
+        throw;
+      }
+      desc.dirty = false;
+      written[desc.fileId] = true;
+    }
+    desc.pinCnt = 0;
+  }
+
+  for (std::uint32_t id = 0; id < (std::uint32_t)MAX_FILES; id++)
+    if (written[id])
+      localFile(id)->flush();
+}
+
+}
@@ -0,0 +1,296 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <pthread.h>
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+* @brief Buffer pool kept in a POSIX shared memory segment, so that several
+* processes working on the same files share one cache.
+*
+* Frames, their descriptors, the hash table and a table of file names all
+* live in the segment; the first process to open it creates it and the others
+* attach. Files are identified by name, since File objects are private to a
+* process. A page made dirty by one process is seen by the others at once and
+* written back by whichever process evicts or flushes it, opening the file by
+* name if it has not done so itself.
+*
+* Hash table partitions are process shared (and robust) pthread mutexes.
+* Frames are pinned with a compare and swap on their pin count, which an
+* evicting process sets to -1 to keep everybody else out while it writes the
+* page back. Replacement is clock. Pins are not released if a process dies
+* while holding them, so the frames stay pinned until the segment is removed.
+*
+* This is a separate, smaller buffer manager rather than a mode of BufMgr: the
+* BufMgr state (File pointers as keys, std::mutex latches, policy objects,
+* buffer rings, I/O threads) cannot be placed in shared memory. Allocating
+* pages in one file from several processes at once is not supported, as the
+* file header is updated without a lock between processes.
+*/
+class ShmBufMgr
+{
+ private:
+	/**
+   * Number of hash table partitions, each with its own latch
+	 */
+  static const int NUM_PARTITIONS = 64;
+
+	/**
+   * Number of files the segment can hold names for, and longest name
+	 */
+  static const int MAX_FILES = 64;
+  static const int MAX_NAME = 256;
+
+	/**
+   * Marks no frame in a hash chain
+	 */
+  static const std::uint32_t NO_FRAME = 0xffffffff;
+
+	/**
+   * A file known to the segment
+	 */
+  struct FileSlot
+  {
+    bool used;
+    bool blob;
+    char name[MAX_NAME];
+  };
+
+	/**
+   * State of one frame. pinCnt is -1 while a process claims the frame to
+	 * evict its page. The page (fileId, pageNo) and hashNext only change under
+	 * the latch of the partition the page hashes to.
+	 */
+  struct Frame
+  {
+    std::atomic<std::int32_t> pinCnt;
+    std::atomic<bool> valid;
+    std::atomic<bool> dirty;
+    std::atomic<bool> refbit;
+    std::atomic<bool> ioInProgress;
+    std::uint32_t fileId;
+    PageId pageNo;
+    std::uint32_t hashNext;
+  };
+
+	/**
+   * Start of the segment. Followed by the frames, the hash buckets and the
+	 * pages.
+	 */
+  struct Header
+  {
+    std::atomic<std::uint64_t> magic;
+    std::uint32_t numBufs;
+    std::uint32_t numBuckets;
+    std::atomic<std::uint32_t> clockHand;
+    std::atomic<std::int32_t> attached;
+    pthread_mutex_t fileLatch;
+    pthread_mutex_t partitions[NUM_PARTITIONS];
+    FileSlot files[MAX_FILES];
+  };
+
+	/**
+   * Name of the segment
+	 */
+  const std::string name;
+
+	/**
+   * The mapped segment and its size
+	 */
+  void* segment;
+  std::size_t segmentSize;
+
+	/**
+   * Parts of the segment
+	 */
+  Header* header;
+  Frame* frames;
+  std::uint32_t* buckets;
+  Page* pages;
+
+	/**
+   * Ids of the files this process used, and the File object of each id.
+	 * Files opened by name for write-back are owned and deleted by this object.
+	 */
+  std::map<const File*, std::uint32_t> fileIds;
+  std::map<std::uint32_t, File*> localFiles;
+  std::map<std::uint32_t, File*> ownedFiles;
+  std::mutex localLatch;
+
+	/**
+   * Size of the segment for the given number of frames.
+	 */
+  static std::size_t segmentBytes(const std::uint32_t bufs, const std::uint32_t numBuckets);
+
+	/**
+   * Lock a process shared mutex, recovering it if its owner died.
+	 */
+  static void lock(pthread_mutex_t* latch);
+
+	/**
+   * Create the segment and initialize it, or attach to it if it exists.
+	 */
+  void createOrAttach(const std::uint32_t bufs);
+
+	/**
+   * Point header, frames, buckets and pages into the mapped segment.
+	 */
+  void mapParts(const std::uint32_t bufs, const std::uint32_t numBuckets);
+
+	/**
+   * Id of the file in the segment, adding its name if needed.
+	 *
+   * @throws  SharedMemoryException If the file table is full or the name too long
+	 */
+  std::uint32_t fileId(const File* file);
+
+	/**
+   * This process's File object for an id, opening the file if needed.
+	 */
+  File* localFile(const std::uint32_t id);
+
+	/**
+   * Hash bucket and partition latch of a page.
+	 */
+  std::uint32_t bucketOf(const std::uint32_t id, const PageId pageNo) const;
+  pthread_mutex_t* partitionOf(const std::uint32_t bucket) const;
+
+	/**
+   * Frame holding the page, or NO_FRAME. Partition latch must be held.
+	 */
+  std::uint32_t lookup(const std::uint32_t bucket, const std::uint32_t id, const PageId pageNo) const;
+
+	/**
+   * Unlink a frame from its hash chain. Partition latch must be held.
+	 */
+  void unlink(const std::uint32_t bucket, const std::uint32_t frame);
+
+	/**
+   * Pin a frame found in the hash table unless it is being evicted.
+	 * Partition latch must be held.
+	 *
+   * @return  False if the frame is claimed for eviction
+	 */
+  bool tryPin(const std::uint32_t frame);
+
+	/**
+   * Write back a claimed frame's page if dirty and drop it from the hash
+	 * table. On a failed write the claim is undone and the error rethrown.
+	 */
+  void dropClaimed(const std::uint32_t frame);
+
+	/**
+   * Claim a frame for a new page, evicting the page in it. The frame is
+	 * returned with pinCnt -1 and not valid.
+	 *
+   * @throws  BufferExceededException If every frame is pinned
+	 */
+  std::uint32_t claimFrame();
+
+	/**
+   * Install a page in a claimed frame, pinned once and marked as being read.
+	 * If another process installed the page in the meantime, the claimed frame
+	 * is released.
+	 *
+   * @return  True if the page was installed
+	 */
+  bool install(const std::uint32_t frame, const std::uint32_t id, const PageId pageNo);
+
+ public:
+	/**
+   * Opens the segment of the given name, creating it with bufs frames if it
+	 * does not exist. Attaching to an existing segment uses its size.
+	 *
+	 * @param name   	Name of the segment, e.g. "/badgerdb"
+	 * @param bufs   	Number of frames if the segment is created
+   * @throws  SharedMemoryException If the segment cannot be created or mapped
+	 */
+  ShmBufMgr(const std::string& name, const std::uint32_t bufs);
+
+	/**
+   * Detaches from the segment. The last process to detach writes back all
+	 * dirty pages; the segment itself stays until remove() is called.
+	 */
+  ~ShmBufMgr();
+
+	/**
+   * Removes the segment of the given name. Processes still attached keep
+	 * using it; new ones create a fresh one.
+	 *
+	 * @param name   	Name of the segment
+	 */
+  static void remove(const std::string& name);
+
+	/**
+   * Reads the page into a frame if needed, pins it and returns it.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param page  	Pinned page returned via this variable
+	 */
+  void readPage(File* file, const PageId pageNo, Page*& page);
+
+	/**
+   * Unpins a page.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number
+	 * @param dirty		True if the page needs to be marked dirty
+   * @throws  PageNotPinnedException If the page is not pinned
+   * @throws  HashNotFoundException If the page is not in the buffer pool
+	 */
+  void unPinPage(File* file, const PageId pageNo, const bool dirty);
+
+	/**
+   * Allocates a new page in the file and pins it.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number of the new page returned via this variable
+	 * @param page  	Pinned page returned via this variable
+	 */
+  void allocPage(File* file, PageId& pageNo, Page*& page);
+
+	/**
+   * Writes back the file's dirty pages, drops all its pages from the pool,
+	 * whichever process read them, and flushes the file to disk.
+	 *
+	 * @param file   	File object
+   * @throws  PagePinnedException If a page of the file is pinned
+	 */
+  void flushFile(const File* file);
+
+	/**
+   * Writes back every dirty page that is not pinned and flushes the files
+	 * written to disk. Pages stay in the pool.
+	 */
+  void flushAll();
+
+	/**
+   * Returns the number of frames and of processes attached.
+	 */
+  std::uint32_t numFrames() const
+  {
+    return header->numBufs;
+  }
+  std::int32_t numAttached() const
+  {
+    return header->attached;
+  }
+};
+
+}
@@ -0,0 +1,232 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "victimCache.h"
+
+namespace badgerdb {
+
+/**
+ * Control bytes below REPEAT are followed by control + 1 literal bytes,
+ * LONG_RUN by a two byte count (low byte first) and the byte repeated that
+ * many times, the others by one byte repeated control - REPEAT + MIN_RUN
+ * times.
+ */
+static const unsigned char REPEAT = 0x80;
+static const unsigned char LONG_RUN = 0xff;
+static const std::size_t MIN_RUN = 3;
+static const std::size_t MAX_RUN = LONG_RUN - 1 - REPEAT + MIN_RUN;
+static const std::size_t MAX_LITERALS = REPEAT;
+
+/**
+ * Appends src[start, end) as literal runs to out, unless that takes it past
+ * limit bytes.
+ */
+static bool appendLiterals(const char* src, std::size_t start, const std::size_t end,
+                           char* out, std::size_t& used, const std::size_t limit)
+{
+  while (start < end)
+  {
+    const std::size_t count = std::min(end - start, MAX_LITERALS);
+    if (used + 1 + count > limit)
+      return false;
+    out[used++] = (char)(count - 1);
+    memcpy(out + used, src + start, count);
+    used += count;
+    start += count;
+  }
+  return true;
+}
+
+/**
+ * Appends a run of count copies of a byte to out, unless that takes it past
+ * limit bytes.
+ */
+static bool appendRun(const char byte, const std::size_t count, char* out, std::size_t& used,
+                      const std::size_t limit)
+{
+  if (used + (count > MAX_RUN ? 4 : 2) > limit)
+    return false;
+  if (count > MAX_RUN)
+  {
+    out[used++] = (char)LONG_RUN;
+    out[used++] = (char)(count & 0xff);
+    out[used++] = (char)(count >> 8);
+  }
+  else
+  {
+    out[used++] = (char)(REPEAT + count - MIN_RUN);
+  }
+  out[used++] = byte;
+  return true;
+}
+
+CompressedVictimCache::CompressedVictimCache()
+  : capacity(0), used(0)
+{
+}
+
+bool CompressedVictimCache::compress(const Page& page, std::string& packed)
+{
+  const char* src = reinterpret_cast<const char*>(&page);
+  const std::size_t size = Page::SIZE;
+  const std::size_t limit = size / 2;
+
+  // packed into the stack first, so the string kept in the cache is no
+  // larger than the page it holds
+  char out[Page::SIZE / 2];
+  std::size_t used = 0;
+  std::size_t literals = 0;
+  std::size_t i = 0;
+  while (i < size)
+  {
+    // free space is long runs of zeroes, compare 32 and then eight bytes at
+    // a time
+    std::size_t run = 1;
+    const std::uint64_t pattern = 0x0101010101010101ULL * (unsigned char)src[i];
+    std::uint64_t words[4];
+    while (i + run + 32 <= size && (memcpy(words, src + i + run, 32),
+        ((words[0] ^ pattern) | (words[1] ^ pattern) | (words[2] ^ pattern) | (words[3] ^ pattern)) == 0))
+      run += 32;
+    while (i + run + 8 <= size && (memcpy(words, src + i + run, 8), words[0] == pattern))
+      run += 8;
+    while (i + run < size && src[i + run] == src[i])
+      run++;
+
+    if (run >= MIN_RUN)
+    {
+      if (!appendLiterals(src, literals, i, out, used, limit) || !appendRun(src[i], run, out, used, limit))
+        return false;
+      i += run;
+      literals = i;
+    }
+    else
+    {
+      i += run;
+    }
+
+    // not worth keeping
+    if (used + (i - literals) > limit)
+      return false;
+  }
+  if (!appendLiterals(src, literals, size, out, used, limit))
+    return false;
+  packed.assign(out, used);
+  return true;
+}
+
+bool CompressedVictimCache::decompress(const std::string& packed, Page& page)
+{
+  char* dst = reinterpret_cast<char*>(&page);
+  const std::size_t size = Page::SIZE;
+  std::size_t out = 0;
+  std::size_t in = 0;
+  while (in < packed.size())
+  {
+    const unsigned char control = packed[in++];
+    if (control < REPEAT)
+    {
+      const std::size_t count = control + 1;
+      if (in + count > packed.size() || out + count > size)
+        return false;
+      memcpy(dst + out, packed.data() + in, count);
+      in += count;
+      out += count;
+    }
+    else
+    {
+      std::size_t count = control - REPEAT + MIN_RUN;
+      if (control == LONG_RUN)
+      {
+        if (in + 2 > packed.size())
+          return false;
+        count = (unsigned char)packed[in] | ((std::size_t)(unsigned char)packed[in + 1] << 8);
+        in += 2;
+      }
+      if (in >= packed.size() || out + count > size)
+        return false;
+      memset(dst + out, packed[in++], count);
+      out += count;
+    }
+  }
+  return out == size;
+}
+
+void CompressedVictimCache::setCapacity(const std::size_t bytes)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  capacity = bytes;
+  while (used > capacity)
+    drop(entries.find(order.front()));
+}
+
+void CompressedVictimCache::drop(std::map<PageKey, Entry>::iterator entry)
+{
+  used -= entry->second.packed.size() + ENTRY_OVERHEAD;
+  order.erase(entry->second.position);
+  entries.erase(entry);
+}
+
+void CompressedVictimCache::insert(const File* file, const PageId pageNo, std::string& packed)
+{
+  const PageKey key(file, pageNo);
+  std::lock_guard<std::mutex> guard(latch);
+  std::map<PageKey, Entry>::iterator it = entries.find(key);
+  if (it != entries.end())
+    drop(it);
+  if (packed.size() + ENTRY_OVERHEAD > capacity)
+    return;
+
+  while (used + packed.size() + ENTRY_OVERHEAD > capacity)
+    drop(entries.find(order.front()));
+
+  Entry& entry = entries[key];
+  entry.packed.swap(packed);
+  entry.position = order.insert(order.end(), key);
+  used += entry.packed.size() + ENTRY_OVERHEAD;
+}
+
+bool CompressedVictimCache::take(const File* file, const PageId pageNo, Page& page)
+{
+  std::string packed;
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    std::map<PageKey, Entry>::iterator it = entries.find(PageKey(file, pageNo));
+    if (it == entries.end())
+      return false;
+    packed.swap(it->second.packed);
+    used -= packed.size();
+    drop(it);
+  }
+  return decompress(packed, page);
+}
+
+void CompressedVictimCache::erase(const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  std::map<PageKey, Entry>::iterator it = entries.find(PageKey(file, pageNo));
+  if (it != entries.end())
+    drop(it);
+}
+
+void CompressedVictimCache::eraseFile(const File* file)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  std::map<PageKey, Entry>::iterator it = entries.lower_bound(PageKey(file, 0));
+  while (it != entries.end() && it->first.first == file)
+    drop(it++);
+}
+
+void CompressedVictimCache::usage(std::size_t& pages, std::size_t& bytes)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  pages = entries.size();
+  bytes = used;
+}
+
+}
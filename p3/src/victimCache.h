@@ -0,0 +1,138 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include "file.h"
+#include "page.h"
+#include "replacer.h"
+
+namespace badgerdb {
+
+/**
+* @brief Second tier below the buffer pool holding clean pages evicted from
+* it, compressed, so that reading them again costs a decompression rather
+* than a disk read.
+*
+* Pages are compressed with a run-length code built for pages that are mostly
+* empty: runs of three or more equal bytes (the zeroed free space) are stored
+* as two bytes, or four when longer than 129 bytes, everything else as literal
+* bytes. Pages that do not shrink to half their size are not kept. The cache
+* is bounded in bytes and drops its least recently stored pages first.
+*
+* The cache only ever holds pages that are not in the pool and whose copy on
+* disk is the one it holds: BufMgr stores a page when it evicts it (after any
+* write back) and takes it out again when the page is read back in. A size of
+* 0, the default, disables it.
+*/
+class CompressedVictimCache
+{
+ public:
+  CompressedVictimCache();
+
+	/**
+   * Sets the number of bytes the cache may use, dropping pages if it shrinks.
+	 *
+	 * @param bytes   Size of the cache, 0 to disable it
+	 */
+  void setCapacity(const std::size_t bytes);
+
+	/**
+   * Returns true if the cache may hold pages.
+	 */
+  bool enabled() const
+  {
+    return capacity > 0;
+  }
+
+	/**
+   * Compresses a page.
+	 *
+	 * @param page    Page to compress
+	 * @param packed  Compressed page returned via this variable
+	 * @return  True if the page shrank to half its size or less
+	 */
+  static bool compress(const Page& page, std::string& packed);
+
+	/**
+   * Decompresses a page compressed by compress().
+	 *
+	 * @param packed  Compressed page
+	 * @param page    Page to decompress into
+	 * @return  False if the data was not a compressed page
+	 */
+  static bool decompress(const std::string& packed, Page& page);
+
+	/**
+   * Stores an evicted page, replacing any older copy.
+	 *
+	 * @param file    File of the page
+	 * @param pageNo  Page number in the file
+	 * @param packed  Page compressed by compress(), moved into the cache
+	 */
+  void insert(const File* file, const PageId pageNo, std::string& packed);
+
+	/**
+   * Removes a page from the cache and decompresses it.
+	 *
+	 * @param file    File of the page
+	 * @param pageNo  Page number in the file
+	 * @param page    Page to decompress into
+	 * @return  True if the page was in the cache
+	 */
+  bool take(const File* file, const PageId pageNo, Page& page);
+
+	/**
+   * Drops a page, or every page of a file, from the cache.
+	 */
+  void erase(const File* file, const PageId pageNo);
+  void eraseFile(const File* file);
+
+	/**
+   * Returns the number of pages in the cache and the bytes they take.
+	 */
+  void usage(std::size_t& pages, std::size_t& bytes);
+
+ private:
+	/**
+   * Bytes counted for each page on top of its compressed size
+	 */
+  static const std::size_t ENTRY_OVERHEAD = 96;
+
+	/**
+   * A compressed page and its position in the eviction order
+	 */
+  struct Entry
+  {
+    std::string packed;
+    std::list<PageKey>::iterator position;
+  };
+
+	/**
+   * Drops an entry, latch must be held.
+	 */
+  void drop(std::map<PageKey, Entry>::iterator entry);
+
+  std::atomic<std::size_t> capacity;
+  std::size_t used;
+  std::map<PageKey, Entry> entries;
+
+	/**
+   * Pages in the order they were stored, oldest first
+	 */
+  std::list<PageKey> order;
+
+  std::mutex latch;
+};
+
+}